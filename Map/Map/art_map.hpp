@@ -0,0 +1,904 @@
+/**
+ * implement an ordered map from std::string as an adaptive radix tree
+ */
+#ifndef SJTU_ART_MAP_HPP
+#define SJTU_ART_MAP_HPP
+
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include "utility.hpp"
+#include "exceptions.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SJTU_ART_SSE2
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace sjtu {
+
+/**
+ * an adaptive radix tree (Leis et al., ICDE 2013) over the bytes of the key.
+ *
+ * an inner node branches on one byte and comes in four sizes: node4 and
+ *   node16 keep sorted key bytes next to their children (node16 is
+ *   searched with one SSE2 compare), node48 maps a byte to one of 48
+ *   slots, node256 is indexed by the byte directly.  a node grows into the
+ *   next size when it is full and shrinks back when it gets sparse.
+ * a chain of nodes with one child is compressed into the prefix of the
+ *   node below it; only the first max_prefix bytes are stored, the rest
+ *   is checked against a leaf when needed.  a lookup compares each byte
+ *   of the key at most once, plus one full compare at the leaf, instead
+ *   of a full string compare at every level of a binary tree.
+ * a key that is a proper prefix of other keys ends at an inner node and
+ *   is kept in its term slot, which sorts before all of its children.
+ * the leaves are threaded in key order like the nodes of sjtu::map, so
+ *   iteration is a walk along the thread.
+ *
+ * iterators and references stay valid until their element is erased.
+ */
+template<class T>
+class art_map {
+public:
+	typedef pair<const std::string, T> value_type;
+private:
+	static const unsigned char leaf_type = 0, node4_type = 1, node16_type = 2, node48_type = 3, node256_type = 4;
+	static const unsigned int max_prefix = 10;
+	class node {
+	public:
+		unsigned char type;
+		explicit node(unsigned char type) :type(type) {}
+	};
+	class leaf : public node {
+	public:
+		value_type data;
+		leaf *pr, *nx;
+		leaf(const value_type &v) :node(leaf_type), data(v), pr(NULL), nx(NULL) {}
+	};
+	class inner : public node {
+	public:
+		// children only, the term leaf is not counted
+		unsigned short count;
+		unsigned int plen;
+		unsigned char pre[max_prefix];
+		leaf* term;
+		explicit inner(unsigned char type) :node(type), count(0), plen(0), term(NULL) {}
+	};
+	class node4 : public inner {
+	public:
+		unsigned char key[4];
+		node* child[4];
+		node4() :inner(node4_type) {}
+	};
+	class node16 : public inner {
+	public:
+		unsigned char key[16];
+		node* child[16];
+		node16() :inner(node16_type) {}
+	};
+	class node48 : public inner {
+	public:
+		// 0 for no child, i + 1 for child[i]
+		unsigned char index[256];
+		node* child[48];
+		node48() :inner(node48_type) {
+			memset(index, 0, sizeof(index));
+			for (int i = 0; i < 48; i++) child[i] = NULL;
+		}
+	};
+	class node256 : public inner {
+	public:
+		node* child[256];
+		node256() :inner(node256_type) {
+			for (int i = 0; i < 256; i++) child[i] = NULL;
+		}
+	};
+public:
+	class const_iterator;
+	class iterator {
+		friend class art_map;
+		friend class const_iterator;
+	private:
+		leaf* p;
+		const art_map* t;
+	public:
+		iterator() :p(NULL), t(NULL) {}
+		iterator(leaf* p, const art_map* t) :p(p), t(t) {}
+		iterator(const iterator &other) :p(other.p), t(other.t) {}
+		iterator& operator =(const iterator &other) {
+			if (this == &other) return *this;
+			p = other.p;
+			t = other.t;
+			return *this;
+		}
+		iterator & operator++() {
+			if (p == NULL) throw invalid_iterator("from art_map::iterator::operator++");
+			p = p->nx;
+			return *this;
+		}
+		iterator operator++(int) {
+			iterator nw(*this);
+			++(*this);
+			return nw;
+		}
+		iterator & operator--() {
+			if (t == NULL) throw invalid_iterator("from art_map::iterator::operator--");
+			leaf* q = (p == NULL) ? t->bk : p->pr;
+			if (q == NULL) throw invalid_iterator("from art_map::iterator::operator--");
+			p = q;
+			return *this;
+		}
+		iterator operator--(int) {
+			iterator nw(*this);
+			--(*this);
+			return nw;
+		}
+		value_type & operator*() const {
+			return p->data;
+		}
+		value_type* operator->() const noexcept {
+			return &(p->data);
+		}
+		bool operator==(const iterator &rhs) const {
+			return (p == rhs.p && t == rhs.t);
+		}
+		bool operator==(const const_iterator &rhs) const {
+			return (p == rhs.p && t == rhs.t);
+		}
+		bool operator!=(const iterator &rhs) const {
+			return !(*this == rhs);
+		}
+		bool operator!=(const const_iterator &rhs) const {
+			return !(*this == rhs);
+		}
+	};
+	class const_iterator {
+		friend class art_map;
+		friend class iterator;
+	private:
+		leaf* p;
+		const art_map* t;
+	public:
+		const_iterator() :p(NULL), t(NULL) {}
+		const_iterator(leaf* p, const art_map* t) :p(p), t(t) {}
+		const_iterator(const const_iterator &other) :p(other.p), t(other.t) {}
+		const_iterator(const iterator &other) :p(other.p), t(other.t) {}
+		const_iterator& operator =(const const_iterator &other) {
+			if (this == &other) return *this;
+			p = other.p;
+			t = other.t;
+			return *this;
+		}
+		const_iterator & operator++() {
+			if (p == NULL) throw invalid_iterator("from art_map::const_iterator::operator++");
+			p = p->nx;
+			return *this;
+		}
+		const_iterator operator++(int) {
+			const_iterator nw(*this);
+			++(*this);
+			return nw;
+		}
+		const_iterator & operator--() {
+			if (t == NULL) throw invalid_iterator("from art_map::const_iterator::operator--");
+			leaf* q = (p == NULL) ? t->bk : p->pr;
+			if (q == NULL) throw invalid_iterator("from art_map::const_iterator::operator--");
+			p = q;
+			return *this;
+		}
+		const_iterator operator--(int) {
+			const_iterator nw(*this);
+			--(*this);
+			return nw;
+		}
+		const value_type & operator*() const {
+			return p->data;
+		}
+		const value_type* operator->() const noexcept {
+			return &(p->data);
+		}
+		bool operator==(const iterator &rhs) const {
+			return (p == rhs.p && t == rhs.t);
+		}
+		bool operator==(const const_iterator &rhs) const {
+			return (p == rhs.p && t == rhs.t);
+		}
+		bool operator!=(const iterator &rhs) const {
+			return !(*this == rhs);
+		}
+		bool operator!=(const const_iterator &rhs) const {
+			return !(*this == rhs);
+		}
+	};
+	art_map() :root(NULL), bg(NULL), bk(NULL), n(0) {}
+	art_map(const art_map &other) :root(NULL), bg(NULL), bk(NULL), n(0) {
+		for (leaf* p = other.bg; p != NULL; p = p->nx) insert(p->data);
+	}
+	art_map & operator=(const art_map &other) {
+		if (this == &other) return *this;
+		clear();
+		for (leaf* p = other.bg; p != NULL; p = p->nx) insert(p->data);
+		return *this;
+	}
+	~art_map() {
+		clear();
+	}
+	/**
+	 * access specified element with bounds checking
+	 * If no such element exists, an exception of type `index_out_of_bound'
+	 */
+	T & at(const std::string &key) {
+		leaf* p = search(key);
+		if (p == NULL) throw index_out_of_bound("from art_map::at");
+		return p->data.second;
+	}
+	const T & at(const std::string &key) const {
+		leaf* p = search(key);
+		if (p == NULL) throw index_out_of_bound("from art_map::at");
+		return p->data.second;
+	}
+	/**
+	 * access specified element, performing an insertion if such key does not already exist.
+	 */
+	T & operator[](const std::string &key) {
+		leaf* p = search(key);
+		if (p == NULL) p = insert(value_type(key, T())).first.p;
+		return p->data.second;
+	}
+	/**
+	 * behave like at() throw index_out_of_bound if such key does not exist.
+	 */
+	const T & operator[](const std::string &key) const {
+		return at(key);
+	}
+	iterator begin() { return iterator(bg, this); }
+	const_iterator cbegin() const { return const_iterator(bg, this); }
+	iterator end() { return iterator(NULL, this); }
+	const_iterator cend() const { return const_iterator(NULL, this); }
+	bool empty() const { return n == 0; }
+	size_t size() const { return n; }
+	void clear() {
+		destroy(root);
+		root = NULL;
+		bg = bk = NULL;
+		n = 0;
+	}
+	/**
+	 * insert an element.
+	 * return a pair, the first of the pair is
+	 *   the iterator to the new element (or the element that prevented the insertion),
+	 *   the second one is true if insert successfully, or false.
+	 */
+	pair<iterator, bool> insert(const value_type &value) {
+		const std::string &key = value.first;
+		if (root == NULL) {
+			leaf* l = new leaf(value);
+			root = l;
+			bg = bk = l;
+			n = 1;
+			return pair<iterator, bool>(iterator(l, this), true);
+		}
+		node** ref = &root;
+		size_t depth = 0;
+		for (;;) {
+			if ((*ref)->type == leaf_type) {
+				leaf* o = static_cast<leaf*>(*ref);
+				const std::string &ok = o->data.first;
+				if (ok == key) return pair<iterator, bool>(iterator(o, this), false);
+				size_t i = depth;
+				while (i < key.size() && i < ok.size() && key[i] == ok[i]) i++;
+				leaf* l = new leaf(value);
+				node4* nn = new node4;
+				set_prefix(nn, key, depth, (unsigned int)(i - depth));
+				hang(nn, o, i);
+				hang(nn, l, i);
+				*ref = nn;
+				if (key < ok) link_before(l, o); else link_after(l, o);
+				n++;
+				return pair<iterator, bool>(iterator(l, this), true);
+			}
+			inner* in = static_cast<inner*>(*ref);
+			unsigned int m = matched(in, key, depth);
+			if (m < in->plen) {
+				// the key leaves the compressed path: a new node4 takes the matched part
+				unsigned char b = prefix_byte(in, depth, m);
+				leaf* lo = minimum(in);
+				leaf* l = new leaf(value);
+				node4* nn = new node4;
+				set_prefix(nn, key, depth, m);
+				cut_prefix(in, depth, m + 1);
+				add_child4(nn, b, in);
+				*ref = nn;
+				hang(nn, l, depth + m);
+				if (key.size() == depth + m || (unsigned char)key[depth + m] < b) link_before(l, lo);
+				else link_after(l, maximum(in));
+				n++;
+				return pair<iterator, bool>(iterator(l, this), true);
+			}
+			depth += in->plen;
+			if (key.size() == depth) {
+				if (in->term != NULL) return pair<iterator, bool>(iterator(in->term, this), false);
+				leaf* l = new leaf(value);
+				in->term = l;
+				link_before(l, minimum(first_child(in)));
+				n++;
+				return pair<iterator, bool>(iterator(l, this), true);
+			}
+			unsigned char c = key[depth];
+			node** next = find_child(in, c);
+			if (next == NULL) {
+				leaf* l = new leaf(value);
+				node* s = next_child(in, c);
+				if (s != NULL) link_before(l, minimum(s));
+				else {
+					node* q = prev_child(in, c);
+					link_after(l, (q != NULL) ? maximum(q) : in->term);
+				}
+				add_child(*ref, c, l);
+				n++;
+				return pair<iterator, bool>(iterator(l, this), true);
+			}
+			ref = next;
+			depth++;
+		}
+	}
+	/**
+	 * erase the element at pos.
+	 *
+	 * throw if pos pointed to a bad element (pos == this->end() || pos points an element out of this)
+	 */
+	void erase(iterator pos) {
+		if (pos.t != this) throw invalid_iterator("from art_map::erase Not for this map");
+		if (pos.p == NULL) throw invalid_iterator("from art_map::erase end()");
+		remove(pos.p);
+	}
+	/**
+	 * erase the element with key, return the number erased (0 or 1).
+	 */
+	size_t erase(const std::string &key) {
+		leaf* p = search(key);
+		if (p == NULL) return 0;
+		remove(p);
+		return 1;
+	}
+	size_t count(const std::string &key) const {
+		return (search(key) == NULL) ? 0 : 1;
+	}
+	iterator find(const std::string &key) {
+		return iterator(search(key), this);
+	}
+	const_iterator find(const std::string &key) const {
+		return const_iterator(search(key), this);
+	}
+	/**
+	 * the range [first, last) of the elements whose key starts with prefix,
+	 *   found by one descent: the subtree below the point where prefix runs
+	 *   out holds exactly those keys, and they are contiguous on the thread.
+	 * an empty range is (end(), end()).
+	 */
+	pair<iterator, iterator> prefix_range(const std::string &prefix) {
+		node* x = cover(prefix);
+		if (x == NULL) return pair<iterator, iterator>(end(), end());
+		return pair<iterator, iterator>(iterator(minimum(x), this), iterator(maximum(x)->nx, this));
+	}
+	pair<const_iterator, const_iterator> prefix_range(const std::string &prefix) const {
+		node* x = cover(prefix);
+		if (x == NULL) return pair<const_iterator, const_iterator>(cend(), cend());
+		return pair<const_iterator, const_iterator>(const_iterator(minimum(x), this), const_iterator(maximum(x)->nx, this));
+	}
+private:
+	node* root;
+	leaf *bg, *bk;
+	size_t n;
+	static int lowest_bit(unsigned int x) {
+#if defined(__GNUC__)
+		return __builtin_ctz(x);
+#elif defined(_MSC_VER)
+		unsigned long i;
+		_BitScanForward(&i, x);
+		return (int)i;
+#else
+		int i = 0;
+		while (!(x & 1)) x >>= 1, i++;
+		return i;
+#endif
+	}
+	static node** find_child(inner* in, unsigned char c) {
+		switch (in->type) {
+		case node4_type: {
+			node4* x = static_cast<node4*>(in);
+			for (int i = 0; i < x->count; i++)
+				if (x->key[i] == c) return x->child + i;
+			return NULL;
+		}
+		case node16_type: {
+			node16* x = static_cast<node16*>(in);
+#ifdef SJTU_ART_SSE2
+			__m128i eq = _mm_cmpeq_epi8(_mm_set1_epi8((char)c), _mm_loadu_si128((const __m128i*)x->key));
+			unsigned int mask = (unsigned int)_mm_movemask_epi8(eq) & ((1u << x->count) - 1);
+			if (mask == 0) return NULL;
+			return x->child + lowest_bit(mask);
+#else
+			for (int i = 0; i < x->count; i++)
+				if (x->key[i] == c) return x->child + i;
+			return NULL;
+#endif
+		}
+		case node48_type: {
+			node48* x = static_cast<node48*>(in);
+			if (x->index[c] == 0) return NULL;
+			return x->child + (x->index[c] - 1);
+		}
+		default: {
+			node256* x = static_cast<node256*>(in);
+			if (x->child[c] == NULL) return NULL;
+			return x->child + c;
+		}
+		}
+	}
+	/**
+	 * the child with the smallest byte greater than c (next_child),
+	 *   or the largest byte less than c (prev_child), or NULL.
+	 */
+	static node* next_child(inner* in, unsigned char c) {
+		switch (in->type) {
+		case node4_type: {
+			node4* x = static_cast<node4*>(in);
+			for (int i = 0; i < x->count; i++)
+				if (x->key[i] > c) return x->child[i];
+			return NULL;
+		}
+		case node16_type: {
+			node16* x = static_cast<node16*>(in);
+			for (int i = 0; i < x->count; i++)
+				if (x->key[i] > c) return x->child[i];
+			return NULL;
+		}
+		case node48_type: {
+			node48* x = static_cast<node48*>(in);
+			for (int i = c + 1; i < 256; i++)
+				if (x->index[i] != 0) return x->child[x->index[i] - 1];
+			return NULL;
+		}
+		default: {
+			node256* x = static_cast<node256*>(in);
+			for (int i = c + 1; i < 256; i++)
+				if (x->child[i] != NULL) return x->child[i];
+			return NULL;
+		}
+		}
+	}
+	static node* prev_child(inner* in, unsigned char c) {
+		switch (in->type) {
+		case node4_type: {
+			node4* x = static_cast<node4*>(in);
+			for (int i = x->count - 1; i >= 0; i--)
+				if (x->key[i] < c) return x->child[i];
+			return NULL;
+		}
+		case node16_type: {
+			node16* x = static_cast<node16*>(in);
+			for (int i = x->count - 1; i >= 0; i--)
+				if (x->key[i] < c) return x->child[i];
+			return NULL;
+		}
+		case node48_type: {
+			node48* x = static_cast<node48*>(in);
+			for (int i = c - 1; i >= 0; i--)
+				if (x->index[i] != 0) return x->child[x->index[i] - 1];
+			return NULL;
+		}
+		default: {
+			node256* x = static_cast<node256*>(in);
+			for (int i = c - 1; i >= 0; i--)
+				if (x->child[i] != NULL) return x->child[i];
+			return NULL;
+		}
+		}
+	}
+	static node* first_child(inner* in) {
+		switch (in->type) {
+		case node4_type: return static_cast<node4*>(in)->child[0];
+		case node16_type: return static_cast<node16*>(in)->child[0];
+		case node48_type: {
+			node48* x = static_cast<node48*>(in);
+			int i = 0;
+			while (x->index[i] == 0) i++;
+			return x->child[x->index[i] - 1];
+		}
+		default: {
+			node256* x = static_cast<node256*>(in);
+			int i = 0;
+			while (x->child[i] == NULL) i++;
+			return x->child[i];
+		}
+		}
+	}
+	static node* last_child(inner* in) {
+		switch (in->type) {
+		case node4_type: return static_cast<node4*>(in)->child[in->count - 1];
+		case node16_type: return static_cast<node16*>(in)->child[in->count - 1];
+		case node48_type: {
+			node48* x = static_cast<node48*>(in);
+			int i = 255;
+			while (x->index[i] == 0) i--;
+			return x->child[x->index[i] - 1];
+		}
+		default: {
+			node256* x = static_cast<node256*>(in);
+			int i = 255;
+			while (x->child[i] == NULL) i--;
+			return x->child[i];
+		}
+		}
+	}
+	static leaf* minimum(node* x) {
+		while (x->type != leaf_type) {
+			inner* in = static_cast<inner*>(x);
+			if (in->term != NULL) return in->term;
+			x = first_child(in);
+		}
+		return static_cast<leaf*>(x);
+	}
+	static leaf* maximum(node* x) {
+		while (x->type != leaf_type) {
+			inner* in = static_cast<inner*>(x);
+			if (in->count == 0) return in->term;
+			x = last_child(in);
+		}
+		return static_cast<leaf*>(x);
+	}
+	/**
+	 * store bytes [from, from + len) of key as the prefix of in.
+	 */
+	static void set_prefix(inner* in, const std::string &key, size_t from, unsigned int len) {
+		in->plen = len;
+		for (unsigned int i = 0; i < len && i < max_prefix; i++) in->pre[i] = (unsigned char)key[from + i];
+	}
+	/**
+	 * byte i of the prefix of in, which sits at depth.
+	 */
+	static unsigned char prefix_byte(inner* in, size_t depth, unsigned int i) {
+		if (i < max_prefix) return in->pre[i];
+		return (unsigned char)minimum(in)->data.first[depth + i];
+	}
+	/**
+	 * drop the first k bytes of the prefix of in, which sits at depth.
+	 */
+	static void cut_prefix(inner* in, size_t depth, unsigned int k) {
+		unsigned int len = in->plen - k;
+		if (in->plen <= max_prefix) memmove(in->pre, in->pre + k, len);
+		else set_prefix(in, minimum(in)->data.first, depth + k, len);
+		in->plen = len;
+	}
+	/**
+	 * the number of prefix bytes of in that match key from depth on,
+	 *   stopping at the end of key.
+	 */
+	static unsigned int matched(inner* in, const std::string &key, size_t depth) {
+		unsigned int i = 0;
+		for (; i < in->plen && i < max_prefix; i++)
+			if (depth + i == key.size() || in->pre[i] != (unsigned char)key[depth + i]) return i;
+		if (i == in->plen) return i;
+		const std::string &full = minimum(in)->data.first;
+		for (; i < in->plen; i++)
+			if (depth + i == key.size() || full[depth + i] != key[depth + i]) return i;
+		return i;
+	}
+	/**
+	 * put a leaf into the new node4 nn: into the term slot if its key ends
+	 *   at depth, else under its byte at depth.
+	 */
+	static void hang(node4* nn, leaf* l, size_t depth) {
+		const std::string &k = l->data.first;
+		if (k.size() == depth) nn->term = l;
+		else add_child4(nn, (unsigned char)k[depth], l);
+	}
+	static void add_child4(node4* x, unsigned char c, node* child) {
+		int i = x->count;
+		while (i > 0 && x->key[i - 1] > c) {
+			x->key[i] = x->key[i - 1];
+			x->child[i] = x->child[i - 1];
+			i--;
+		}
+		x->key[i] = c;
+		x->child[i] = child;
+		x->count++;
+	}
+	static void copy_header(inner* to, const inner* from) {
+		to->count = from->count;
+		to->plen = from->plen;
+		memcpy(to->pre, from->pre, max_prefix);
+		to->term = from->term;
+	}
+	/**
+	 * add a child under byte c, ref is replaced by a larger node when full.
+	 */
+	static void add_child(node* &ref, unsigned char c, node* child) {
+		inner* in = static_cast<inner*>(ref);
+		switch (in->type) {
+		case node4_type: {
+			node4* x = static_cast<node4*>(in);
+			if (x->count < 4) {
+				add_child4(x, c, child);
+				return;
+			}
+			node16* y = new node16;
+			copy_header(y, x);
+			memcpy(y->key, x->key, 4);
+			for (int i = 0; i < 4; i++) y->child[i] = x->child[i];
+			delete x;
+			ref = y;
+			add_child(ref, c, child);
+			return;
+		}
+		case node16_type: {
+			node16* x = static_cast<node16*>(in);
+			if (x->count < 16) {
+				int i = x->count;
+				while (i > 0 && x->key[i - 1] > c) {
+					x->key[i] = x->key[i - 1];
+					x->child[i] = x->child[i - 1];
+					i--;
+				}
+				x->key[i] = c;
+				x->child[i] = child;
+				x->count++;
+				return;
+			}
+			node48* y = new node48;
+			copy_header(y, x);
+			for (int i = 0; i < 16; i++) {
+				y->child[i] = x->child[i];
+				y->index[x->key[i]] = (unsigned char)(i + 1);
+			}
+			delete x;
+			ref = y;
+			add_child(ref, c, child);
+			return;
+		}
+		case node48_type: {
+			node48* x = static_cast<node48*>(in);
+			if (x->count < 48) {
+				int i = 0;
+				while (x->child[i] != NULL) i++;
+				x->child[i] = child;
+				x->index[c] = (unsigned char)(i + 1);
+				x->count++;
+				return;
+			}
+			node256* y = new node256;
+			copy_header(y, x);
+			for (int i = 0; i < 256; i++)
+				if (x->index[i] != 0) y->child[i] = x->child[x->index[i] - 1];
+			delete x;
+			ref = y;
+			add_child(ref, c, child);
+			return;
+		}
+		default: {
+			node256* x = static_cast<node256*>(in);
+			x->child[c] = child;
+			x->count++;
+			return;
+		}
+		}
+	}
+	/**
+	 * remove the child under byte c, ref is replaced by a smaller node
+	 *   when sparse (with some slack, so one byte going in and out does not
+	 *   resize every time).
+	 */
+	static void remove_child(node* &ref, unsigned char c) {
+		inner* in = static_cast<inner*>(ref);
+		switch (in->type) {
+		case node4_type:
+		case node16_type: {
+			unsigned char* key = (in->type == node4_type) ? static_cast<node4*>(in)->key : static_cast<node16*>(in)->key;
+			node** child = (in->type == node4_type) ? static_cast<node4*>(in)->child : static_cast<node16*>(in)->child;
+			int i = 0;
+			while (key[i] != c) i++;
+			for (; i + 1 < in->count; i++) {
+				key[i] = key[i + 1];
+				child[i] = child[i + 1];
+			}
+			in->count--;
+			if (in->type == node16_type && in->count <= 3) {
+				node4* y = new node4;
+				copy_header(y, in);
+				memcpy(y->key, key, in->count);
+				for (int j = 0; j < in->count; j++) y->child[j] = child[j];
+				delete static_cast<node16*>(in);
+				ref = y;
+			}
+			return;
+		}
+		case node48_type: {
+			node48* x = static_cast<node48*>(in);
+			x->child[x->index[c] - 1] = NULL;
+			x->index[c] = 0;
+			x->count--;
+			if (x->count <= 12) {
+				node16* y = new node16;
+				copy_header(y, x);
+				int k = 0;
+				for (int i = 0; i < 256; i++)
+					if (x->index[i] != 0) {
+						y->key[k] = (unsigned char)i;
+						y->child[k++] = x->child[x->index[i] - 1];
+					}
+				delete x;
+				ref = y;
+			}
+			return;
+		}
+		default: {
+			node256* x = static_cast<node256*>(in);
+			x->child[c] = NULL;
+			x->count--;
+			if (x->count <= 37) {
+				node48* y = new node48;
+				copy_header(y, x);
+				int k = 0;
+				for (int i = 0; i < 256; i++)
+					if (x->child[i] != NULL) {
+						y->child[k] = x->child[i];
+						y->index[i] = (unsigned char)(++k);
+					}
+				delete x;
+				ref = y;
+			}
+			return;
+		}
+		}
+	}
+	/**
+	 * a node4 left with a single entry is replaced by it; a child node
+	 *   takes over the prefix of the node and the byte leading to it.
+	 */
+	static void collapse(node* &ref, size_t depth) {
+		inner* in = static_cast<inner*>(ref);
+		if (in->type != node4_type || in->count + (in->term != NULL) != 1) return;
+		node4* x = static_cast<node4*>(in);
+		if (x->term != NULL) {
+			ref = x->term;
+			delete x;
+			return;
+		}
+		node* c = x->child[0];
+		if (c->type != leaf_type) {
+			inner* y = static_cast<inner*>(c);
+			unsigned int len = x->plen + 1 + y->plen;
+			set_prefix(y, minimum(y)->data.first, depth, len);
+		}
+		ref = c;
+		delete x;
+	}
+	static void free_node(node* x) {
+		switch (x->type) {
+		case leaf_type: delete static_cast<leaf*>(x); break;
+		case node4_type: delete static_cast<node4*>(x); break;
+		case node16_type: delete static_cast<node16*>(x); break;
+		case node48_type: delete static_cast<node48*>(x); break;
+		default: delete static_cast<node256*>(x); break;
+		}
+	}
+	static void destroy(node* x) {
+		if (x == NULL) return;
+		if (x->type != leaf_type) {
+			inner* in = static_cast<inner*>(x);
+			destroy(in->term);
+			switch (in->type) {
+			case node4_type:
+				for (int i = 0; i < in->count; i++) destroy(static_cast<node4*>(in)->child[i]);
+				break;
+			case node16_type:
+				for (int i = 0; i < in->count; i++) destroy(static_cast<node16*>(in)->child[i]);
+				break;
+			case node48_type:
+				for (int i = 0; i < 48; i++) destroy(static_cast<node48*>(in)->child[i]);
+				break;
+			default:
+				for (int i = 0; i < 256; i++) destroy(static_cast<node256*>(in)->child[i]);
+				break;
+			}
+		}
+		free_node(x);
+	}
+	void link_before(leaf* l, leaf* s) {
+		l->nx = s;
+		l->pr = s->pr;
+		if (s->pr == NULL) bg = l; else s->pr->nx = l;
+		s->pr = l;
+	}
+	void link_after(leaf* l, leaf* p) {
+		l->pr = p;
+		l->nx = p->nx;
+		if (p->nx == NULL) bk = l; else p->nx->pr = l;
+		p->nx = l;
+	}
+	/**
+	 * only the stored prefix bytes are compared on the way down, a key
+	 *   that differs in a byte beyond them is caught at the leaf.
+	 */
+	leaf* search(const std::string &key) const {
+		node* x = root;
+		size_t depth = 0;
+		while (x != NULL) {
+			if (x->type == leaf_type) {
+				leaf* l = static_cast<leaf*>(x);
+				return (l->data.first == key) ? l : NULL;
+			}
+			inner* in = static_cast<inner*>(x);
+			if (in->plen != 0) {
+				if (key.size() < depth + in->plen) return NULL;
+				unsigned int k = (in->plen < max_prefix) ? in->plen : max_prefix;
+				if (memcmp(in->pre, key.data() + depth, k) != 0) return NULL;
+				depth += in->plen;
+			}
+			if (key.size() == depth) {
+				leaf* l = in->term;
+				return (l != NULL && l->data.first == key) ? l : NULL;
+			}
+			node** c = find_child(in, (unsigned char)key[depth]);
+			if (c == NULL) return NULL;
+			x = *c;
+			depth++;
+		}
+		return NULL;
+	}
+	/**
+	 * the root of the subtree holding exactly the keys that start with prefix, or NULL.
+	 */
+	node* cover(const std::string &prefix) const {
+		node* x = root;
+		size_t depth = 0;
+		while (x != NULL) {
+			if (x->type == leaf_type) {
+				const std::string &k = static_cast<leaf*>(x)->data.first;
+				return (k.compare(0, prefix.size(), prefix) == 0) ? x : NULL;
+			}
+			inner* in = static_cast<inner*>(x);
+			unsigned int m = matched(in, prefix, depth);
+			if (depth + m == prefix.size()) return x;
+			if (m < in->plen) return NULL;
+			depth += in->plen;
+			node** c = find_child(in, (unsigned char)prefix[depth]);
+			if (c == NULL) return NULL;
+			x = *c;
+			depth++;
+		}
+		return NULL;
+	}
+	void remove(leaf* l) {
+		const std::string &key = l->data.first;
+		if (root == l) root = NULL;
+		else remove(root, key, 0);
+		if (l->pr == NULL) bg = l->nx; else l->pr->nx = l->nx;
+		if (l->nx == NULL) bk = l->pr; else l->nx->pr = l->pr;
+		delete l;
+		n--;
+	}
+	/**
+	 * unhook the leaf with key from the subtree at ref, which is an inner node at depth.
+	 */
+	static void remove(node* &ref, const std::string &key, size_t depth) {
+		inner* in = static_cast<inner*>(ref);
+		size_t d = depth + in->plen;
+		if (key.size() == d) in->term = NULL;
+		else {
+			unsigned char c = key[d];
+			node** next = find_child(in, c);
+			if ((*next)->type == leaf_type) remove_child(ref, c);
+			else remove(*next, key, d + 1);
+		}
+		collapse(ref, depth);
+	}
+};
+
+}
+
+#endif
@@ -0,0 +1,76 @@
+/**
+ * sjtu::map::apply_batch against the same ops applied one at a time.
+ *   g++ -std=c++17 -O2 -pthread -I.. apply_batch.cpp -o batch
+ *   ./batch [entries = 1000000] [ops per size = 2000000]
+ * the map starts with entries random keys out of twice as many; for each
+ *   batch length the ops (3 upserts to 1 erase, uniform keys) are cut
+ *   into batches and applied by operator[] / erase one by one, by
+ *   apply_batch, and by apply_batch with parallel set.  every run starts
+ *   from a copy of the same map and the results are compared.
+ * a short batch pays for its sort without sharing much of its paths, the
+ *   gain shows once the batch is dense in the map (about 1 op per 12
+ *   entries and up at the defaults).
+ */
+#include "map.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <vector>
+#include <random>
+
+typedef std::chrono::steady_clock clk;
+typedef sjtu::map<int, int> map_type;
+
+static double since(clk::time_point t0) {
+	return std::chrono::duration<double>(clk::now() - t0).count();
+}
+
+static unsigned long long checksum(const map_type &m) {
+	unsigned long long h = 0;
+	for (map_type::const_iterator it = m.cbegin(); it != m.cend(); ++it)
+		h = h * 1000003 + (unsigned long long)it->first * 31 + (unsigned long long)it->second;
+	return h;
+}
+
+int main(int argc, char** argv) {
+	int n = (argc > 1) ? atoi(argv[1]) : 1000000;
+	int total = (argc > 2) ? atoi(argv[2]) : 2000000;
+	std::mt19937 g(7);
+	map_type base;
+	for (int i = 0; i < n; i++) base[(int)(g() % (2u * n))] = i;
+	std::vector<map_type::batch_op> ops;
+	ops.reserve(total);
+	for (int i = 0; i < total; i++) {
+		int k = (int)(g() % (2u * n));
+		if (g() % 4 == 0) ops.push_back(map_type::batch_op(k));
+		else ops.push_back(map_type::batch_op(k, i));
+	}
+	printf("%zu entries, %d ops, ns per op\n", base.size(), total);
+	const int lengths[] = { 16, 256, 4096, 65536 };
+	for (int len : lengths) {
+		map_type a(base), b(base), c(base);
+		clk::time_point t0 = clk::now();
+		for (int i = 0; i < total; i++) {
+			if (ops[i].erase) a.erase(ops[i].key);
+			else a[ops[i].key] = ops[i].value;
+		}
+		double t1 = since(t0);
+		t0 = clk::now();
+		for (int i = 0; i < total; i += len) {
+			int j = (i + len < total) ? i + len : total;
+			b.apply_batch(ops.begin() + i, ops.begin() + j);
+		}
+		double t2 = since(t0);
+		t0 = clk::now();
+		for (int i = 0; i < total; i += len) {
+			int j = (i + len < total) ? i + len : total;
+			c.apply_batch(ops.begin() + i, ops.begin() + j, true);
+		}
+		double t3 = since(t0);
+		unsigned long long s = checksum(a);
+		printf("batch %6d  one by one %4.0f  apply_batch %4.0f (x%.2f)  parallel %4.0f (x%.2f)%s\n", len,
+			t1 / total * 1e9, t2 / total * 1e9, t1 / t2, t3 / total * 1e9, t1 / t3,
+			(checksum(b) == s && checksum(c) == s) ? "" : "  MISMATCH");
+	}
+	return 0;
+}
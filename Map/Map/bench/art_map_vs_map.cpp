@@ -0,0 +1,208 @@
+/**
+ * sjtu::art_map against sjtu::map<std::string, T> on string keys.
+ *   g++ -std=c++17 -O2 -I.. art_map_vs_map.cpp -o art
+ *   ./art [keys = 500000]
+ * four generated datasets shaped like real ones:
+ *   urls    https://www.<site>.<tld>/<section>/<slug>-<id>, a few hundred
+ *           sites, long shared prefixes
+ *   words   pronounceable words of 2 to 5 syllables with an occasional
+ *           suffix, short keys that branch early
+ *   emails  <first>.<last><n>@<domain> from small name lists
+ *   ids     "user:" and a random zero-padded 10-digit number, fixed
+ *           length like the keys of a key-value store
+ * for each: insert in random order, lookups of present and of absent
+ *   keys (one byte changed), an in-order walk, prefix scans (art_map's
+ *   prefix_range against lower_bound plus a walk on map) and erasing
+ *   every key.  heap bytes per key are counted through operator new,
+ *   the strings themselves included on both sides.  the results of both
+ *   maps are checked against each other.
+ */
+#include "map.hpp"
+#include "art_map.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <new>
+#include <string>
+#include <vector>
+#include <random>
+#include <algorithm>
+
+static size_t live_bytes = 0;
+
+void* operator new(size_t n) {
+	void* p = std::malloc(n + 16);
+	if (p == NULL) throw std::bad_alloc();
+	*static_cast<size_t*>(p) = n;
+	live_bytes += n;
+	return static_cast<char*>(p) + 16;
+}
+void operator delete(void* p) noexcept {
+	if (p == NULL) return;
+	void* q = static_cast<char*>(p) - 16;
+	live_bytes -= *static_cast<size_t*>(q);
+	std::free(q);
+}
+void operator delete(void* p, size_t) noexcept {
+	operator delete(p);
+}
+
+typedef std::chrono::steady_clock clk;
+typedef sjtu::map<std::string, int> tree_map;
+typedef sjtu::art_map<int> radix_map;
+
+static double since(clk::time_point t0) {
+	return std::chrono::duration<double>(clk::now() - t0).count();
+}
+
+static std::string pick(std::mt19937 &g, const char* const* v, size_t n) {
+	return v[g() % n];
+}
+
+static std::string syllables(std::mt19937 &g, int k) {
+	static const char* const on[] = { "b", "c", "d", "f", "g", "h", "k", "l", "m", "n", "p", "r", "s", "t", "v", "w", "br", "ch", "st", "tr", "sh", "pl" };
+	static const char* const nu[] = { "a", "e", "i", "o", "u", "ai", "ea", "ou", "y" };
+	static const char* const co[] = { "", "", "", "n", "r", "s", "t", "l", "m", "nd", "st" };
+	std::string s;
+	for (int i = 0; i < k; i++) s += pick(g, on, 22) + pick(g, nu, 9) + pick(g, co, 11);
+	return s;
+}
+
+static std::vector<std::string> urls(std::mt19937 &g, size_t n) {
+	static const char* const tld[] = { "com", "org", "net", "io", "co.uk", "de", "edu" };
+	static const char* const sec[] = { "news", "blog", "products", "docs", "users", "search", "images", "2023/05", "2024/11", "help/articles" };
+	std::vector<std::string> site;
+	for (int i = 0; i < 300; i++) site.push_back(syllables(g, 2 + (int)(g() % 2)) + "." + pick(g, tld, 7));
+	std::vector<std::string> v;
+	for (size_t i = 0; i < n; i++) {
+		size_t s = std::min(g() % site.size(), g() % site.size());
+		v.push_back("https://www." + site[s] + "/" + pick(g, sec, 10) + "/" + syllables(g, 1 + (int)(g() % 3)) + "-" + std::to_string(g() % 1000000));
+	}
+	return v;
+}
+
+static std::vector<std::string> words(std::mt19937 &g, size_t n) {
+	static const char* const suf[] = { "", "", "", "", "s", "ing", "ed", "er", "ly", "ness", "tion" };
+	std::vector<std::string> v;
+	for (size_t i = 0; i < n; i++) v.push_back(syllables(g, 2 + (int)(g() % 4)) + pick(g, suf, 11));
+	return v;
+}
+
+static std::vector<std::string> emails(std::mt19937 &g, size_t n) {
+	static const char* const dom[] = { "gmail.com", "yahoo.com", "outlook.com", "qq.com", "163.com", "sjtu.edu.cn", "example.org" };
+	std::vector<std::string> first, last;
+	for (int i = 0; i < 500; i++) first.push_back(syllables(g, 1 + (int)(g() % 2)));
+	for (int i = 0; i < 2000; i++) last.push_back(syllables(g, 2 + (int)(g() % 2)));
+	std::vector<std::string> v;
+	for (size_t i = 0; i < n; i++)
+		v.push_back(first[g() % first.size()] + "." + last[g() % last.size()] + std::to_string(g() % 100) + "@" + pick(g, dom, 7));
+	return v;
+}
+
+static std::vector<std::string> ids(std::mt19937 &g, size_t n) {
+	std::vector<std::string> v;
+	char buf[32];
+	for (size_t i = 0; i < n; i++) {
+		snprintf(buf, sizeof(buf), "user:%010llu", ((unsigned long long)g() << 32 | g()) % 10000000000ull);
+		v.push_back(buf);
+	}
+	return v;
+}
+
+/**
+ * the distinct keys in a random order, the absent ones, and some prefixes
+ *   taken from keys (cut at a random length).
+ */
+static void prepare(std::mt19937 &g, std::vector<std::string> v, std::vector<std::string> &keys,
+	std::vector<std::string> &miss, std::vector<std::string> &pre) {
+	std::sort(v.begin(), v.end());
+	v.erase(std::unique(v.begin(), v.end()), v.end());
+	std::shuffle(v.begin(), v.end(), g);
+	keys = v;
+	miss.clear();
+	pre.clear();
+	for (size_t i = 0; i < keys.size(); i++) {
+		std::string m = keys[i];
+		m[g() % m.size()] ^= 0x20;
+		miss.push_back(m);
+	}
+	for (size_t i = 0; i < keys.size() / 50 + 1; i++) {
+		const std::string &k = keys[g() % keys.size()];
+		pre.push_back(k.substr(0, k.size() / 2 + g() % (k.size() / 2 + 1)));
+	}
+}
+
+class result {
+public:
+	double bytes, ins, hit, miss, walk, scan, del;
+	unsigned long long sum;
+};
+
+static long long scan(const tree_map &m, const std::string &p) {
+	long long s = 0;
+	for (tree_map::const_iterator it = m.lower_bound(p); it != m.cend() && it->first.compare(0, p.size(), p) == 0; ++it) s += it->second;
+	return s;
+}
+
+static long long scan(const radix_map &m, const std::string &p) {
+	long long s = 0;
+	sjtu::pair<radix_map::const_iterator, radix_map::const_iterator> r = m.prefix_range(p);
+	for (radix_map::const_iterator it = r.first; it != r.second; ++it) s += it->second;
+	return s;
+}
+
+template<class M>
+static result run(const std::vector<std::string> &keys, const std::vector<std::string> &miss, const std::vector<std::string> &pre) {
+	result r;
+	size_t n = keys.size(), before = live_bytes;
+	unsigned long long sum = 0;
+	M* m = new M;
+	clk::time_point t0 = clk::now();
+	for (size_t i = 0; i < n; i++) m->insert(typename M::value_type(keys[i], (int)i));
+	r.ins = since(t0) / n * 1e9;
+	r.bytes = (double)(live_bytes - before) / n;
+	t0 = clk::now();
+	for (size_t i = 0; i < n; i++) sum += m->find(keys[n - 1 - i])->second;
+	r.hit = since(t0) / n * 1e9;
+	t0 = clk::now();
+	for (size_t i = 0; i < n; i++) sum += m->count(miss[i]);
+	r.miss = since(t0) / n * 1e9;
+	t0 = clk::now();
+	for (typename M::const_iterator it = m->cbegin(); it != m->cend(); ++it) sum = sum * 31 + it->first.size() + it->second;
+	r.walk = since(t0) / n * 1e9;
+	t0 = clk::now();
+	for (size_t i = 0; i < pre.size(); i++) sum = sum * 31 + scan(*m, pre[i]);
+	r.scan = since(t0) / pre.size() * 1e9;
+	t0 = clk::now();
+	for (size_t i = 0; i < n; i++) sum += m->erase(keys[i]);
+	r.del = since(t0) / n * 1e9;
+	delete m;
+	r.sum = sum;
+	return r;
+}
+
+int main(int argc, char** argv) {
+	size_t n = (argc > 1) ? strtoull(argv[1], NULL, 10) : 500000;
+	std::mt19937 g(38);
+	const char* names[] = { "urls", "words", "emails", "ids" };
+	printf("ns per op (scan: per prefix), heap bytes per key\n");
+	for (int d = 0; d < 4; d++) {
+		std::vector<std::string> raw = (d == 0) ? urls(g, n) : (d == 1) ? words(g, n) : (d == 2) ? emails(g, n) : ids(g, n);
+		std::vector<std::string> keys, miss, pre;
+		prepare(g, raw, keys, miss, pre);
+		raw.clear();
+		raw.shrink_to_fit();
+		size_t len = 0;
+		for (size_t i = 0; i < keys.size(); i++) len += keys[i].size();
+		printf("%s: %zu keys, %.1f bytes long on average\n", names[d], keys.size(), (double)len / keys.size());
+		result a = run<tree_map>(keys, miss, pre);
+		result b = run<radix_map>(keys, miss, pre);
+		const char* who[] = { "map", "art_map" };
+		result* rs[] = { &a, &b };
+		for (int k = 0; k < 2; k++)
+			printf("  %-8s %6.1f bytes  insert %5.0f  hit %5.0f  miss %5.0f  walk %4.0f  scan %6.0f  erase %5.0f\n", who[k],
+				rs[k]->bytes, rs[k]->ins, rs[k]->hit, rs[k]->miss, rs[k]->walk, rs[k]->scan, rs[k]->del);
+		if (a.sum != b.sum) printf("  MISMATCH\n");
+	}
+	return 0;
+}
@@ -0,0 +1,87 @@
+/**
+ * sjtu::map with avl_balance against weight_balance on three workloads.
+ *   g++ -std=c++17 -O2 -I.. balance_policies.cpp -o balance
+ *   ./balance [keys = 1000000]
+ * random inserts the keys shuffled and looks up uniform keys, sequential
+ *   inserts and looks them up in order, zipfian inserts them shuffled and
+ *   looks them up with a zipf(0.99) skew; each then erases half the keys.
+ * reported per operation: time, rotations of insert and erase, the height
+ *   against the ideal one and the mean depth of a lookup.  the counters
+ *   need SJTU_MAP_STATS, which costs a little on every operation, so the
+ *   times are comparable between the policies, not to a build without it.
+ */
+#define SJTU_MAP_STATS
+
+#include "map.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <chrono>
+#include <vector>
+#include <random>
+#include <algorithm>
+
+typedef std::chrono::steady_clock clk;
+
+static double since(clk::time_point t0) {
+	return std::chrono::duration<double>(clk::now() - t0).count();
+}
+
+static unsigned long long rotations(const sjtu::map_stats &s) {
+	return s.rotations[0] + s.rotations[1] + s.rotations[2] + s.rotations[3];
+}
+
+template<class Balance>
+void run(const char* workload, const char* policy, const std::vector<int> &ins, const std::vector<int> &look, const std::vector<int> &del) {
+	sjtu::map<int, int, std::less<int>, sjtu::no_aggregate, Balance> m;
+	clk::time_point t0 = clk::now();
+	for (int k : ins) m.insert(sjtu::pair<const int, int>(k, k));
+	double ti = since(t0);
+	sjtu::map_stats a = m.stats();
+	m.reset_stats();
+	long long sum = 0;
+	t0 = clk::now();
+	for (int k : look) {
+		auto it = m.find(k);
+		if (it != m.end()) sum += it->second;
+	}
+	double tl = since(t0);
+	sjtu::map_stats b = m.stats();
+	double depth = 0;
+	for (int i = 0; i < sjtu::map_stats::depth_slots; i++) depth += (double)i * b.depth[i];
+	depth /= b.searches;
+	m.reset_stats();
+	t0 = clk::now();
+	for (int k : del) m.erase(k);
+	double te = since(t0);
+	sjtu::map_stats c = m.stats();
+	printf("%-10s %-6s h %2d/%2d  insert %4.0f ns rot %.3f | find %4.0f ns depth %5.2f | erase %4.0f ns rot %.3f (%lld)\n",
+		workload, policy, a.height, a.ideal_height,
+		ti / ins.size() * 1e9, (double)rotations(a) / ins.size(),
+		tl / look.size() * 1e9, depth,
+		te / del.size() * 1e9, (double)rotations(c) / del.size(), sum & 1);
+}
+
+int main(int argc, char** argv) {
+	int n = (argc > 1) ? atoi(argv[1]) : 1000000;
+	std::mt19937 g(5);
+	std::vector<int> rnd(n), seq(n), uni(n), zipf(n);
+	for (int i = 0; i < n; i++) rnd[i] = seq[i] = i;
+	std::shuffle(rnd.begin(), rnd.end(), g);
+	for (int i = 0; i < n; i++) uni[i] = (int)(g() % n);
+	// rank i is drawn with weight 1 / (i + 1)^0.99, the ranks go to shuffled keys
+	std::vector<double> cdf(n);
+	double s = 0;
+	for (int i = 0; i < n; i++) cdf[i] = s += 1.0 / pow(i + 1, 0.99);
+	std::uniform_real_distribution<double> u(0, s);
+	for (int i = 0; i < n; i++) zipf[i] = rnd[std::lower_bound(cdf.begin(), cdf.end(), u(g)) - cdf.begin()];
+	std::vector<int> rnd_half(rnd.begin(), rnd.begin() + n / 2), seq_half(seq.begin(), seq.begin() + n / 2);
+	printf("%d keys, times and rotations per operation\n", n);
+	run<sjtu::avl_balance>("random", "avl", rnd, uni, rnd_half);
+	run<sjtu::weight_balance>("random", "weight", rnd, uni, rnd_half);
+	run<sjtu::avl_balance>("sequential", "avl", seq, seq, seq_half);
+	run<sjtu::weight_balance>("sequential", "weight", seq, seq, seq_half);
+	run<sjtu::avl_balance>("zipfian", "avl", rnd, zipf, rnd_half);
+	run<sjtu::weight_balance>("zipfian", "weight", rnd, zipf, rnd_half);
+	return 0;
+}
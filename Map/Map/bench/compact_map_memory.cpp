@@ -0,0 +1,69 @@
+/**
+ * bytes per entry and speed of sjtu::compact_map against sjtu::map.
+ *   g++ -std=c++17 -O2 -I.. compact_map_memory.cpp -o compact
+ *   ./compact [n = 1000000]
+ * the heap is measured by counting every byte that passes through
+ *   operator new, so both maps are charged for exactly what they allocate
+ *   (the allocator's own headers come on top for both).
+ */
+#include "map.hpp"
+#include "compact_map.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <new>
+#include <vector>
+#include <algorithm>
+#include <random>
+
+static size_t live_bytes = 0;
+
+void* operator new(size_t n) {
+	void* p = std::malloc(n + 16);
+	if (p == NULL) throw std::bad_alloc();
+	*static_cast<size_t*>(p) = n;
+	live_bytes += n;
+	return static_cast<char*>(p) + 16;
+}
+void operator delete(void* p) noexcept {
+	if (p == NULL) return;
+	void* q = static_cast<char*>(p) - 16;
+	live_bytes -= *static_cast<size_t*>(q);
+	std::free(q);
+}
+void operator delete(void* p, size_t) noexcept {
+	operator delete(p);
+}
+
+typedef std::chrono::steady_clock clk;
+
+template<class M>
+static void run(const char* name, const std::vector<int> &keys) {
+	size_t n = keys.size(), before = live_bytes;
+	long long sum = 0;
+	M* m = new M;
+	clk::time_point t0 = clk::now();
+	for (size_t i = 0; i < n; i++) m->insert(typename M::value_type(keys[i], (int)i));
+	double ins = std::chrono::duration<double, std::nano>(clk::now() - t0).count() / n;
+	size_t bytes = live_bytes - before;
+	t0 = clk::now();
+	for (size_t i = 0; i < n; i++) sum += m->find(keys[n - 1 - i])->second;
+	double hit = std::chrono::duration<double, std::nano>(clk::now() - t0).count() / n;
+	t0 = clk::now();
+	for (typename M::const_iterator it = m->cbegin(); it != m->cend(); ++it) sum += it->first;
+	double walk = std::chrono::duration<double, std::nano>(clk::now() - t0).count() / n;
+	delete m;
+	printf("%-12s %6.1f bytes/entry  insert %7.1f  find %7.1f  walk %5.1f ns  (%lld)\n",
+		name, (double)bytes / n, ins, hit, walk, sum);
+}
+
+int main(int argc, char** argv) {
+	size_t n = (argc > 1) ? strtoull(argv[1], NULL, 10) : 1000000;
+	std::vector<int> keys(n);
+	for (size_t i = 0; i < n; i++) keys[i] = (int)i;
+	std::shuffle(keys.begin(), keys.end(), std::mt19937(7));
+	printf("n = %zu, pair<const int, int>\n", n);
+	run<sjtu::map<int, int> >("map", keys);
+	run<sjtu::compact_map<int, int> >("compact_map", keys);
+	return 0;
+}
@@ -0,0 +1,54 @@
+/**
+ * sjtu::map::find_batch against one find() per key.
+ *   g++ -std=c++17 -O2 -I.. find_batch.cpp -o find_batch
+ *   ./find_batch [lookups = 2000000] [batch = 1024]
+ * for every map size the keys are inserted shuffled and looked up uniformly
+ *   at random, in batches of the given length for find_batch; the value of
+ *   each found element is read so both sides touch the same memory.  the
+ *   gain shows once the tree outgrows the caches, below that find_batch is
+ *   a little slower than plain find().
+ */
+#include "map.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <vector>
+#include <random>
+#include <algorithm>
+
+typedef std::chrono::steady_clock clk;
+typedef sjtu::map<int, int> map_type;
+
+static double since(clk::time_point t0) {
+	return std::chrono::duration<double>(clk::now() - t0).count();
+}
+
+int main(int argc, char** argv) {
+	int lookups = (argc > 1) ? atoi(argv[1]) : 2000000;
+	int batch = (argc > 2) ? atoi(argv[2]) : 1024;
+	if (batch < 1) batch = 1;
+	std::mt19937 g(3);
+	printf("%d lookups, batches of %d\n", lookups, batch);
+	for (int n = 1 << 10; n <= 1 << 22; n <<= 2) {
+		std::vector<int> keys(n);
+		for (int i = 0; i < n; i++) keys[i] = i;
+		std::shuffle(keys.begin(), keys.end(), g);
+		map_type m;
+		for (int k : keys) m.insert(map_type::value_type(k, k));
+		std::vector<int> q(lookups);
+		for (int i = 0; i < lookups; i++) q[i] = (int)(g() % n);
+		std::vector<map_type::iterator> out(lookups);
+		clk::time_point t0 = clk::now();
+		long long a = 0;
+		for (int i = 0; i < lookups; i++) a += m.find(q[i])->second;
+		double tf = since(t0);
+		t0 = clk::now();
+		long long b = 0;
+		for (int i = 0; i < lookups; i += batch) m.find_batch(q.data() + i, std::min(batch, lookups - i), out.data() + i);
+		for (int i = 0; i < lookups; i++) b += out[i]->second;
+		double tb = since(t0);
+		printf("n %8d  find %4.0f ns  find_batch %4.0f ns  x%.2f%s\n", n,
+			tf / lookups * 1e9, tb / lookups * 1e9, tf / tb, (a == b) ? "" : "  MISMATCH");
+	}
+	return 0;
+}
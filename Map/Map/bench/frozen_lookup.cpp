@@ -0,0 +1,96 @@
+/**
+ * lookups in sjtu::map against its flat_map and its frozen eytzinger_map.
+ *   g++ -std=c++17 -O2 -I.. frozen_lookup.cpp -o frozen
+ *   ./frozen [keys = 4000000] [lookups = 4000000] [rounds = 3]
+ * for map sizes from 1000 up to keys, random keys of which half are
+ *   present are looked up with find (and lower_bound) in the tree, the
+ *   sorted array (a plain binary search) and the eytzinger table built by
+ *   freeze().  once the table outgrows the caches the eytzinger descent,
+ *   which prefetches four levels ahead and has no branch to mispredict,
+ *   should pull ahead of both.  the best of rounds is reported, the three
+ *   must agree on every answer.
+ */
+#include "map.hpp"
+#include "flat_map.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <vector>
+#include <random>
+
+typedef std::chrono::steady_clock clk;
+typedef sjtu::map<int, int> tree_map;
+typedef sjtu::flat_map<int, int> sorted_map;
+typedef sjtu::eytzinger_map<int, int> frozen_map;
+
+static double since(clk::time_point t0) {
+	return std::chrono::duration<double>(clk::now() - t0).count();
+}
+
+static const int* hit(const tree_map &m, int k) {
+	tree_map::const_iterator it = m.find(k);
+	return (it == m.cend()) ? NULL : &it->second;
+}
+static const int* hit(const sorted_map &m, int k) {
+	sorted_map::const_iterator it = m.find(k);
+	return (it == m.cend()) ? NULL : &it->second;
+}
+static const int* hit(const frozen_map &m, int k) {
+	const frozen_map::value_type* p = m.find(k);
+	return (p == NULL) ? NULL : &p->second;
+}
+
+static int bound(const tree_map &m, int k) {
+	tree_map::const_iterator it = m.lower_bound(k);
+	return (it == m.cend()) ? -1 : it->first;
+}
+static int bound(const sorted_map &m, int k) {
+	sorted_map::const_iterator it = m.lower_bound(k);
+	return (it == m.cend()) ? -1 : it->first;
+}
+static int bound(const frozen_map &m, int k) {
+	const frozen_map::value_type* p = m.lower_bound(k);
+	return (p == NULL) ? -1 : p->first;
+}
+
+template<class M>
+static double run(const M &m, const std::vector<int> &q, int rounds, unsigned long long &sum) {
+	double best = 1e30;
+	for (int r = 0; r < rounds; r++) {
+		unsigned long long s = 0;
+		clk::time_point t0 = clk::now();
+		for (size_t i = 0; i < q.size(); i++) {
+			const int* p = hit(m, q[i]);
+			s = s * 31 + (p == NULL ? 7 : (unsigned)*p);
+			if ((i & 7) == 0) s += (unsigned)bound(m, q[i] + 1);
+		}
+		double t = since(t0);
+		if (t < best) best = t;
+		sum = s;
+	}
+	return best / q.size() * 1e9;
+}
+
+int main(int argc, char** argv) {
+	int keys = (argc > 1) ? atoi(argv[1]) : 4000000;
+	int lookups = (argc > 2) ? atoi(argv[2]) : 4000000;
+	int rounds = (argc > 3) ? atoi(argv[3]) : 3;
+	std::mt19937 g(27);
+	printf("ns per lookup (1 in 8 also a lower_bound), best of %d\n", rounds);
+	for (int n = 1000; n <= keys; n *= 4) {
+		tree_map m;
+		// even keys, so an odd query misses
+		while (m.size() < (size_t)n) m[(int)(g() % ((unsigned)n * 4)) * 2] = (int)g();
+		sorted_map f(m.cbegin(), m.cend());
+		frozen_map e = sjtu::freeze(m);
+		std::vector<int> q(lookups);
+		for (int i = 0; i < lookups; i++) q[i] = (int)(g() % ((unsigned)n * 8));
+		unsigned long long a, b, c;
+		double tm = run(m, q, rounds, a);
+		double tf = run(f, q, rounds, b);
+		double te = run(e, q, rounds, c);
+		printf("%8d keys  map %5.0f  flat_map %5.0f  eytzinger %5.0f (x%.2f over map)%s\n",
+			n, tm, tf, te, tm / te, (a == b && b == c) ? "" : "  MISMATCH");
+	}
+	return 0;
+}
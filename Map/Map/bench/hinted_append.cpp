@@ -0,0 +1,65 @@
+/**
+ * sjtu::map appends with insert(end(), value) against plain insert(value).
+ *   g++ -std=c++17 -O2 -I.. hinted_append.cpp -o append
+ *   ./append [keys = 4000000] [rounds = 3]
+ * every run inserts the keys 0, 3, 6, ... in increasing order into an
+ *   empty map, for three map sizes up to keys.  with avl_balance a hinted
+ *   append climbs the kept spine only while a height changes, so its
+ *   cost per key should stay flat as the map grows; plain insert looks
+ *   the key up from the root (O(log n) comparisons), and with
+ *   weight_balance the hint saves the comparisons but still walks the
+ *   whole spine.  the best of rounds is reported, and every map is
+ *   checked against the keys (size, first and last key, a sum).
+ */
+#include "map.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+
+typedef std::chrono::steady_clock clk;
+
+static double since(clk::time_point t0) {
+	return std::chrono::duration<double>(clk::now() - t0).count();
+}
+
+template<class Balance>
+double run(int n, int rounds, bool hinted, bool &ok) {
+	typedef sjtu::map<int, int, std::less<int>, sjtu::no_aggregate, Balance> map_type;
+	double best = 1e30;
+	for (int r = 0; r < rounds; r++) {
+		map_type m;
+		clk::time_point t0 = clk::now();
+		if (hinted) {
+			for (int i = 0; i < n; i++) m.insert(m.end(), sjtu::pair<const int, int>(3 * i, i));
+		}
+		else {
+			for (int i = 0; i < n; i++) m.insert(sjtu::pair<const int, int>(3 * i, i));
+		}
+		double t = since(t0);
+		if (t < best) best = t;
+		long long sum = 0;
+		for (typename map_type::const_iterator it = m.cbegin(); it != m.cend(); ++it) sum += it->second;
+		if (m.size() != (size_t)n || sum != (long long)n * (n - 1) / 2) ok = false;
+		if (n > 0 && (m.cbegin()->first != 0 || (--m.cend())->first != 3 * (n - 1))) ok = false;
+		m.validate();
+	}
+	return best / n * 1e9;
+}
+
+int main(int argc, char** argv) {
+	int keys = (argc > 1) ? atoi(argv[1]) : 4000000;
+	int rounds = (argc > 2) ? atoi(argv[2]) : 3;
+	printf("increasing keys, ns per insert, best of %d\n", rounds);
+	const int parts[] = { 64, 8, 1 };
+	for (int part : parts) {
+		int n = keys / part;
+		bool ok = true;
+		double a = run<sjtu::avl_balance>(n, rounds, false, ok);
+		double b = run<sjtu::avl_balance>(n, rounds, true, ok);
+		double c = run<sjtu::weight_balance>(n, rounds, false, ok);
+		double d = run<sjtu::weight_balance>(n, rounds, true, ok);
+		printf("%8d keys  avl insert %4.0f  end() hint %4.0f (x%.2f)  |  weight insert %4.0f  end() hint %4.0f (x%.2f)%s\n",
+			n, a, b, a / b, c, d, c / d, ok ? "" : "  MISMATCH");
+	}
+	return 0;
+}
@@ -0,0 +1,91 @@
+/**
+ * latency percentiles of a cache hit in sjtu::lru_cache and sjtu::concurrent_lru_cache.
+ *   g++ -std=c++17 -O2 -pthread -I.. lru_cache_latency.cpp -o lru
+ *   ./lru [entries = 100000] [hits per thread = 1000000] [max threads = 4]
+ * the cache is filled below its capacity, so every get() hits and moves
+ *   its entry to the front.  each get() is timed on its own with
+ *   steady_clock, whose own cost (the "clock" line) is included in the
+ *   figures; keys are uniform over the entries.
+ */
+#include "lru_cache.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+typedef std::chrono::steady_clock clk;
+
+class sampler {
+public:
+	std::vector<long long> ns;
+	unsigned long long x;
+	explicit sampler(unsigned long long seed) :x(seed | 1) {}
+	int key(int n) {
+		x ^= x << 13;
+		x ^= x >> 7;
+		x ^= x << 17;
+		return (int)(x % (unsigned long long)n);
+	}
+	template<class F>
+	void time(F f) {
+		clk::time_point t0 = clk::now();
+		f();
+		ns.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(clk::now() - t0).count());
+	}
+};
+
+static void report(const char* name, std::vector<long long> &ns) {
+	std::sort(ns.begin(), ns.end());
+	size_t n = ns.size();
+	printf("%-22s p50 %5lld  p90 %5lld  p99 %5lld  p99.9 %6lld  max %7lld ns\n", name,
+		ns[n / 2], ns[n * 9 / 10], ns[n * 99 / 100], ns[n * 999 / 1000], ns[n - 1]);
+}
+
+int main(int argc, char** argv) {
+	int entries = (argc > 1) ? atoi(argv[1]) : 100000;
+	int hits = (argc > 2) ? atoi(argv[2]) : 1000000;
+	int max_threads = (argc > 3) ? atoi(argv[3]) : 4;
+	printf("%d entries, %d hits per thread\n", entries, hits);
+	{
+		sampler s(1);
+		for (int i = 0; i < hits; i++) s.time([]() {});
+		report("clock", s.ns);
+	}
+	{
+		sjtu::lru_cache<int, int> c(entries);
+		for (int i = 0; i < entries; i++) c.put(i, i);
+		sampler s(2);
+		long long sum = 0;
+		for (int i = 0; i < hits; i++) {
+			int k = s.key(entries), v = 0;
+			s.time([&]() { c.get(k, v); });
+			sum += v;
+		}
+		report("lru_cache", s.ns);
+		if (sum < 0) puts("");
+	}
+	for (int threads = 1; threads <= max_threads; threads *= 2) {
+		sjtu::concurrent_lru_cache<int, int> c(entries);
+		for (int i = 0; i < entries; i++) c.put(i, i);
+		std::vector<sampler> s;
+		for (int t = 0; t < threads; t++) s.push_back(sampler(t + 3));
+		std::vector<std::thread> th;
+		for (int t = 0; t < threads; t++) th.emplace_back([&, t]() {
+			sampler &me = s[t];
+			me.ns.reserve(hits);
+			for (int i = 0; i < hits; i++) {
+				int k = me.key(entries), v = 0;
+				me.time([&]() { c.get(k, v); });
+			}
+		});
+		for (size_t t = 0; t < th.size(); t++) th[t].join();
+		std::vector<long long> all;
+		for (int t = 0; t < threads; t++) all.insert(all.end(), s[t].ns.begin(), s[t].ns.end());
+		char name[64];
+		snprintf(name, sizeof name, "concurrent, %d thr", threads);
+		report(name, all);
+	}
+	return 0;
+}
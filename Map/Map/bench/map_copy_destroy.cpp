@@ -0,0 +1,50 @@
+/**
+ * copy, copy assignment and destruction of a large sjtu::map.
+ *   g++ -std=c++17 -O2 -pthread -I.. map_copy_destroy.cpp -o copy
+ *   ./copy [entries = 10000000] [rounds = 3]
+ * the map is built once from sorted keys; each round copies it, assigns
+ *   it over a map of the same size and destroys both copies.  a copy forks
+ *   subtrees over SJTU_MAP_FORK_GRAIN nodes onto log2(hardware threads)
+ *   levels of threads, the thread count is printed with the results.
+ */
+#include "map.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+typedef std::chrono::steady_clock clk;
+typedef sjtu::map<int, int> map_type;
+
+static double since(clk::time_point t0) {
+	return std::chrono::duration<double>(clk::now() - t0).count();
+}
+
+int main(int argc, char** argv) {
+	int n = (argc > 1) ? atoi(argv[1]) : 10000000;
+	int rounds = (argc > 2) ? atoi(argv[2]) : 3;
+	std::vector<map_type::value_type> v;
+	v.reserve(n);
+	for (int i = 0; i < n; i++) v.push_back(map_type::value_type(i, i));
+	map_type m(v.begin(), v.end());
+	std::vector<map_type::value_type>().swap(v);
+	printf("%d entries, %u hardware threads\n", n, std::thread::hardware_concurrency());
+	for (int r = 0; r < rounds; r++) {
+		clk::time_point t0 = clk::now();
+		map_type* c = new map_type(m);
+		double tc = since(t0);
+		map_type* a = new map_type(m);
+		t0 = clk::now();
+		*a = m;
+		double ta = since(t0);
+		if (c->size() != m.size() || a->size() != m.size()) printf("size mismatch\n");
+		t0 = clk::now();
+		delete c;
+		double td = since(t0);
+		delete a;
+		printf("copy %.3f s (%.0f ns/entry)  assign %.3f s (%.0f ns/entry)  destroy %.3f s (%.0f ns/entry)\n",
+			tc, tc / n * 1e9, ta, ta / n * 1e9, td, td / n * 1e9);
+	}
+	return 0;
+}
@@ -0,0 +1,177 @@
+/**
+ * sjtu::order_book replaying a synthetic message file.
+ *   g++ -std=c++17 -O2 -I.. order_book_replay.cpp -o replay
+ *   ./replay [messages = 2000000] [file = replay.txt] [rounds = 3]
+ * the file is written first, one message per line:
+ *   A id b|s price qty    add a limit order
+ *   C id                  cancel
+ *   M id qty              modify the quantity
+ * about 45% adds, 40% cancels and 15% modifies.  prices sit a geometric
+ *   number of ticks behind a mid that drifts, 1 add in 20 crosses the
+ *   spread, cancels and modifies mostly hit recent orders (some of them
+ *   filled or cancelled already, so the book refuses them).
+ * the file is parsed into memory and replayed into a fresh book rounds
+ *   times, each message timed on its own: reported are messages per
+ *   second and the p50 / p99 / p99.9 latency of the best round.  every
+ *   round must end with the same fills and the same book, the levels must
+ *   hold every resting order and the book must not be crossed.  the
+ *   latencies include the two clock reads around each message.
+ */
+#include "order_book.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <functional>
+
+typedef std::chrono::steady_clock clk;
+typedef sjtu::order_book<long long, long long, unsigned long long> book_type;
+
+static double since(clk::time_point t0) {
+	return std::chrono::duration<double>(clk::now() - t0).count();
+}
+
+class message {
+public:
+	char kind;
+	char side;
+	unsigned long long id;
+	long long price, qty;
+};
+
+static void generate(const char* path, int total) {
+	FILE* out = fopen(path, "w");
+	if (out == NULL) {
+		printf("cannot write %s\n", path);
+		exit(1);
+	}
+	std::mt19937_64 g(47);
+	std::geometric_distribution<int> behind(0.25);
+	std::vector<unsigned long long> ids;
+	long long mid = 100000;
+	unsigned long long next = 1;
+	for (int i = 0; i < total; i++) {
+		unsigned r = (unsigned)(g() % 100);
+		if (ids.empty() || r < 45) {
+			if (g() % 64 == 0) mid += (long long)(g() % 5) - 2;
+			bool buy = g() % 2 == 0;
+			long long ticks = behind(g) + 1;
+			if (g() % 20 == 0) ticks = -(long long)(g() % 3);
+			long long price = buy ? mid - ticks : mid + ticks;
+			long long qty = (long long)(g() % 10 + 1) * 100;
+			fprintf(out, "A %llu %c %lld %lld\n", next, buy ? 'b' : 's', price, qty);
+			ids.push_back(next++);
+		}
+		else {
+			size_t back = (size_t)(g() % 4096);
+			unsigned long long id = ids[(back < ids.size()) ? ids.size() - 1 - back : (size_t)(g() % ids.size())];
+			if (r < 85) fprintf(out, "C %llu\n", id);
+			else fprintf(out, "M %llu %lld\n", id, (long long)(g() % 12) * 100);
+		}
+	}
+	fclose(out);
+}
+
+static std::vector<message> parse(const char* path) {
+	std::vector<message> v;
+	FILE* in = fopen(path, "r");
+	if (in == NULL) {
+		printf("cannot read %s\n", path);
+		exit(1);
+	}
+	char kind;
+	while (fscanf(in, " %c", &kind) == 1) {
+		message m;
+		m.kind = kind;
+		m.side = 'b';
+		m.price = m.qty = 0;
+		if (kind == 'A') {
+			if (fscanf(in, "%llu %c %lld %lld", &m.id, &m.side, &m.price, &m.qty) != 4) break;
+		}
+		else if (kind == 'C') {
+			if (fscanf(in, "%llu", &m.id) != 1) break;
+		}
+		else if (fscanf(in, "%llu %lld", &m.id, &m.qty) != 2) break;
+		v.push_back(m);
+	}
+	fclose(in);
+	return v;
+}
+
+// the book takes its callbacks by value, these are handed over by reference
+class fills {
+public:
+	unsigned long long n, sum;
+	fills() :n(0), sum(0) {}
+	void operator()(unsigned long long maker, unsigned long long taker, long long price, long long qty) {
+		n++;
+		sum = sum * 1000003 + maker * 31 + taker * 7 + (unsigned long long)(price * 13 + qty);
+	}
+};
+
+class totals {
+public:
+	long long qty;
+	size_t orders;
+	unsigned long long sum;
+	totals() :qty(0), orders(0), sum(0) {}
+	void operator()(long long price, long long total, size_t k) {
+		qty += total;
+		orders += k;
+		sum = sum * 1000003 + (unsigned long long)(price * 31 + total) + k;
+	}
+};
+
+int main(int argc, char** argv) {
+	int total = (argc > 1) ? atoi(argv[1]) : 2000000;
+	const char* path = (argc > 2) ? argv[2] : "replay.txt";
+	int rounds = (argc > 3) ? atoi(argv[3]) : 3;
+	generate(path, total);
+	std::vector<message> msgs = parse(path);
+	printf("%zu messages from %s\n", msgs.size(), path);
+	std::vector<double> lat(msgs.size()), best;
+	double best_t = 1e30;
+	unsigned long long first_fill = 0, first_book = 0;
+	bool ok = true;
+	for (int round = 0; round < rounds; round++) {
+		book_type b;
+		fills f;
+		long long resting = 0, refused = 0;
+		clk::time_point t0 = clk::now();
+		for (size_t i = 0; i < msgs.size(); i++) {
+			const message &m = msgs[i];
+			clk::time_point t1 = clk::now();
+			if (m.kind == 'A') b.add(m.id, m.side == 'b' ? book_type::buy : book_type::sell, m.price, m.qty, std::ref(f));
+			else if (m.kind == 'C') refused += !b.cancel(m.id);
+			else refused += !b.modify(m.id, m.qty);
+			lat[i] = std::chrono::duration<double>(clk::now() - t1).count();
+		}
+		double t = since(t0);
+		totals bt, at;
+		b.depth(book_type::buy, (size_t)-1, std::ref(bt));
+		b.depth(book_type::sell, (size_t)-1, std::ref(at));
+		resting = bt.qty + at.qty;
+		long long bid, ask;
+		if (bt.orders + at.orders != b.size()) ok = false;
+		if (b.best(book_type::buy, bid) && b.best(book_type::sell, ask) && !(bid < ask)) ok = false;
+		unsigned long long sum = bt.sum * 7 + at.sum;
+		if (round == 0) {
+			first_fill = f.sum;
+			first_book = sum;
+			printf("%llu fills, %lld refused, %zu resting orders (%lld qty) on %zu + %zu levels\n",
+				f.n, refused, b.size(), resting, b.levels(book_type::buy), b.levels(book_type::sell));
+		}
+		else if (f.sum != first_fill || sum != first_book) ok = false;
+		if (t < best_t) {
+			best_t = t;
+			best = lat;
+		}
+	}
+	std::sort(best.begin(), best.end());
+	size_t n = best.size();
+	printf("%.2f M messages/s  p50 %.0f ns  p99 %.0f ns  p99.9 %.0f ns%s\n", n / best_t / 1e6,
+		best[n / 2] * 1e9, best[n * 99 / 100] * 1e9, best[n * 999 / 1000] * 1e9, ok ? "" : "  MISMATCH");
+	return 0;
+}
@@ -0,0 +1,59 @@
+/**
+ * throughput of sjtu::concurrent_skiplist_map against one sjtu::map behind a mutex.
+ *   g++ -std=c++17 -O2 -pthread -I.. skiplist_throughput.cpp -o skiplist
+ *   ./skiplist [ops = 2000000, split over the threads] [max threads = 64] [keys = 1000000]
+ * every thread runs 50% insert, 25% erase and 25% find on uniform keys,
+ *   the thread count doubles from 1 up to the maximum.
+ */
+#include "concurrent_skiplist_map.hpp"
+#include "map.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <mutex>
+
+template<class F>
+static double run(int threads, unsigned long long ops, unsigned long long keys, F f) {
+	std::vector<std::thread> th;
+	std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+	for (int t = 0; t < threads; t++) th.emplace_back([&, t]() {
+		unsigned long long x = t * 0x9E3779B97F4A7C15ull + 17;
+		for (unsigned long long i = 0; i < ops / threads; i++) {
+			x ^= x << 13;
+			x ^= x >> 7;
+			x ^= x << 17;
+			f((int)(x & 3), (int)((x >> 8) % keys));
+		}
+	});
+	for (size_t i = 0; i < th.size(); i++) th[i].join();
+	double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+	return ops / s / 1e6;
+}
+
+int main(int argc, char** argv) {
+	unsigned long long ops = (argc > 1) ? strtoull(argv[1], NULL, 10) : 2000000;
+	int max_threads = (argc > 2) ? atoi(argv[2]) : 64;
+	unsigned long long keys = (argc > 3) ? strtoull(argv[3], NULL, 10) : 1000000;
+	printf("%llu ops over %llu keys, Mops/s\n", ops, keys);
+	for (int threads = 1; threads <= max_threads; threads *= 2) {
+		sjtu::concurrent_skiplist_map<int, int> s;
+		double a = run(threads, ops, keys, [&](int op, int k) {
+			int v;
+			if (op < 2) s.insert(sjtu::pair<const int, int>(k, k));
+			else if (op == 2) s.erase(k);
+			else s.find(k, v);
+		});
+		sjtu::map<int, int> m;
+		std::mutex mu;
+		double b = run(threads, ops, keys, [&](int op, int k) {
+			std::lock_guard<std::mutex> g(mu);
+			if (op < 2) m.insert(sjtu::pair<const int, int>(k, k));
+			else if (op == 2) m.erase(k);
+			else m.find(k);
+		});
+		printf("threads %2d  skiplist %6.2f  mutex + map %6.2f\n", threads, a, b);
+	}
+	return 0;
+}
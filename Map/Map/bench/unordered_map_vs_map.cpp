@@ -0,0 +1,61 @@
+/**
+ * sjtu::unordered_map against sjtu::map on the same random integer keys.
+ *   g++ -std=c++17 -O2 -I.. unordered_map_vs_map.cpp -o umap
+ *   ./umap [n = 1000000]
+ * insert   n distinct keys in random order
+ * hit      n lookups of present keys
+ * miss     n lookups of absent keys
+ * erase    every key in another random order
+ * figures are nanoseconds per operation.
+ */
+#include "map.hpp"
+#include "unordered_map.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <random>
+
+typedef std::chrono::steady_clock clk;
+
+static double ns_per(clk::time_point t0, size_t n) {
+	return std::chrono::duration<double, std::nano>(clk::now() - t0).count() / n;
+}
+
+template<class M>
+static void run(const char* name, const std::vector<long long> &keys, const std::vector<long long> &absent,
+	const std::vector<long long> &order) {
+	size_t n = keys.size();
+	long long sum = 0;
+	M m;
+	clk::time_point t0 = clk::now();
+	for (size_t i = 0; i < n; i++) m.insert(typename M::value_type(keys[i], (long long)i));
+	double ins = ns_per(t0, n);
+	t0 = clk::now();
+	for (size_t i = 0; i < n; i++) sum += m.find(keys[order[i]])->second;
+	double hit = ns_per(t0, n);
+	t0 = clk::now();
+	for (size_t i = 0; i < n; i++) sum += (long long)m.count(absent[i]);
+	double miss = ns_per(t0, n);
+	t0 = clk::now();
+	for (size_t i = 0; i < n; i++) m.erase(m.find(keys[order[i]]));
+	double era = ns_per(t0, n);
+	printf("%-14s insert %7.1f  hit %7.1f  miss %7.1f  erase %7.1f  (%lld)\n", name, ins, hit, miss, era, sum);
+}
+
+int main(int argc, char** argv) {
+	size_t n = (argc > 1) ? strtoull(argv[1], NULL, 10) : 1000000;
+	std::mt19937_64 g(20240601);
+	std::vector<long long> all(2 * n);
+	for (size_t i = 0; i < 2 * n; i++) all[i] = (long long)(i * 0x9E3779B97F4A7C15ull >> 1);
+	std::shuffle(all.begin(), all.end(), g);
+	std::vector<long long> keys(all.begin(), all.begin() + n), absent(all.begin() + n, all.end());
+	std::vector<long long> order(n);
+	for (size_t i = 0; i < n; i++) order[i] = (long long)i;
+	std::shuffle(order.begin(), order.end(), g);
+	printf("n = %zu, ns per operation\n", n);
+	run<sjtu::map<long long, long long> >("map", keys, absent, order);
+	run<sjtu::unordered_map<long long, long long> >("unordered_map", keys, absent, order);
+	return 0;
+}
@@ -0,0 +1,119 @@
+/**
+ * YCSB-style throughput of sjtu::concurrent_map across thread counts.
+ *   g++ -std=c++17 -O2 -pthread -I.. ycsb_concurrent_map.cpp -o ycsb
+ *   ./ycsb [records = 1000000] [ops = 1000000, split over the threads] [max threads = 8]
+ * workloads, keys drawn from a zipfian(0.99) over the loaded records:
+ *   A  50% read, 50% update
+ *   B  95% read,  5% update
+ *   C 100% read
+ *   E  95% scan of up to 100 elements, 5% insert of a new key
+ */
+#include "concurrent_map.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <atomic>
+
+class zipfian {
+public:
+	zipfian(unsigned long long n, double theta, unsigned long long seed) :n(n), theta(theta), x(seed | 1) {
+		zetan = zeta(n);
+		double zeta2 = zeta(2);
+		alpha = 1 / (1 - theta);
+		eta = (1 - std::pow(2.0 / n, 1 - theta)) / (1 - zeta2 / zetan);
+	}
+	unsigned long long next() {
+		double u = uniform();
+		double uz = u * zetan;
+		if (uz < 1) return 0;
+		if (uz < 1 + std::pow(0.5, theta)) return 1;
+		return (unsigned long long)(n * std::pow(eta * u - eta + 1, alpha)) % n;
+	}
+	double uniform() {
+		x ^= x << 13;
+		x ^= x >> 7;
+		x ^= x << 17;
+		return (x >> 11) * (1.0 / 9007199254740992.0);
+	}
+private:
+	unsigned long long n;
+	double theta, zetan, alpha, eta;
+	unsigned long long x;
+	double zeta(unsigned long long m) const {
+		double s = 0;
+		for (unsigned long long i = 1; i <= m; i++) s += 1 / std::pow((double)i, theta);
+		return s;
+	}
+};
+
+// scatter the zipfian ranks over the key space, as YCSB does
+static long long scramble(unsigned long long r, unsigned long long n) {
+	return (long long)((r * 0x9E3779B97F4A7C15ull) % n);
+}
+
+typedef sjtu::concurrent_map<long long, long long> cmap;
+
+static double run(cmap &m, char w, int threads, unsigned long long records, unsigned long long ops,
+	std::atomic<unsigned long long> &fresh) {
+	std::vector<std::thread> th;
+	std::atomic<int> ready(0);
+	std::atomic<bool> go(false);
+	std::chrono::steady_clock::time_point t0;
+	for (int t = 0; t < threads; t++) {
+		th.emplace_back([&, t]() {
+			zipfian z(records, 0.99, 0x1234567ull * (t + 1));
+			long long sink = 0;
+			ready++;
+			while (!go.load()) std::this_thread::yield();
+			for (unsigned long long i = 0; i < ops; i++) {
+				double u = z.uniform();
+				long long k = scramble(z.next(), records), v;
+				if (w == 'E') {
+					if (u < 0.95) m.scan(k, 1 + (size_t)(u * 1000) % 100, [&](const cmap::value_type &e) { sink += e.second; });
+					else {
+						long long nk = (long long)fresh++;
+						m.insert(cmap::value_type(nk, nk));
+					}
+					continue;
+				}
+				double reads = (w == 'A') ? 0.5 : (w == 'B') ? 0.95 : 1.0;
+				if (u < reads) {
+					if (m.find(k, v)) sink += v;
+				}
+				else m.update(k, [](long long &x) { x++; });
+			}
+			if (sink == 42) std::printf(" ");
+		});
+	}
+	while (ready.load() < threads) std::this_thread::yield();
+	t0 = std::chrono::steady_clock::now();
+	go = true;
+	for (size_t i = 0; i < th.size(); i++) th[i].join();
+	double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+	return threads * ops / s;
+}
+
+int main(int argc, char** argv) {
+	unsigned long long records = (argc > 1) ? std::atoll(argv[1]) : 1000000;
+	unsigned long long ops = (argc > 2) ? std::atoll(argv[2]) : 1000000;
+	int most = (argc > 3) ? std::atoi(argv[3]) : 8;
+	std::printf("records %llu, ops %llu, hardware threads %u\n", records, ops, std::thread::hardware_concurrency());
+	std::printf("%-9s", "threads");
+	for (int t = 1; t <= most; t *= 2) std::printf("%12d", t);
+	std::printf("   (Mops/s)\n");
+	const char* names = "ABCE";
+	for (int wi = 0; wi < 4; wi++) {
+		std::printf("%-9c", names[wi]);
+		for (int t = 1; t <= most; t *= 2) {
+			cmap m;
+			for (unsigned long long i = 0; i < records; i++) m.insert(cmap::value_type((long long)i, (long long)i));
+			std::atomic<unsigned long long> fresh(records);
+			std::printf("%12.2f", run(m, names[wi], t, records, ops / t, fresh) / 1e6);
+			std::fflush(stdout);
+		}
+		std::printf("\n");
+	}
+}
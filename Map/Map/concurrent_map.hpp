@@ -0,0 +1,312 @@
+/**
+ * implement a thread-safe ordered map out of range-partitioned sjtu::map shards
+ */
+#ifndef SJTU_CONCURRENT_MAP_HPP
+#define SJTU_CONCURRENT_MAP_HPP
+
+// only for std::less<T>
+#include <functional>
+#include <cstddef>
+#include <new>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include "utility.hpp"
+#include "exceptions.hpp"
+#include "map.hpp"
+#include "epoch.hpp"
+
+namespace sjtu {
+
+/**
+ * the key space is cut into ranges, each range is an sjtu::map guarded by
+ *   its own reader-writer lock, so threads touching different ranges never
+ *   wait for each other and readers of one range share it.
+ *
+ * the range boundaries live in an immutable layout published through an
+ *   atomic pointer, finding the shard of a key takes no lock at all.
+ * when a shard grows over shard_limit elements it is split at its median
+ *   (map::split_at, O(log n)) into two new shards and a new layout is
+ *   published.  the old shard is marked retired under its write lock, a
+ *   thread that reaches it through a stale layout sees the mark and looks
+ *   the key up again.  the retired layout and shard go to the
+ *   epoch_domain: every operation runs inside an epoch_guard from the
+ *   moment it loads the layout until it lets go of the shard, so they are
+ *   freed as soon as no thread can still reach them.
+ *
+ * no reference into the container is handed out: lookups copy the value
+ *   and update() runs a function on it under the lock.
+ * scan() and for_each() walk the shards in key order, locking one shard
+ *   at a time; they see every element that is present for the whole walk.
+ *   the callback runs under a shard's read lock and must not write the map.
+ */
+template<
+	class Key,
+	class T,
+	class Compare = std::less<Key>
+> class concurrent_map {
+public:
+	typedef pair<const Key, T> value_type;
+private:
+	class shard {
+	public:
+		mutable std::shared_timed_mutex lock;
+		map<Key, T, Compare> m;
+		bool retired;
+		shard() :retired(false) {}
+	};
+	class layout {
+	public:
+		// shard i holds the keys in [bound[i - 1], bound[i])
+		size_t n;
+		Key* bound;
+		shard** sh;
+		layout(size_t n) :n(n), bound(NULL), sh(NULL) {
+			bound = static_cast<Key*>(::operator new(sizeof(Key) * (n == 0 ? 1 : n)));
+			sh = new shard*[n];
+		}
+		~layout() {
+			for (size_t i = 0; i + 1 < n; i++) bound[i].~Key();
+			::operator delete(bound);
+			delete[] sh;
+		}
+	};
+public:
+	explicit concurrent_map(size_t shard_limit = 1 << 16) :limit(shard_limit < 2 ? 2 : shard_limit), cur(NULL) {
+		layout* l = new layout(1);
+		l->sh[0] = new shard;
+		cur.store(l, std::memory_order_release);
+	}
+	concurrent_map(const concurrent_map &) = delete;
+	concurrent_map & operator=(const concurrent_map &) = delete;
+	/**
+	 * nobody may use the map any more, the live layout and shards are
+	 *   freed at once, the retired ones are already with the epoch_domain.
+	 */
+	~concurrent_map() {
+		layout* l = cur.load(std::memory_order_acquire);
+		for (size_t i = 0; i < l->n; i++) delete l->sh[i];
+		delete l;
+	}
+	/**
+	 * copy the value of key into out, return false if there is no such key.
+	 */
+	bool find(const Key &key, T &out) const {
+		epoch_guard eg;
+		std::shared_lock<std::shared_timed_mutex> g;
+		const map<Key, T, Compare> &m = read(key, g);
+		typename map<Key, T, Compare>::const_iterator it = m.find(key);
+		if (it == m.cend()) return false;
+		out = it->second;
+		return true;
+	}
+	/**
+	 * If no such element exists, an exception of type `index_out_of_bound'
+	 */
+	T at(const Key &key) const {
+		epoch_guard eg;
+		std::shared_lock<std::shared_timed_mutex> g;
+		return read(key, g).at(key);
+	}
+	size_t count(const Key &key) const {
+		epoch_guard eg;
+		std::shared_lock<std::shared_timed_mutex> g;
+		return read(key, g).count(key);
+	}
+	/**
+	 * return false if the key was already there.
+	 */
+	bool insert(const value_type &value) {
+		epoch_guard eg;
+		shard* s;
+		bool ok;
+		{
+			std::unique_lock<std::shared_timed_mutex> g;
+			s = write(value.first, g);
+			ok = s->m.insert(value).second;
+		}
+		if (ok) grown(s);
+		return ok;
+	}
+	/**
+	 * insert or overwrite.
+	 */
+	void assign(const Key &key, const T &value) {
+		epoch_guard eg;
+		shard* s;
+		{
+			std::unique_lock<std::shared_timed_mutex> g;
+			s = write(key, g);
+			s->m[key] = value;
+		}
+		grown(s);
+	}
+	/**
+	 * run f(T &) on the value of key under the shard's write lock,
+	 *   return false if there is no such key.
+	 */
+	template<class F>
+	bool update(const Key &key, F f) {
+		epoch_guard eg;
+		std::unique_lock<std::shared_timed_mutex> g;
+		shard* s = write(key, g);
+		typename map<Key, T, Compare>::iterator it = s->m.find(key);
+		if (it == s->m.end()) return false;
+		f(it->second);
+		return true;
+	}
+	size_t erase(const Key &key) {
+		epoch_guard eg;
+		std::unique_lock<std::shared_timed_mutex> g;
+		shard* s = write(key, g);
+		typename map<Key, T, Compare>::iterator it = s->m.find(key);
+		if (it == s->m.end()) return 0;
+		s->m.erase(it);
+		return 1;
+	}
+	/**
+	 * the sum of the shard sizes, exact only when nobody is writing.
+	 */
+	size_t size() const {
+		size_t n = 0;
+		for (;;) {
+			epoch_guard eg;
+			layout* l = cur.load(std::memory_order_acquire);
+			n = 0;
+			size_t i;
+			for (i = 0; i < l->n; i++) {
+				std::shared_lock<std::shared_timed_mutex> g(l->sh[i]->lock);
+				if (l->sh[i]->retired) break;
+				n += l->sh[i]->m.size();
+			}
+			if (i == l->n) return n;
+		}
+	}
+	bool empty() const { return size() == 0; }
+	size_t shard_count() const {
+		epoch_guard eg;
+		return cur.load(std::memory_order_acquire)->n;
+	}
+	/**
+	 * call f(const value_type &) on at most n elements with key >= lo, in key order.
+	 */
+	template<class F>
+	void scan(const Key &lo, size_t n, F f) const {
+		walk(&lo, n, f);
+	}
+	/**
+	 * call f(const value_type &) on every element in key order.
+	 */
+	template<class F>
+	void for_each(F f) const {
+		walk(NULL, (size_t)-1, f);
+	}
+private:
+	size_t limit;
+	std::atomic<layout*> cur;
+	std::mutex split_lock;
+	Compare cmp;
+	static void free_layout(void* p) { delete static_cast<layout*>(p); }
+	static void free_shard(void* p) { delete static_cast<shard*>(p); }
+	size_t locate(const layout* l, const Key &key) const {
+		size_t lo = 0, len = l->n - 1;
+		while (len > 0) {
+			size_t half = len >> 1;
+			if (!cmp(key, l->bound[lo + half])) lo += half + 1, len -= half + 1;
+			else len = half;
+		}
+		return lo;
+	}
+	const map<Key, T, Compare> & read(const Key &key, std::shared_lock<std::shared_timed_mutex> &g) const {
+		for (;;) {
+			layout* l = cur.load(std::memory_order_acquire);
+			shard* s = l->sh[locate(l, key)];
+			g = std::shared_lock<std::shared_timed_mutex>(s->lock);
+			if (!s->retired) return s->m;
+			g.unlock();
+		}
+	}
+	shard* write(const Key &key, std::unique_lock<std::shared_timed_mutex> &g) {
+		for (;;) {
+			layout* l = cur.load(std::memory_order_acquire);
+			shard* s = l->sh[locate(l, key)];
+			g = std::unique_lock<std::shared_timed_mutex>(s->lock);
+			if (!s->retired) return s;
+			g.unlock();
+		}
+	}
+	/**
+	 * split s at its median if it is over the limit, the caller is inside
+	 *   an epoch_guard since it found s.
+	 */
+	void grown(shard* s) {
+		{
+			std::shared_lock<std::shared_timed_mutex> g(s->lock);
+			if (s->retired || s->m.size() <= limit) return;
+		}
+		std::lock_guard<std::mutex> sg(split_lock);
+		layout* l = cur.load(std::memory_order_acquire);
+		size_t i = 0;
+		while (i < l->n && l->sh[i] != s) i++;
+		if (i == l->n) return;
+		std::unique_lock<std::shared_timed_mutex> g(s->lock);
+		if (s->m.size() <= limit) return;
+		shard *a = new shard, *b = new shard;
+		layout* nl = new layout(l->n + 1);
+		const Key &mid = s->m.rank((int)(s->m.size() / 2 + 1))->first;
+		size_t k = 0;
+		for (size_t j = 0; j + 1 < l->n; j++) {
+			if (j == i) new (nl->bound + k++) Key(mid);
+			new (nl->bound + k++) Key(l->bound[j]);
+		}
+		if (i + 1 == l->n) new (nl->bound + k++) Key(mid);
+		for (size_t j = 0, t = 0; j < l->n; j++) {
+			if (j == i) {
+				nl->sh[t++] = a;
+				nl->sh[t++] = b;
+			}
+			else nl->sh[t++] = l->sh[j];
+		}
+		a->m.union_with(s->m);
+		a->m.split_at(nl->bound[i], b->m);
+		cur.store(nl, std::memory_order_release);
+		s->retired = true;
+		g.unlock();
+		epoch_guard eg;
+		eg.retire(l, free_layout);
+		eg.retire(s, free_shard);
+	}
+	template<class F>
+	void walk(const Key* lo, size_t left, F &f) const {
+		// the resume point is a copy, the shard it came from may be split meanwhile
+		Key* from = (lo == NULL) ? NULL : new Key(*lo);
+		try {
+			while (left > 0) {
+				// one critical section per shard, a long walk does not hold back reclamation
+				epoch_guard eg;
+				layout* l = cur.load(std::memory_order_acquire);
+				size_t i = (from == NULL) ? 0 : locate(l, *from);
+				shard* s = l->sh[i];
+				std::shared_lock<std::shared_timed_mutex> g(s->lock);
+				if (s->retired) continue;
+				const map<Key, T, Compare> &m = s->m;
+				typename map<Key, T, Compare>::const_iterator it =
+					(from == NULL) ? m.cbegin() : m.lower_bound(*from);
+				for (; left > 0 && it != m.cend(); ++it, --left) f(*it);
+				if (i + 1 == l->n) break;
+				delete from;
+				from = NULL;
+				from = new Key(l->bound[i]);
+			}
+		}
+		catch (...) {
+			delete from;
+			throw;
+		}
+		delete from;
+	}
+};
+
+}
+
+#endif
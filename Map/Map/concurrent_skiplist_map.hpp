@@ -0,0 +1,403 @@
+/**
+ * implement a lock-free ordered map as a skip list
+ */
+#ifndef SJTU_CONCURRENT_SKIPLIST_MAP_HPP
+#define SJTU_CONCURRENT_SKIPLIST_MAP_HPP
+
+// only for std::less<T>
+#include <functional>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <atomic>
+#include "utility.hpp"
+#include "exceptions.hpp"
+#include "epoch.hpp"
+
+namespace sjtu {
+
+/**
+ * a skip list whose links are changed only by compare-and-swap, so no
+ *   thread ever waits for another: insert, find and erase are lock-free.
+ *
+ * a link is a node pointer whose low bit marks its owner as being erased.
+ *   erase marks the links of the victim from the top down, the level 0
+ *   mark is the moment it leaves the map; marked nodes are then snipped
+ *   out by whoever walks past them with locate().  an insert links level
+ *   0 first (the moment it enters the map) and then climbs, relocating its
+ *   neighbours whenever a swap fails.
+ * a node is freed through the epoch_domain once both its inserter and its
+ *   eraser are done with it, so a thread inside a critical section never
+ *   reads freed memory, however far behind it is.
+ *
+ * values are copied out, there is no way to change a value in place.
+ * iterators walk level 0 in key order while others write: they see every
+ *   element present for the whole walk and never one erased before they
+ *   got there.  an iterator pins the calling thread's epoch while it points
+ *   at an element, so it must stay on that thread; every repin_every steps
+ *   it lets go and finds its way back by key, so a long walk does not hold
+ *   back reclamation, but an iterator left lying around does.
+ * scan() and for_each() hold no iterator between calls of the callback
+ *   batch and are the way to walk from code that does other work meanwhile.
+ * size() is exact only when nobody is writing.
+ */
+template<
+	class Key,
+	class T,
+	class Compare = std::less<Key>
+> class concurrent_skiplist_map {
+public:
+	typedef pair<const Key, T> value_type;
+private:
+	typedef std::atomic<std::uintptr_t> link;
+	static const int max_level = 24;
+	class node {
+	public:
+		value_type data;
+		// the inserter and the eraser, the last one to leave retires the node
+		std::atomic<int> owners;
+		int level;
+		link* next;
+		node(const value_type &v, int level) :data(v), owners(2), level(level), next(NULL) {}
+	};
+	static std::size_t links_at() {
+		return (sizeof(node) + alignof(link) - 1) / alignof(link) * alignof(link);
+	}
+	static node* make(const value_type &v, int level) {
+		void* raw = ::operator new(links_at() + sizeof(link) * level);
+		node* n;
+		try {
+			n = new (raw) node(v, level);
+		}
+		catch (...) {
+			::operator delete(raw);
+			throw;
+		}
+		n->next = reinterpret_cast<link*>(static_cast<char*>(raw) + links_at());
+		for (int i = 0; i < level; i++) new (n->next + i) link(0);
+		return n;
+	}
+	static void destroy(void* p) {
+		node* n = static_cast<node*>(p);
+		n->~node();
+		::operator delete(p);
+	}
+	static node* ptr(std::uintptr_t v) { return reinterpret_cast<node*>(v & ~(std::uintptr_t)1); }
+	static bool marked(std::uintptr_t v) { return (v & 1) != 0; }
+	static std::uintptr_t word(node* n) { return reinterpret_cast<std::uintptr_t>(n); }
+	/**
+	 * the first node after n on level 0 that is not being erased.
+	 */
+	static node* live(node* n) {
+		while (n != NULL) {
+			std::uintptr_t s = n->next[0].load(std::memory_order_acquire);
+			if (!marked(s)) return n;
+			n = ptr(s);
+		}
+		return NULL;
+	}
+public:
+	class const_iterator {
+		friend class concurrent_skiplist_map;
+	private:
+		node* p;
+		const concurrent_skiplist_map* m;
+		epoch_domain::record* r;
+		size_t steps;
+		const_iterator(node* p, const concurrent_skiplist_map* m) :p(p), m(m), r(NULL), steps(0) {
+			if (p != NULL) pin();
+		}
+		void pin() {
+			r = epoch_domain::mine();
+			epoch_domain::instance().enter(r);
+		}
+		void unpin() {
+			if (r != NULL) epoch_domain::instance().exit(r);
+			r = NULL;
+		}
+	public:
+		const_iterator() :p(NULL), m(NULL), r(NULL), steps(0) {}
+		const_iterator(const const_iterator &other) :p(other.p), m(other.m), r(NULL), steps(0) {
+			if (p != NULL) pin();
+		}
+		const_iterator & operator=(const const_iterator &other) {
+			if (this == &other) return *this;
+			if (other.p != NULL && r == NULL) pin();
+			p = other.p;
+			m = other.m;
+			if (p == NULL) unpin();
+			return *this;
+		}
+		~const_iterator() { unpin(); }
+		const value_type & operator*() const {
+			if (p == NULL) throw invalid_iterator("from concurrent_skiplist_map::const_iterator::operator*");
+			return p->data;
+		}
+		const value_type* operator->() const {
+			if (p == NULL) throw invalid_iterator("from concurrent_skiplist_map::const_iterator::operator->");
+			return &p->data;
+		}
+		const_iterator & operator++() {
+			if (p == NULL) throw invalid_iterator("from concurrent_skiplist_map::const_iterator::operator++");
+			if (++steps % repin_every != 0) p = live(ptr(p->next[0].load(std::memory_order_acquire)));
+			else {
+				// p may be freed once unpinned, its key is all that is kept
+				Key k(p->data.first);
+				unpin();
+				pin();
+				p = m->seek(k, true);
+			}
+			if (p == NULL) unpin();
+			return *this;
+		}
+		const_iterator operator++(int) {
+			const_iterator nw(*this);
+			++(*this);
+			return nw;
+		}
+		bool operator==(const const_iterator &rhs) const { return p == rhs.p; }
+		bool operator!=(const const_iterator &rhs) const { return p != rhs.p; }
+	};
+	concurrent_skiplist_map() :total(0) {
+		for (int i = 0; i < max_level; i++) head[i].store(0, std::memory_order_relaxed);
+	}
+	concurrent_skiplist_map(const concurrent_skiplist_map &) = delete;
+	concurrent_skiplist_map & operator=(const concurrent_skiplist_map &) = delete;
+	/**
+	 * nobody may use the map any more, the nodes still linked are freed at
+	 *   once, the erased ones are already with the epoch_domain.
+	 */
+	~concurrent_skiplist_map() {
+		node* p = ptr(head[0].load(std::memory_order_acquire));
+		while (p != NULL) {
+			node* q = ptr(p->next[0].load(std::memory_order_relaxed));
+			destroy(p);
+			p = q;
+		}
+	}
+	const_iterator cbegin() const {
+		epoch_guard g;
+		return const_iterator(live(ptr(head[0].load(std::memory_order_acquire))), this);
+	}
+	const_iterator cend() const { return const_iterator(); }
+	/**
+	 * the first element whose key is not less than key, or cend().
+	 */
+	const_iterator lower_bound(const Key &key) const {
+		epoch_guard g;
+		return const_iterator(seek(key), this);
+	}
+	/**
+	 * call f(const value_type &) on at most limit elements with key >= lo,
+	 *   in key order.  the walk leaves its critical section every
+	 *   repin_every elements and goes on after the last key it saw.
+	 */
+	template<class F>
+	void scan(const Key &lo, size_t limit, F f) const {
+		walk(&lo, limit, f);
+	}
+	/**
+	 * call f(const value_type &) on every element in key order, see scan().
+	 */
+	template<class F>
+	void for_each(F f) const {
+		walk(NULL, (size_t)-1, f);
+	}
+	size_t size() const {
+		std::ptrdiff_t n = total.load(std::memory_order_relaxed);
+		return (n < 0) ? 0 : (size_t)n;
+	}
+	bool empty() const { return size() == 0; }
+	/**
+	 * copy the value of key into out, return false if there is no such key.
+	 */
+	bool find(const Key &key, T &out) const {
+		epoch_guard g;
+		node* p = seek(key);
+		if (p == NULL || cmp(key, p->data.first)) return false;
+		out = p->data.second;
+		return true;
+	}
+	/**
+	 * If no such element exists, an exception of type `index_out_of_bound'
+	 */
+	T at(const Key &key) const {
+		epoch_guard g;
+		node* p = seek(key);
+		if (p == NULL || cmp(key, p->data.first)) throw index_out_of_bound("from concurrent_skiplist_map::at");
+		return p->data.second;
+	}
+	size_t count(const Key &key) const {
+		epoch_guard g;
+		node* p = seek(key);
+		return (p == NULL || cmp(key, p->data.first)) ? 0 : 1;
+	}
+	/**
+	 * return false if the key was already there.
+	 */
+	bool insert(const value_type &value) {
+		epoch_guard g;
+		link* preds[max_level];
+		node* succs[max_level];
+		int top = random_level();
+		node* n = NULL;
+		for (;;) {
+			if (locate(value.first, preds, succs)) {
+				if (n != NULL) destroy(n);
+				return false;
+			}
+			if (n == NULL) n = make(value, top);
+			for (int i = 0; i < top; i++) n->next[i].store(word(succs[i]), std::memory_order_relaxed);
+			std::uintptr_t expect = word(succs[0]);
+			if (preds[0][0].compare_exchange_strong(expect, word(n), std::memory_order_acq_rel)) break;
+		}
+		total.fetch_add(1, std::memory_order_relaxed);
+		for (int i = 1; i < top && climb(n, i, preds, succs); i++);
+		// an erase that marked n while it climbed may have missed a level
+		if (marked(n->next[0].load(std::memory_order_acquire))) locate(value.first, preds, succs);
+		release(g, n);
+		return true;
+	}
+	/**
+	 * erase the element with key, return the number erased (0 or 1).
+	 */
+	size_t erase(const Key &key) {
+		epoch_guard g;
+		link* preds[max_level];
+		node* succs[max_level];
+		if (!locate(key, preds, succs)) return 0;
+		node* v = succs[0];
+		for (int i = v->level - 1; i >= 1; i--) {
+			std::uintptr_t s = v->next[i].load(std::memory_order_acquire);
+			while (!marked(s) && !v->next[i].compare_exchange_weak(s, s | 1, std::memory_order_acq_rel));
+		}
+		std::uintptr_t s = v->next[0].load(std::memory_order_acquire);
+		for (;;) {
+			// another erase got there first
+			if (marked(s)) return 0;
+			if (v->next[0].compare_exchange_weak(s, s | 1, std::memory_order_acq_rel)) break;
+		}
+		total.fetch_sub(1, std::memory_order_relaxed);
+		locate(key, preds, succs);
+		release(g, v);
+		return 1;
+	}
+	/**
+	 * how many elements an iterator or a scan passes under one pin.
+	 */
+	static const size_t repin_every = 64;
+private:
+	mutable link head[max_level];
+	std::atomic<std::ptrdiff_t> total;
+	Compare cmp;
+	static int random_level() {
+		static thread_local std::uint32_t x = 0;
+		if (x == 0) x = (std::uint32_t)(reinterpret_cast<std::uintptr_t>(&x) >> 4) | 1;
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		int l = 1;
+		// one in four nodes goes up a level
+		for (std::uint32_t y = x; l < max_level && (y & 3) == 0; y >>= 2) l++;
+		return l;
+	}
+	/**
+	 * find on every level the last link before key (preds, the links of a
+	 *   node or the head) and the node after it (succs), snipping out every
+	 *   marked node on the way.  return whether succs[0] holds key.
+	 */
+	bool locate(const Key &key, link** preds, node** succs) const {
+	retry:
+		link* pred = head;
+		node* curr = NULL;
+		for (int i = max_level - 1; i >= 0; i--) {
+			curr = ptr(pred[i].load(std::memory_order_acquire));
+			while (curr != NULL) {
+				std::uintptr_t succ = curr->next[i].load(std::memory_order_acquire);
+				if (marked(succ)) {
+					std::uintptr_t expect = word(curr);
+					if (!pred[i].compare_exchange_strong(expect, succ & ~(std::uintptr_t)1, std::memory_order_acq_rel)) goto retry;
+					curr = ptr(succ);
+					continue;
+				}
+				if (!cmp(curr->data.first, key)) break;
+				pred = curr->next;
+				curr = ptr(succ);
+			}
+			preds[i] = pred;
+			succs[i] = curr;
+		}
+		return curr != NULL && !cmp(key, curr->data.first);
+	}
+	/**
+	 * the first node with key not less than key (greater than key with
+	 *   after) that is not being erased, a read-only descent that steps
+	 *   over marked nodes.
+	 */
+	node* seek(const Key &key, bool after = false) const {
+		link* pred = head;
+		node* curr = NULL;
+		for (int i = max_level - 1; i >= 0; i--) {
+			curr = ptr(pred[i].load(std::memory_order_acquire));
+			while (curr != NULL) {
+				std::uintptr_t succ = curr->next[i].load(std::memory_order_acquire);
+				if (!marked(succ)) {
+					if (after ? cmp(key, curr->data.first) : !cmp(curr->data.first, key)) break;
+					pred = curr->next;
+				}
+				curr = ptr(succ);
+			}
+		}
+		return curr;
+	}
+	template<class F>
+	void walk(const Key* lo, size_t limit, F &f) const {
+		// the resume point is a copy, the node it came from may be freed meanwhile
+		Key* from = NULL;
+		try {
+			while (limit > 0) {
+				epoch_guard g;
+				node* p = (from != NULL) ? seek(*from, true) :
+					((lo != NULL) ? seek(*lo) : live(ptr(head[0].load(std::memory_order_acquire))));
+				for (size_t i = 1; p != NULL && limit > 0; i++) {
+					f(p->data);
+					--limit;
+					if (i == repin_every) break;
+					p = live(ptr(p->next[0].load(std::memory_order_acquire)));
+				}
+				if (p == NULL || limit == 0) break;
+				delete from;
+				from = NULL;
+				from = new Key(p->data.first);
+			}
+		}
+		catch (...) {
+			delete from;
+			throw;
+		}
+		delete from;
+	}
+	/**
+	 * link n, already on level 0, into level i.  return false when n is
+	 *   being erased, then the levels above are left alone.
+	 */
+	bool climb(node* n, int i, link** preds, node** succs) {
+		for (;;) {
+			std::uintptr_t old = n->next[i].load(std::memory_order_acquire);
+			if (marked(old)) return false;
+			if (ptr(old) != succs[i] && !n->next[i].compare_exchange_strong(old, word(succs[i]), std::memory_order_acq_rel)) continue;
+			std::uintptr_t expect = word(succs[i]);
+			if (preds[i][i].compare_exchange_strong(expect, word(n), std::memory_order_acq_rel)) return true;
+			locate(n->data.first, preds, succs);
+			// n was erased and snipped from level 0 meanwhile
+			if (succs[0] != n) return false;
+		}
+	}
+	static void release(epoch_guard &g, node* n) {
+		if (n->owners.fetch_sub(1, std::memory_order_acq_rel) == 1) g.retire(n, destroy);
+	}
+};
+
+}
+
+#endif
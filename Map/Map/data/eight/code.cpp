@@ -0,0 +1,191 @@
+// art_map against sjtu::map<std::string, int>
+
+#include <iostream>
+#include <string>
+#include "map.hpp"
+#include "art_map.hpp"
+
+typedef sjtu::art_map<int> art;
+typedef sjtu::map<std::string, int> ref;
+
+const int random_ops = 200000;
+
+unsigned long long seed = 20241019;
+int rand() {
+	seed ^= seed << 13;
+	seed ^= seed >> 7;
+	seed ^= seed << 17;
+	return (int)(seed >> 33);
+}
+
+int errors = 0;
+
+void fail(const char* what, const std::string &key) {
+	if (++errors <= 10) std::cout << "mismatch " << what << " [" << key.size() << " bytes]" << std::endl;
+}
+
+/**
+ * the same elements in the same order, walked both ways.
+ */
+void check(const art &a, const ref &b) {
+	if (a.size() != b.size()) fail("size", "");
+	art::const_iterator i = a.cbegin();
+	for (ref::const_iterator j = b.cbegin(); j != b.cend(); ++j, ++i) {
+		if (i == a.cend()) {
+			fail("short", j->first);
+			return;
+		}
+		if (i->first != j->first || i->second != j->second) fail("order", j->first);
+	}
+	if (i != a.cend()) fail("long", i->first);
+	if (b.empty()) return;
+	i = a.cend();
+	ref::const_iterator j = b.cend();
+	do {
+		--i;
+		--j;
+		if (i->first != j->first) fail("backward", j->first);
+	} while (j != b.cbegin());
+}
+
+void insert(art &a, ref &b, const std::string &key, int v) {
+	bool x = a.insert(art::value_type(key, v)).second;
+	bool y = b.insert(ref::value_type(key, v)).second;
+	if (x != y) fail("insert", key);
+}
+
+void erase(art &a, ref &b, const std::string &key) {
+	ref::iterator it = b.find(key);
+	size_t y = 0;
+	if (it != b.end()) {
+		b.erase(it);
+		y = 1;
+	}
+	if (a.erase(key) != y) fail("erase", key);
+}
+
+void lookup(const art &a, const ref &b, const std::string &key) {
+	ref::const_iterator it = b.find(key);
+	art::const_iterator jt = a.find(key);
+	if ((it == b.cend()) != (jt == a.cend())) fail("find", key);
+	else if (it != b.cend() && jt->second != it->second) fail("value", key);
+}
+
+void prefix(const art &a, const ref &b, const std::string &p) {
+	sjtu::pair<art::const_iterator, art::const_iterator> r = a.prefix_range(p);
+	art::const_iterator i = r.first;
+	for (ref::const_iterator j = b.lower_bound(p); j != b.cend() && j->first.compare(0, p.size(), p) == 0; ++j, ++i) {
+		if (i == r.second || i->first != j->first) {
+			fail("prefix", p);
+			return;
+		}
+	}
+	if (i != r.second) fail("prefix end", p);
+}
+
+unsigned long long checksum(const ref &b) {
+	unsigned long long s = 0;
+	for (ref::const_iterator j = b.cbegin(); j != b.cend(); ++j) s = s * 31 + (unsigned long long)j->second + j->first.size();
+	return s;
+}
+
+/**
+ * one inner node fans out to 1, 2, ... 256 children and back, it passes
+ *   node4 -> node16 -> node48 -> node256 and shrinks through them again.
+ */
+void fan_out() {
+	art a;
+	ref b;
+	std::string base = "fan/";
+	insert(a, b, base, -1);
+	int order[256];
+	for (int c = 0; c < 256; c++) order[c] = (c * 97 + 13) % 256;
+	for (int c = 0; c < 256; c++) {
+		insert(a, b, base + (char)order[c], c);
+		insert(a, b, base + (char)order[c] + "tail", c + 1000);
+		check(a, b);
+	}
+	std::cout << "grown " << a.size() << " " << checksum(b) << std::endl;
+	for (int c = 0; c < 256; c++) lookup(a, b, base + (char)c);
+	prefix(a, b, base);
+	prefix(a, b, base + (char)200);
+	for (int c = 255; c >= 0; c--) {
+		erase(a, b, base + (char)order[(c * 7) % 256] + "tail");
+		erase(a, b, base + (char)order[(c * 7) % 256]);
+		check(a, b);
+	}
+	std::cout << "shrunk " << a.size() << " " << checksum(b) << std::endl;
+	erase(a, b, base);
+	check(a, b);
+}
+
+/**
+ * keys sharing prefixes much longer than the stored part of a node
+ *   prefix, split at every distance and merged back by the erases.
+ */
+void long_prefix() {
+	art a;
+	ref b;
+	std::string base;
+	for (int i = 0; i < 48; i++) base += (char)('a' + i % 26);
+	insert(a, b, base + "#1", 1);
+	insert(a, b, base + "#2", 2);
+	int cut[] = { 47, 40, 25, 12, 11, 10, 9, 3, 0 };
+	for (int k = 0; k < 9; k++) {
+		std::string key = base.substr(0, cut[k]) + "!" + base.substr(cut[k]);
+		insert(a, b, key, 10 + k);
+		insert(a, b, base.substr(0, cut[k]), 20 + k);
+		check(a, b);
+		// differs from a stored key only past the stored prefix bytes
+		std::string near = base;
+		near[cut[k] < 47 ? 47 : 46] = '?';
+		lookup(a, b, near);
+		lookup(a, b, near + "#1");
+		prefix(a, b, base.substr(0, cut[k] + 1));
+		prefix(a, b, near.substr(0, 30));
+	}
+	std::cout << "split " << a.size() << " " << checksum(b) << std::endl;
+	for (int k = 0; k < 9; k++) {
+		erase(a, b, base.substr(0, cut[k]) + "!" + base.substr(cut[k]));
+		check(a, b);
+		erase(a, b, base.substr(0, cut[k]));
+		check(a, b);
+		lookup(a, b, base + "#1");
+	}
+	std::cout << "merged " << a.size() << " " << checksum(b) << std::endl;
+}
+
+std::string random_key() {
+	static const char* stem[] = { "", "https://www.example.com/products/", "https://www.example.com/users/", "\xff\xff", "a" };
+	std::string s = stem[rand() % 5];
+	int len = rand() % 5;
+	for (int i = 0; i < len; i++) s += "ab\xff\x01"[rand() % 4];
+	if (rand() % 8 == 0) s += (char)(rand() % 256);
+	return s;
+}
+
+void mixed() {
+	art a;
+	ref b;
+	for (int i = 0; i < random_ops; i++) {
+		std::string key = random_key();
+		int op = rand() % 10;
+		if (op < 5) insert(a, b, key, rand());
+		else if (op < 8) erase(a, b, key);
+		else if (op < 9) lookup(a, b, key);
+		else prefix(a, b, key);
+		if (i % 1000 == 0) check(a, b);
+	}
+	check(a, b);
+	art c(a);
+	check(c, b);
+	std::cout << "mixed " << a.size() << " " << checksum(b) << std::endl;
+}
+
+int main() {
+	fan_out();
+	long_prefix();
+	mixed();
+	std::cout << "errors " << errors << std::endl;
+	return 0;
+}
@@ -0,0 +1,146 @@
+// interval_map against a brute force scan of a std::map of the same
+// intervals: short and long intervals over a small range so that most of
+// them overlap, inserted, found and erased (by key and by iterator), with
+// overlap, stabbing and overlaps queries checked for the intervals they
+// report, their order and their count, endpoints included.
+
+#include <iostream>
+#include <map>
+#include <utility>
+#include <vector>
+#include "interval_map.hpp"
+
+const int steps = 60000;
+const int coord_range = 4000;
+const int max_size = 3000;
+
+unsigned long long seed = 8800;
+int rand() {
+	seed ^= seed << 13;
+	seed ^= seed >> 7;
+	seed ^= seed << 17;
+	return (int)(seed >> 33);
+}
+
+typedef sjtu::interval_map<int, int> imap;
+typedef std::map<std::pair<int, int>, int> ref_type;
+
+int errors = 0;
+
+void fail(const char* what, int step) {
+	if (++errors <= 10) std::cout << "mismatch " << what << " at step " << step << std::endl;
+}
+
+class collect {
+public:
+	std::vector<std::pair<std::pair<int, int>, int> >* out;
+	collect(std::vector<std::pair<std::pair<int, int>, int> >* out) :out(out) {}
+	void operator()(const imap::value_type &v) const {
+		out->push_back(std::make_pair(std::make_pair(v.first.first, v.first.second), v.second));
+	}
+};
+
+/**
+ * the intervals of r overlapping [lo, hi) in key order, or containing lo
+ *   when stab.
+ */
+std::vector<std::pair<std::pair<int, int>, int> > brute(const ref_type &r, int lo, int hi, bool stab) {
+	std::vector<std::pair<std::pair<int, int>, int> > v;
+	for (ref_type::const_iterator it = r.begin(); it != r.end(); ++it) {
+		bool hit = stab ? (it->first.first <= lo && lo < it->first.second)
+			: (it->first.first < hi && lo < it->first.second);
+		if (hit) v.push_back(*it);
+	}
+	return v;
+}
+
+int interval_end(int lo) {
+	// mostly short, some long, a few spanning most of the range
+	int r = rand() % 10;
+	int len = (r < 6) ? rand() % 20 + 1 : (r < 9) ? rand() % 400 + 1 : rand() % coord_range + 1;
+	return lo + len;
+}
+
+int main() {
+	imap m;
+	ref_type r;
+	long long reported = 0;
+	try {
+		m.insert(5, 5, 0);
+		fail("empty interval", 0);
+	}
+	catch (sjtu::runtime_error &) {}
+	for (int step = 0; step < steps; step++) {
+		int op = rand() % 10;
+		if (op < 4 && r.size() < (size_t)max_size) {
+			int lo = rand() % coord_range;
+			int hi = interval_end(lo);
+			int v = rand();
+			sjtu::pair<imap::iterator, bool> got = m.insert(lo, hi, v);
+			bool fresh = r.insert(std::make_pair(std::make_pair(lo, hi), v)).second;
+			if (got.second != fresh) fail("insert result", step);
+			if (got.first->first.first != lo || got.first->first.second != hi || got.first->second != r[std::make_pair(lo, hi)]) fail("insert iterator", step);
+		}
+		else if (op < 6 && !r.empty()) {
+			// erase an existing interval or a made-up one
+			int lo, hi;
+			if (rand() % 4 != 0) {
+				ref_type::iterator it = r.lower_bound(std::make_pair(rand() % coord_range, 0));
+				if (it == r.end()) it = r.begin();
+				lo = it->first.first;
+				hi = it->first.second;
+			}
+			else {
+				lo = rand() % coord_range;
+				hi = interval_end(lo);
+			}
+			size_t want = r.erase(std::make_pair(lo, hi));
+			if (rand() % 2 == 0) {
+				imap::iterator it = m.find(lo, hi);
+				if ((it != m.end()) != (want == 1)) fail("find before erase", step);
+				if (it != m.end()) m.erase(it);
+			}
+			else if (m.erase(lo, hi) != want) fail("erase result", step);
+		}
+		else {
+			int lo = rand() % (coord_range + 200) - 100;
+			int hi = lo + rand() % 300 + (rand() % 8 == 0 ? -10 : 0);
+			if (rand() % 3 == 0 && !r.empty()) {
+				// on an endpoint of an interval that is there
+				ref_type::iterator it = r.lower_bound(std::make_pair(rand() % coord_range, 0));
+				if (it == r.end()) it = r.begin();
+				lo = (rand() % 2 == 0) ? it->first.first : it->first.second;
+				hi = lo + rand() % 50 + 1;
+			}
+			std::vector<std::pair<std::pair<int, int>, int> > got, want;
+			size_t k;
+			if (rand() % 2 == 0) {
+				k = m.overlapping(lo, hi, collect(&got));
+				want = brute(r, lo, hi, false);
+				if (!(lo < hi)) want.clear();
+				if (got != want) fail("overlapping", step);
+				bool any = m.overlaps(lo, hi);
+				if (any != !want.empty()) fail("overlaps", step);
+			}
+			else {
+				k = m.stabbing(lo, collect(&got));
+				want = brute(r, lo, hi, true);
+				if (got != want) fail("stabbing", step);
+			}
+			if (k != want.size()) fail("query count", step);
+			reported += k;
+		}
+		if (m.size() != r.size()) fail("size", step);
+	}
+	ref_type::const_iterator j = r.begin();
+	for (imap::const_iterator it = m.cbegin(); it != m.cend(); ++it, ++j)
+		if (j == r.end() || it->first.first != j->first.first || it->first.second != j->first.second || it->second != j->second) {
+			fail("final walk", steps);
+			break;
+		}
+	m.clear();
+	if (!m.empty() || m.overlaps(0, coord_range * 2) || m.stabbing(0, collect(NULL)) != 0) fail("clear", steps);
+	std::cout << "size " << r.size() << " reported " << reported << std::endl;
+	std::cout << "errors " << errors << std::endl;
+	return 0;
+}
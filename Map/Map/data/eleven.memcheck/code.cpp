@@ -0,0 +1,174 @@
+// map with an element whose copy throws: a copy or an assignment that
+// throws halfway frees what it made and leaves the source as it was, an
+// apply_batch leaves a valid map in which each op was applied or not.
+// the grains and the depth are forced small so the copies fork on one core too.
+
+#define SJTU_MAP_FORK_GRAIN 32
+#define SJTU_MAP_BATCH_GRAIN 8
+#define SJTU_MAP_FORK_DEPTH 4
+
+#include <iostream>
+#include <atomic>
+#include <map>
+#include <vector>
+#include "map.hpp"
+
+const int entries = 1000;
+const int attempts = 20;
+
+unsigned long long seed = 4400;
+int rand() {
+	seed ^= seed << 13;
+	seed ^= seed >> 7;
+	seed ^= seed << 17;
+	return (int)(seed >> 33);
+}
+
+// copies and assignments left before the next one throws, negative when disarmed
+std::atomic<int> fuse(-1);
+std::atomic<long long> live(0);
+
+class value {
+public:
+	int x;
+	value(int x = 0) :x(x) { live++; }
+	value(const value &other) :x(other.x) {
+		if (fuse.load() >= 0 && fuse.fetch_sub(1) == 0) throw x;
+		live++;
+	}
+	value & operator=(const value &other) {
+		if (fuse.load() >= 0 && fuse.fetch_sub(1) == 0) throw x;
+		x = other.x;
+		return *this;
+	}
+	~value() { live--; }
+};
+
+typedef sjtu::map<int, value> map_type;
+
+int errors = 0;
+
+void fail(const char* what, int attempt) {
+	if (++errors <= 10) std::cout << "mismatch " << what << " at attempt " << attempt << std::endl;
+}
+
+unsigned long long checksum(const map_type &m) {
+	unsigned long long h = 0;
+	for (map_type::const_iterator it = m.cbegin(); it != m.cend(); ++it)
+		h = h * 1000003 + (unsigned long long)(it->first * 31 + it->second.x);
+	return h;
+}
+
+void intact(const map_type &m, unsigned long long sum, const char* what, int attempt) {
+	try {
+		m.validate();
+	}
+	catch (sjtu::runtime_error &) {
+		fail(what, attempt);
+		return;
+	}
+	if (m.size() != (size_t)entries || checksum(m) != sum) fail(what, attempt);
+}
+
+int main() {
+	map_type m;
+	for (int i = 0; i < entries; i++) m[rand() % (entries * 4)];
+	while (m.size() < (size_t)entries) m[rand() % (entries * 4)];
+	for (map_type::iterator it = m.begin(); it != m.end(); ++it) it->second.x = rand() % 1000;
+	unsigned long long sum = checksum(m);
+	long long base = live.load();
+	int caught = 0;
+	for (int a = 0; a < attempts; a++) {
+		fuse = rand() % (entries + entries / 10);
+		try {
+			map_type c(m);
+			fuse = -1;
+			intact(c, sum, "copy", a);
+		}
+		catch (int) {
+			caught++;
+		}
+		fuse = -1;
+		if (live.load() != base) fail("copy leak", a);
+		intact(m, sum, "copy source", a);
+		map_type d;
+		d[1] = value(1);
+		fuse = rand() % (entries + entries / 10);
+		try {
+			d = m;
+			fuse = -1;
+			intact(d, sum, "assign", a);
+		}
+		catch (int) {
+			caught++;
+			fuse = -1;
+			try {
+				d.validate();
+			}
+			catch (sjtu::runtime_error &) {
+				fail("assign target", a);
+			}
+		}
+		fuse = -1;
+		d.clear();
+		if (live.load() != base) fail("assign leak", a);
+		intact(m, sum, "assign source", a);
+	}
+	// batches over a copy, checked against std::map
+	map_type b(m);
+	std::map<int, int> r;
+	for (map_type::const_iterator it = b.cbegin(); it != b.cend(); ++it) r[it->first] = it->second.x;
+	for (int a = 0; a < attempts; a++) {
+		std::vector<map_type::batch_op> ops;
+		int n = rand() % 200 + 1;
+		for (int i = 0; i < n; i++) {
+			int k = rand() % (entries * 4);
+			if (rand() % 3 == 0) ops.push_back(map_type::batch_op(k));
+			else ops.push_back(map_type::batch_op(k, value(rand() % 1000)));
+		}
+		// the state of every touched key after the batch, -1 for absent
+		std::map<int, int> after;
+		for (size_t i = 0; i < ops.size(); i++) after[ops[i].key] = ops[i].erase ? -1 : ops[i].value.x;
+		long long held = live.load() - (long long)b.size();
+		fuse = rand() % (n + n / 2 + 1);
+		try {
+			b.apply_batch(ops.begin(), ops.end(), true);
+		}
+		catch (int) {
+			caught++;
+		}
+		fuse = -1;
+		try {
+			b.validate();
+		}
+		catch (sjtu::runtime_error &) {
+			fail("batch validate", a);
+			break;
+		}
+		if (live.load() - (long long)b.size() != held) fail("batch leak", a);
+		for (std::map<int, int>::const_iterator i = after.begin(); i != after.end(); ++i) {
+			map_type::const_iterator it = b.find(i->first);
+			int now = (it == b.cend()) ? -1 : it->second.x;
+			std::map<int, int>::iterator was = r.find(i->first);
+			if (now != i->second && now != ((was == r.end()) ? -1 : was->second)) fail("batch element", a);
+			if (now < 0) {
+				if (was != r.end()) r.erase(was);
+			}
+			else r[i->first] = now;
+		}
+		if (b.size() != r.size()) fail("batch size", a);
+		else {
+			std::map<int, int>::const_iterator j = r.begin();
+			for (map_type::const_iterator it = b.cbegin(); it != b.cend(); ++it, ++j)
+				if (it->first != j->first || it->second.x != j->second) {
+					fail("batch untouched element", a);
+					break;
+				}
+		}
+	}
+	b.clear();
+	if (live.load() != base) fail("batch leak", 0);
+	std::cout << "caught " << caught << std::endl;
+	std::cout << "errors " << errors << std::endl;
+	return 0;
+}
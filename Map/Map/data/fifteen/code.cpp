@@ -0,0 +1,158 @@
+// persistent_map snapshots against copies of std::map taken at the same
+// time: after every later write to the map (and to other snapshots) each
+// snapshot must still hold exactly what it was taken with, walked both
+// ways and looked up.  a snapshot is also read and dropped on another
+// thread while the map goes on being written, and every node is freed
+// once the last version that holds it is gone.
+
+#include <iostream>
+#include <thread>
+#include <atomic>
+#include <map>
+#include <vector>
+#include "persistent_map.hpp"
+
+const int steps = 100000;
+const int key_range = 3000;
+const int kept = 12;
+const int snapshot_every = 500;
+const int thread_rounds = 6;
+
+unsigned long long seed = 6400;
+int rand() {
+	seed ^= seed << 13;
+	seed ^= seed >> 7;
+	seed ^= seed << 17;
+	return (int)(seed >> 33);
+}
+
+std::atomic<long long> live(0);
+
+class value {
+public:
+	int x;
+	value(int x = 0) :x(x) { live++; }
+	value(const value &other) :x(other.x) { live++; }
+	value & operator=(const value &other) {
+		x = other.x;
+		return *this;
+	}
+	~value() { live--; }
+};
+
+typedef sjtu::persistent_map<int, value> pmap;
+typedef std::map<int, int> reference;
+
+std::atomic<int> errors(0);
+
+void fail(const char* what, int step) {
+	if (++errors <= 10) std::cout << "mismatch " << what << " at step " << step << std::endl;
+}
+
+bool same(const pmap &m, const reference &r) {
+	if (m.size() != r.size()) return false;
+	reference::const_iterator j = r.begin();
+	for (pmap::const_iterator it = m.cbegin(); it != m.cend(); ++it, ++j)
+		if (j == r.end() || it->first != j->first || it->second.x != j->second) return false;
+	if (r.empty()) return true;
+	reference::const_reverse_iterator k = r.rbegin();
+	pmap::const_iterator it = m.cend();
+	for (; k != r.rend(); ++k) {
+		--it;
+		if (it->first != k->first) return false;
+	}
+	return true;
+}
+
+void write(pmap &m, reference &r, int step) {
+	int op = rand() % 100, k = rand() % key_range;
+	if (op < 40) {
+		bool fresh = r.find(k) == r.end();
+		if (m.insert(pmap::value_type(k, value(step))).second != fresh) fail("insert", step);
+		if (fresh) r[k] = step;
+	}
+	else if (op < 65) {
+		m[k].x = step;
+		r[k] = step;
+	}
+	else if (op < 90) {
+		if (m.erase(k) != r.erase(k)) fail("erase", step);
+	}
+	else {
+		pmap::const_iterator it = m.find(k);
+		if ((it == m.cend()) != (r.find(k) == r.end())) fail("find", step);
+		else if (it != m.cend()) {
+			m.erase(it);
+			r.erase(k);
+		}
+	}
+}
+
+int main() {
+	{
+		pmap m;
+		reference r;
+		std::vector<pmap> snaps;
+		std::vector<reference> was;
+		for (int step = 0; step < steps; step++) {
+			write(m, r, step);
+			if (step % snapshot_every == 0) {
+				if ((int)snaps.size() == kept) {
+					int i = rand() % kept;
+					snaps.erase(snaps.begin() + i);
+					was.erase(was.begin() + i);
+				}
+				snaps.push_back(m.snapshot());
+				was.push_back(r);
+			}
+			if (step % snapshot_every == snapshot_every / 2 && snaps.size() > 1) {
+				// a snapshot is a map of its own: a write to it is seen by nobody else
+				int i = rand() % (int)snaps.size();
+				pmap other(snaps[i]);
+				reference ro(was[i]);
+				for (int w = 0; w < 50; w++) write(other, ro, step);
+				if (!same(other, ro)) fail("written snapshot", step);
+				int j = rand() % (int)snaps.size();
+				snaps[j] = other;
+				was[j] = ro;
+				for (size_t s = 0; s < snaps.size(); s++)
+					if (!same(snaps[s], was[s])) fail("snapshot isolation", step);
+				if (!same(m, r)) fail("map", step);
+			}
+		}
+		for (size_t s = 0; s < snaps.size(); s++) {
+			if (!same(snaps[s], was[s])) fail("snapshot at the end", steps);
+			for (reference::const_iterator j = was[s].begin(); j != was[s].end(); ++j)
+				if (snaps[s].at(j->first).x != j->second || snaps[s].count(j->first) != 1) {
+					fail("snapshot lookup", steps);
+					break;
+				}
+		}
+		std::cout << "size " << m.size() << std::endl;
+	}
+	if (live.load() != 0) fail("leak", steps);
+	// a reader thread per round walks its snapshot and drops it
+	{
+		pmap m;
+		reference r;
+		for (int round = 0; round < thread_rounds; round++) {
+			pmap* s = new pmap(m.snapshot());
+			reference* rs = new reference(r);
+			std::atomic<bool> go(false);
+			std::thread reader([&]() {
+				go = true;
+				for (int i = 0; i < 20; i++)
+					if (!same(*s, *rs)) fail("snapshot read on a thread", round);
+				delete s;
+				delete rs;
+			});
+			while (!go.load());
+			for (int w = 0; w < steps / 10; w++) write(m, r, w);
+			reader.join();
+		}
+		if (!same(m, r)) fail("map after threads", 0);
+	}
+	if (live.load() != 0) fail("leak after threads", 0);
+	std::cout << "errors " << errors.load() << std::endl;
+	return 0;
+}
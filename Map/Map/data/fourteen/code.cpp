@@ -0,0 +1,186 @@
+// concurrent_skiplist_map: first alone against sjtu::map (insert, erase,
+// find, at, count, lower_bound, iterators, scan, for_each, size), then
+// under threads.  each writer owns the keys of its residue and keeps its
+// own reference, all writers race for a shared range (what is left there
+// must be the successful inserts less the successful erases), and a
+// reader walks the map meanwhile: in order, no duplicates, the values
+// right, and every key that is never erased seen on every walk.
+
+#include <iostream>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include "map.hpp"
+#include "concurrent_skiplist_map.hpp"
+
+const int steps = 200000;
+const int key_range = 5000;
+const int writers = 4;
+const int thread_steps = 100000;
+const int shared_keys = 20000;
+const int stable_keys = 500;
+
+unsigned long long seed = 6000;
+int rand() {
+	seed ^= seed << 13;
+	seed ^= seed >> 7;
+	seed ^= seed << 17;
+	return (int)(seed >> 33);
+}
+
+typedef sjtu::concurrent_skiplist_map<int, long long> skiplist;
+typedef sjtu::map<int, long long> reference;
+
+std::atomic<int> errors(0);
+
+void fail(const char* what, int step) {
+	if (++errors <= 10) std::cout << "mismatch " << what << " at step " << step << std::endl;
+}
+
+void compare(const skiplist &s, const reference &r, int step) {
+	if (s.size() != r.size()) fail("size", step);
+	reference::const_iterator j = r.cbegin();
+	for (skiplist::const_iterator it = s.cbegin(); it != s.cend(); ++it, ++j)
+		if (j == r.cend() || it->first != j->first || it->second != j->second) {
+			fail("iterator walk", step);
+			return;
+		}
+	if (j != r.cend()) fail("iterator walk", step);
+	j = r.cbegin();
+	bool ok = true;
+	s.for_each([&](const skiplist::value_type &v) {
+		if (j == r.cend() || v.first != j->first || v.second != j->second) ok = false;
+		else ++j;
+	});
+	if (!ok || j != r.cend()) fail("for_each", step);
+}
+
+void alone() {
+	skiplist s;
+	reference r;
+	for (int step = 0; step < steps; step++) {
+		int op = rand() % 100, k = rand() % key_range;
+		if (op < 40) {
+			bool fresh = r.find(k) == r.end();
+			if (s.insert(skiplist::value_type(k, step)) != fresh) fail("insert", step);
+			if (fresh) r[k] = step;
+		}
+		else if (op < 70) {
+			if (s.erase(k) != r.erase(k)) fail("erase", step);
+		}
+		else if (op < 85) {
+			long long v = -1;
+			bool there = s.find(k, v);
+			reference::const_iterator j = r.find(k);
+			if (there != (j != r.cend()) || (there && v != j->second)) fail("find", step);
+			if (s.count(k) != r.count(k)) fail("count", step);
+			try {
+				if (s.at(k) != j->second) fail("at", step);
+			}
+			catch (sjtu::index_out_of_bound &) {
+				if (j != r.cend()) fail("at", step);
+			}
+		}
+		else if (op < 95) {
+			skiplist::const_iterator it = s.lower_bound(k);
+			reference::const_iterator j = r.lower_bound(k);
+			if ((it == s.cend()) != (j == r.cend()) || (j != r.cend() && it->first != j->first)) fail("lower_bound", step);
+		}
+		else {
+			size_t limit = (size_t)(rand() % 300);
+			reference::const_iterator j = r.lower_bound(k);
+			size_t seen = 0;
+			bool ok = true;
+			s.scan(k, limit, [&](const skiplist::value_type &v) {
+				if (j == r.cend() || v.first != j->first || v.second != j->second) ok = false;
+				else ++j;
+				seen++;
+			});
+			size_t want = 0;
+			for (reference::const_iterator i = r.lower_bound(k); i != r.cend() && want < limit; ++i) want++;
+			if (!ok || seen != want) fail("scan", step);
+		}
+		if (step % 20000 == 0) compare(s, r, step);
+	}
+	compare(s, r, steps);
+	std::cout << "alone size " << s.size() << std::endl;
+}
+
+// a writer's own keys are base + writers * i, the shared ones sit above key_range * writers
+const int shared_base = 1 << 24, stable_base = 1 << 28;
+
+void together() {
+	skiplist s;
+	for (int i = 0; i < stable_keys; i++) s.insert(skiplist::value_type(stable_base + i * 7, 3LL * (stable_base + i * 7)));
+	std::atomic<long long> shared_in(0), shared_out(0);
+	std::atomic<bool> done(false);
+	std::vector<reference> own(writers);
+	std::vector<std::thread> ts;
+	for (int w = 0; w < writers; w++)
+		ts.push_back(std::thread([&, w]() {
+			unsigned long long x = 6100 + w;
+			reference &r = own[w];
+			for (int step = 0; step < thread_steps; step++) {
+				x ^= x << 13;
+				x ^= x >> 7;
+				x ^= x << 17;
+				int k = w + writers * (int)((x >> 20) % key_range);
+				if ((x & 3) != 0) {
+					if (s.insert(skiplist::value_type(k, 3LL * k)) != (r.find(k) == r.end())) fail("thread insert", step);
+					r[k] = 3LL * k;
+				}
+				else {
+					if (s.erase(k) != r.erase(k)) fail("thread erase", step);
+				}
+				// the shared range: every writer goes through it in its own order
+				int j = shared_base + (int)(((unsigned long long)step * 7919 + w * 104729ULL) % shared_keys);
+				if (step % 2 == 0) shared_in += s.insert(skiplist::value_type(j, 3LL * j)) ? 1 : 0;
+				else shared_out += (long long)s.erase(j);
+			}
+		}));
+	long long walks = 0;
+	std::thread reader([&]() {
+		while (!done.load()) {
+			long long last = -1;
+			int stable = 0;
+			bool ok = true;
+			s.for_each([&](const skiplist::value_type &v) {
+				if (v.first <= last || v.second != 3LL * v.first) ok = false;
+				last = v.first;
+				if (v.first >= stable_base) stable++;
+			});
+			if (!ok) fail("reader order", (int)walks);
+			if (stable != stable_keys) fail("reader stable keys", (int)walks);
+			walks++;
+		}
+	});
+	for (int w = 0; w < writers; w++) ts[w].join();
+	done = true;
+	reader.join();
+	// what is left of the shared range is what went in and did not come out
+	long long left = 0;
+	s.scan(shared_base, (size_t)-1, [&](const skiplist::value_type &v) {
+		if (v.first < stable_base) left++;
+	});
+	if (left != shared_in.load() - shared_out.load()) fail("shared balance", 0);
+	reference all;
+	for (int w = 0; w < writers; w++)
+		for (reference::const_iterator it = own[w].cbegin(); it != own[w].cend(); ++it) all[it->first] = it->second;
+	size_t mine = 0;
+	s.for_each([&](const skiplist::value_type &v) {
+		if (v.first >= shared_base) return;
+		reference::const_iterator j = all.find(v.first);
+		if (j == all.cend() || j->second != v.second) fail("final element", 0);
+		mine++;
+	});
+	if (mine != all.size()) fail("final size", 0);
+	if (s.size() != all.size() + (size_t)left + stable_keys) fail("size after threads", 0);
+	std::cout << "together size " << all.size() << std::endl;
+}
+
+int main() {
+	alone();
+	together();
+	std::cout << "errors " << errors.load() << std::endl;
+	return 0;
+}
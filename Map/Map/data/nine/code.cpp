@@ -0,0 +1,132 @@
+// the parallel paths of map: clone, the set operations and apply_batch.
+// the grains and the depth are forced small so they fork on one core too.
+
+#define SJTU_MAP_FORK_GRAIN 32
+#define SJTU_MAP_BATCH_GRAIN 8
+#define SJTU_MAP_FORK_DEPTH 4
+
+#include <iostream>
+#include <map>
+#include <vector>
+#include "map.hpp"
+
+const int rounds = 40;
+const int max_size = 6000;
+
+unsigned long long seed = 4300;
+int rand() {
+	seed ^= seed << 13;
+	seed ^= seed >> 7;
+	seed ^= seed << 17;
+	return (int)(seed >> 33);
+}
+
+int errors = 0;
+
+void fail(const char* what, int round) {
+	if (++errors <= 10) std::cout << "mismatch " << what << " in round " << round << std::endl;
+}
+
+template<class M>
+void same(const M &m, const std::map<int, int> &r, const char* what, int round) {
+	try {
+		m.validate();
+	}
+	catch (sjtu::runtime_error &) {
+		fail(what, round);
+		return;
+	}
+	if ((size_t)m.size() != r.size()) {
+		fail(what, round);
+		return;
+	}
+	typename M::const_iterator it = m.cbegin();
+	for (std::map<int, int>::const_iterator jt = r.begin(); jt != r.end(); ++jt, ++it)
+		if (it->first != jt->first || it->second != jt->second) {
+			fail(what, round);
+			return;
+		}
+}
+
+template<class M>
+void fill(M &m, std::map<int, int> &r, int n, int lo, int span) {
+	for (int i = 0; i < n; i++) {
+		int k = lo + rand() % span, v = rand() % 1000;
+		m.insert(typename M::value_type(k, v));
+		r.insert(std::pair<const int, int>(k, v));
+	}
+}
+
+unsigned long long checksum(const std::map<int, int> &r) {
+	unsigned long long s = 0;
+	for (std::map<int, int>::const_iterator it = r.begin(); it != r.end(); ++it) s = s * 31 + (unsigned long long)(it->first * 7 + it->second);
+	return s;
+}
+
+template<class M>
+void run(const char* name) {
+	unsigned long long total = 0;
+	for (int round = 0; round < rounds; round++) {
+		M a, b;
+		std::map<int, int> ra, rb;
+		int span = 1 + rand() % (4 * max_size);
+		fill(a, ra, rand() % max_size, 0, span);
+		fill(b, rb, rand() % max_size, rand() % span - span / 2, span);
+
+		M c(a);
+		same(c, ra, "copy", round);
+		M d;
+		d = b;
+		same(d, rb, "assign", round);
+
+		// on equal keys the element of the left map stays
+		M u(a), v(b);
+		std::map<int, int> ru(ra);
+		ru.insert(rb.begin(), rb.end());
+		u.union_with(v);
+		same(u, ru, "union", round);
+		if (!v.empty()) fail("union leftover", round);
+
+		M x(a);
+		std::map<int, int> rx;
+		for (std::map<int, int>::const_iterator it = ra.begin(); it != ra.end(); ++it)
+			if (rb.count(it->first)) rx.insert(*it);
+		x.intersect_with(b);
+		same(x, rx, "intersection", round);
+
+		M y(a);
+		std::map<int, int> ry;
+		for (std::map<int, int>::const_iterator it = ra.begin(); it != ra.end(); ++it)
+			if (!rb.count(it->first)) ry.insert(*it);
+		y.difference_with(b);
+		same(y, ry, "difference", round);
+
+		std::vector<typename M::batch_op> ops;
+		int m = rand() % max_size;
+		for (int i = 0; i < m; i++) {
+			int k = rand() % span;
+			if (rand() % 3 == 0) {
+				ops.push_back(typename M::batch_op(k));
+				ra.erase(k);
+			}
+			else {
+				int v = rand() % 1000;
+				ops.push_back(typename M::batch_op(k, v));
+				ra[k] = v;
+			}
+		}
+		a.apply_batch(ops.begin(), ops.end(), true);
+		same(a, ra, "batch", round);
+		same(b, rb, "untouched", round);
+
+		total = total * 131 + checksum(ru) + checksum(rx) * 3 + checksum(ry) * 5 + checksum(ra) * 7;
+	}
+	std::cout << name << " " << total << std::endl;
+}
+
+int main() {
+	run<sjtu::map<int, int> >("avl");
+	run<sjtu::map<int, int, std::less<int>, sjtu::no_aggregate, sjtu::weight_balance> >("weight");
+	std::cout << "errors " << errors << std::endl;
+	return 0;
+}
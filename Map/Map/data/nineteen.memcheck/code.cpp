@@ -0,0 +1,165 @@
+// flat_map and its frozen eytzinger_map against sjtu::map.
+// batched inserts of an element whose copy throws: a batch that throws
+// leaves the flat_map as it was and frees what it made, one that does not
+// keeps the first occurrence of every key like map::insert.  then freeze()
+// of maps of every small size and some large ones, looked up with find,
+// lower_bound, count and at on present keys, gaps and both ends.
+
+#include <iostream>
+#include <atomic>
+#include <vector>
+#include "map.hpp"
+#include "flat_map.hpp"
+
+const int batches = 60;
+const int max_batch = 400;
+const int key_range = 20000;
+const int small_sizes = 40;
+const int large_size = 20000;
+const int lookups = 20000;
+
+unsigned long long seed = 9900;
+int rand() {
+	seed ^= seed << 13;
+	seed ^= seed >> 7;
+	seed ^= seed << 17;
+	return (int)(seed >> 33);
+}
+
+// copies left before the next one throws, negative when disarmed
+std::atomic<int> fuse(-1);
+std::atomic<long long> live(0);
+
+class value {
+public:
+	int x;
+	value(int x = 0) :x(x) { live++; }
+	value(const value &other) :x(other.x) {
+		if (fuse.load() >= 0 && fuse.fetch_sub(1) == 0) throw x;
+		live++;
+	}
+	value & operator=(const value &other) {
+		x = other.x;
+		return *this;
+	}
+	~value() { live--; }
+};
+
+typedef sjtu::flat_map<int, value> flat_type;
+typedef sjtu::map<int, int> map_type;
+
+int errors = 0;
+
+void fail(const char* what, int step) {
+	if (++errors <= 10) std::cout << "mismatch " << what << " at step " << step << std::endl;
+}
+
+bool same(const flat_type &f, const map_type &m) {
+	if (f.size() != m.size()) return false;
+	map_type::const_iterator j = m.cbegin();
+	for (flat_type::const_iterator it = f.cbegin(); it != f.cend(); ++it, ++j)
+		if (it->first != j->first || it->second.x != j->second) return false;
+	return true;
+}
+
+void batched(int &caught) {
+	flat_type f;
+	map_type m;
+	for (int step = 0; step < batches; step++) {
+		std::vector<flat_type::value_type> batch;
+		int k = rand() % max_batch;
+		for (int i = 0; i < k; i++) batch.push_back(flat_type::value_type(rand() % key_range, value(rand() % 1000)));
+		// the gathering copies the batch, the merge copies the stored elements and the batch
+		fuse = (rand() % 3 == 0) ? -1 : rand() % (k * 2 + (int)f.size() + 1);
+		bool threw = false;
+		try {
+			f.insert(batch.begin(), batch.end());
+		}
+		catch (int) {
+			threw = true;
+			caught++;
+		}
+		fuse = -1;
+		if (!threw) {
+			for (size_t i = 0; i < batch.size(); i++) m.insert(sjtu::pair<const int, int>(batch[i].first, batch[i].second.x));
+		}
+		if (!same(f, m)) fail(threw ? "thrown batch" : "batch", step);
+		if (live.load() != (long long)batch.size() + (long long)f.size()) fail("batch leak", step);
+		// single inserts and erases in between
+		for (int i = 0; i < 20; i++) {
+			int key = rand() % key_range;
+			if (rand() % 2 == 0) {
+				bool fresh = f.insert(flat_type::value_type(key, value(key))).second;
+				if (fresh != m.insert(sjtu::pair<const int, int>(key, key)).second) fail("insert", step);
+			}
+			else if (f.erase(key) != m.erase(key)) fail("erase", step);
+		}
+		if (!same(f, m)) fail("insert and erase", step);
+		for (int i = 0; i < 200; i++) {
+			int key = rand() % (key_range + 2) - 1;
+			flat_type::const_iterator a = static_cast<const flat_type &>(f).lower_bound(key);
+			map_type::const_iterator b = m.lower_bound(key);
+			if ((a == f.cend()) != (b == m.cend()) || (a != f.cend() && a->first != b->first)) fail("flat lower_bound", step);
+			if (f.count(key) != m.count(key)) fail("flat count", step);
+		}
+	}
+	f.clear();
+	if (live.load() != 0) fail("flat leak", batches);
+}
+
+/**
+ * lookups of key in the frozen e against m.
+ */
+void lookup(const sjtu::eytzinger_map<int, int> &e, const map_type &m, int key, int step) {
+	const sjtu::pair<const int, int>* p = e.lower_bound(key);
+	map_type::const_iterator b = m.lower_bound(key);
+	if ((p == NULL) != (b == m.cend()) || (p != NULL && (p->first != b->first || p->second != b->second))) fail("lower_bound", step);
+	map_type::const_iterator c = m.find(key);
+	p = e.find(key);
+	if ((p == NULL) != (c == m.cend()) || (p != NULL && p->second != c->second)) fail("find", step);
+	if (e.count(key) != m.count(key)) fail("count", step);
+	try {
+		if (e.at(key) != m.at(key)) fail("at", step);
+	}
+	catch (sjtu::index_out_of_bound &) {
+		if (m.count(key) != 0) fail("at", step);
+	}
+}
+
+void frozen() {
+	for (int size = 0; size <= small_sizes + 3; size++) {
+		bool large = size > small_sizes;
+		int n = large ? large_size / (small_sizes + 4 - size) : size;
+		map_type m;
+		// every key even, so the odd ones fall in the gaps
+		while (m.size() < (size_t)n) m[2 * (rand() % (n * 4 + 1))] = rand();
+		sjtu::eytzinger_map<int, int> e = sjtu::freeze(m);
+		if (e.size() != m.size() || e.empty() != m.empty()) fail("frozen size", size);
+		if (large) {
+			for (int i = 0; i < lookups / 4; i++) lookup(e, m, rand() % (n * 8 + 6) - 3, size);
+		}
+		else {
+			for (int key = -3; key <= n * 8 + 3; key++) lookup(e, m, key, size);
+		}
+		// a copy, an assignment and the frozen flat_map answer the same
+		sjtu::eytzinger_map<int, int> c(e);
+		e = sjtu::freeze(map_type());
+		e = c;
+		sjtu::flat_map<int, int> f(m.cbegin(), m.cend());
+		sjtu::eytzinger_map<int, int> g = f.freeze();
+		for (int i = 0; i < 300; i++) {
+			int key = rand() % (n * 8 + 6) - 3;
+			lookup(e, m, key, size);
+			lookup(g, m, key, size);
+		}
+	}
+}
+
+int main() {
+	int caught = 0;
+	batched(caught);
+	frozen();
+	std::cout << "caught " << caught << std::endl;
+	std::cout << "errors " << errors << std::endl;
+	return 0;
+}
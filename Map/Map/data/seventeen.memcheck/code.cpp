@@ -0,0 +1,205 @@
+// snapshot files of sjtu::map: save then load gives back the same map (empty
+// ones included, into a map that held something else), a second save
+// replaces the file and leaves no temporary behind.  a file with a changed
+// payload byte, version, layout or size, or one loaded as other types, is
+// refused with the map untouched; a wrong element count is caught too.
+
+#include <iostream>
+#include <cstdio>
+#include <cstddef>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+#include "map.hpp"
+#include "snapshot.hpp"
+
+const int rounds = 4;
+const int max_entries = 3000;
+const int key_range = 1000000;
+
+unsigned long long seed = 7700;
+int rand() {
+	seed ^= seed << 13;
+	seed ^= seed >> 7;
+	seed ^= seed << 17;
+	return (int)(seed >> 33);
+}
+
+typedef sjtu::map<int, double> map_type;
+
+const std::string path = "seventeen.snap";
+const std::string bad = "seventeen.bad";
+
+int errors = 0;
+
+void fail(const char* what, int round) {
+	if (++errors <= 10) std::cout << "mismatch " << what << " at round " << round << std::endl;
+}
+
+bool same(const map_type &m, const std::map<int, double> &r) {
+	try {
+		m.validate();
+	}
+	catch (sjtu::runtime_error &) {
+		return false;
+	}
+	if (m.size() != r.size()) return false;
+	std::map<int, double>::const_iterator j = r.begin();
+	for (map_type::const_iterator it = m.cbegin(); it != m.cend(); ++it, ++j)
+		if (it->first != j->first || it->second != j->second) return false;
+	return true;
+}
+
+std::vector<char> slurp(const std::string &p) {
+	std::vector<char> v;
+	FILE* f = std::fopen(p.c_str(), "rb");
+	if (f == NULL) return v;
+	char buf[4096];
+	size_t n;
+	while ((n = std::fread(buf, 1, sizeof(buf), f)) > 0) v.insert(v.end(), buf, buf + n);
+	std::fclose(f);
+	return v;
+}
+
+void spill(const std::string &p, const std::vector<char> &v) {
+	FILE* f = std::fopen(p.c_str(), "wb");
+	if (!v.empty()) std::fwrite(&v[0], 1, v.size(), f);
+	std::fclose(f);
+}
+
+/**
+ * load bad into a map holding r, which must throw with reason in the message
+ *   and leave the map as it was.
+ */
+void refused(const std::map<int, double> &r, const char* reason, const char* what, int round) {
+	map_type m;
+	for (std::map<int, double>::const_iterator it = r.begin(); it != r.end(); ++it) m[it->first] = it->second;
+	try {
+		sjtu::load(m, bad);
+		fail(what, round);
+	}
+	catch (sjtu::runtime_error &e) {
+		if (e.what().find(reason) == std::string::npos) fail(what, round);
+	}
+	if (!same(m, r)) fail(what, round);
+}
+
+int main() {
+	int caught = 0;
+	for (int round = 0; round < rounds; round++) {
+		int n = (round == 0) ? 0 : (round == 1) ? 1 : rand() % max_entries;
+		map_type m;
+		std::map<int, double> r;
+		for (int i = 0; i < n; i++) {
+			int k = rand() % key_range;
+			double v = rand() / 7.0;
+			m[k] = v;
+			r[k] = v;
+		}
+		sjtu::save(m, path);
+		std::FILE* tmp = std::fopen((path + ".tmp").c_str(), "rb");
+		if (tmp != NULL) {
+			std::fclose(tmp);
+			fail("temporary left", round);
+		}
+		map_type l;
+		for (int i = 0; i < 50; i++) l[rand() % key_range] = -1;
+		sjtu::load(l, path);
+		if (!same(l, r)) fail("round trip", round);
+		l.insert(sjtu::pair<const int, double>(key_range, 0.5));
+		// the file is replaced by the next save
+		sjtu::save(l, path);
+		map_type l2;
+		sjtu::load(l2, path);
+		r[key_range] = 0.5;
+		if (!same(l2, r)) fail("second save", round);
+		r.erase(key_range);
+		sjtu::save(m, path);
+
+		std::vector<char> file = slurp(path);
+		size_t header = sizeof(sjtu::snapshot_header);
+		if (file.size() != header + r.size() * (sizeof(int) + sizeof(double))) {
+			fail("file size", round);
+			continue;
+		}
+		std::map<int, double> other;
+		other[round] = round;
+		std::vector<char> v;
+		// a flipped payload byte
+		if (!r.empty()) {
+			v = file;
+			v[header + rand() % (v.size() - header)] ^= (char)(1 << (rand() % 8));
+			spill(bad, v);
+			refused(other, "checksum mismatch", "bad checksum", round);
+		}
+		// another version
+		v = file;
+		v[offsetof(sjtu::snapshot_header, version)] += 1;
+		spill(bad, v);
+		refused(other, "unsupported version", "bad version", round);
+		// another layout in the header
+		v = file;
+		v[offsetof(sjtu::snapshot_header, layout) + rand() % 8] ^= 1;
+		spill(bad, v);
+		refused(other, "layout mismatch", "bad layout", round);
+		// a map of other types reading a good file
+		{
+			sjtu::map<int, long long> w;
+			w[1] = 2;
+			try {
+				sjtu::load(w, path);
+				fail("other types", round);
+			}
+			catch (sjtu::runtime_error &e) {
+				if (e.what().find("layout mismatch") == std::string::npos) fail("other types", round);
+			}
+			if (w.size() != 1 || w.cbegin()->second != 2) fail("other types", round);
+		}
+		// not a snapshot at all
+		v = file;
+		v[0] = 'X';
+		spill(bad, v);
+		refused(other, "not a snapshot", "bad magic", round);
+		// cut short, one element or inside the header
+		v = file;
+		v.resize(n > 0 ? v.size() - 4 : header / 2);
+		spill(bad, v);
+		refused(other, n > 0 ? "size mismatch" : "not a snapshot", "truncated", round);
+		// fewer elements than the payload holds: the checksum covers only the payload
+		if (!r.empty()) {
+			v = file;
+			unsigned long long count = r.size() - 1;
+			memcpy(&v[offsetof(sjtu::snapshot_header, count)], &count, sizeof(count));
+			spill(bad, v);
+			map_type t;
+			t[1] = 1;
+			try {
+				sjtu::load(t, bad);
+				fail("wrong count", round);
+			}
+			catch (sjtu::runtime_error &e) {
+				if (e.what().find("trailing bytes") == std::string::npos) fail("wrong count", round);
+				caught++;
+			}
+			if (t.size() != 0) fail("wrong count", round);
+		}
+		// the good file is still good
+		map_type g;
+		sjtu::load(g, path);
+		if (!same(g, r)) fail("reload", round);
+	}
+	map_type m;
+	try {
+		sjtu::load(m, "seventeen.missing");
+		fail("missing file", 0);
+	}
+	catch (sjtu::runtime_error &e) {
+		caught++;
+	}
+	std::remove(path.c_str());
+	std::remove(bad.c_str());
+	std::cout << "caught " << caught << std::endl;
+	std::cout << "errors " << errors << std::endl;
+	return 0;
+}
@@ -0,0 +1,185 @@
+// concurrent_map with a shard limit small enough that shards keep
+// splitting: alone against std::map (insert, assign, update, erase, find,
+// at, count, scan, for_each, size) with ascending, descending and random
+// keys, where the shard count may never shrink and must cover the size;
+// then writers on their own keys split shards under a reader that walks
+// the map, and the final contents must be what the writers left.
+
+#include <iostream>
+#include <thread>
+#include <atomic>
+#include <map>
+#include <vector>
+#include "concurrent_map.hpp"
+
+const int steps = 100000;
+const int key_range = 8000;
+const int limit = 16;
+const int writers = 4;
+const int thread_steps = 60000;
+const int stable_keys = 300;
+
+unsigned long long seed = 6800;
+int rand() {
+	seed ^= seed << 13;
+	seed ^= seed >> 7;
+	seed ^= seed << 17;
+	return (int)(seed >> 33);
+}
+
+typedef sjtu::concurrent_map<int, long long> cmap;
+typedef std::map<int, long long> reference;
+
+std::atomic<int> errors(0);
+
+void fail(const char* what, int step) {
+	if (++errors <= 10) std::cout << "mismatch " << what << " at step " << step << std::endl;
+}
+
+void compare(const cmap &m, const reference &r, int step) {
+	if (m.size() != r.size()) fail("size", step);
+	reference::const_iterator j = r.begin();
+	bool ok = true;
+	m.for_each([&](const cmap::value_type &v) {
+		if (j == r.end() || v.first != j->first || v.second != j->second) ok = false;
+		else ++j;
+	});
+	if (!ok || j != r.end()) fail("for_each", step);
+	if (m.shard_count() < (r.size() + limit - 1) / limit) fail("too few shards", step);
+}
+
+void in_order(bool up) {
+	cmap m(limit);
+	reference r;
+	size_t shards = 1;
+	for (int i = 0; i < key_range; i++) {
+		int k = up ? i : key_range - i;
+		if (!m.insert(cmap::value_type(k, k))) fail("ordered insert", i);
+		r[k] = k;
+		size_t now = m.shard_count();
+		if (now < shards) fail("shards shrank", i);
+		shards = now;
+	}
+	compare(m, r, 0);
+	std::cout << (up ? "ascending" : "descending") << " shards " << (m.shard_count() >= (size_t)key_range / limit) << std::endl;
+}
+
+void alone() {
+	cmap m(limit);
+	reference r;
+	size_t shards = 1;
+	for (int step = 0; step < steps; step++) {
+		int op = rand() % 100, k = rand() % key_range;
+		if (op < 35) {
+			bool fresh = r.find(k) == r.end();
+			if (m.insert(cmap::value_type(k, step)) != fresh) fail("insert", step);
+			if (fresh) r[k] = step;
+		}
+		else if (op < 50) {
+			m.assign(k, step);
+			r[k] = step;
+		}
+		else if (op < 60) {
+			bool there = r.find(k) != r.end();
+			if (m.update(k, [&](long long &v) { v += 7; }) != there) fail("update", step);
+			if (there) r[k] += 7;
+		}
+		else if (op < 80) {
+			if (m.erase(k) != r.erase(k)) fail("erase", step);
+		}
+		else if (op < 92) {
+			long long v = -1;
+			bool there = m.find(k, v);
+			reference::const_iterator j = r.find(k);
+			if (there != (j != r.end()) || (there && v != j->second)) fail("find", step);
+			if (m.count(k) != r.count(k)) fail("count", step);
+			try {
+				if (m.at(k) != j->second) fail("at", step);
+			}
+			catch (sjtu::index_out_of_bound &) {
+				if (j != r.end()) fail("at", step);
+			}
+		}
+		else {
+			size_t n = (size_t)(rand() % 200);
+			reference::const_iterator j = r.lower_bound(k);
+			size_t seen = 0;
+			bool ok = true;
+			m.scan(k, n, [&](const cmap::value_type &v) {
+				if (j == r.end() || v.first != j->first || v.second != j->second) ok = false;
+				else ++j;
+				seen++;
+			});
+			size_t want = 0;
+			for (reference::const_iterator i = r.lower_bound(k); i != r.end() && want < n; ++i) want++;
+			if (!ok || seen != want) fail("scan", step);
+		}
+		size_t now = m.shard_count();
+		if (now < shards) fail("shards shrank", step);
+		shards = now;
+		if (step % 10000 == 0) compare(m, r, step);
+	}
+	compare(m, r, steps);
+	std::cout << "alone size " << m.size() << std::endl;
+}
+
+const int stable_base = 1 << 28;
+
+void together() {
+	cmap m(limit);
+	for (int i = 0; i < stable_keys; i++) m.insert(cmap::value_type(stable_base + i, 3LL * (stable_base + i)));
+	std::atomic<bool> done(false);
+	std::vector<reference> own(writers);
+	std::vector<std::thread> ts;
+	for (int w = 0; w < writers; w++)
+		ts.push_back(std::thread([&, w]() {
+			unsigned long long x = 6900 + w;
+			reference &r = own[w];
+			for (int step = 0; step < thread_steps; step++) {
+				x ^= x << 13;
+				x ^= x >> 7;
+				x ^= x << 17;
+				int k = w + writers * (int)((x >> 20) % key_range);
+				if ((x & 3) != 0) {
+					m.assign(k, 3LL * k);
+					r[k] = 3LL * k;
+				}
+				else {
+					if (m.erase(k) != r.erase(k)) fail("thread erase", step);
+				}
+			}
+		}));
+	long long walks = 0;
+	std::thread reader([&]() {
+		while (!done.load()) {
+			long long last = -1;
+			int stable = 0;
+			bool ok = true;
+			m.for_each([&](const cmap::value_type &v) {
+				if (v.first <= last || v.second != 3LL * v.first) ok = false;
+				last = v.first;
+				if (v.first >= stable_base) stable++;
+			});
+			if (!ok) fail("reader order", (int)walks);
+			if (stable != stable_keys) fail("reader stable keys", (int)walks);
+			walks++;
+		}
+	});
+	for (int w = 0; w < writers; w++) ts[w].join();
+	done = true;
+	reader.join();
+	reference all;
+	for (int w = 0; w < writers; w++) all.insert(own[w].begin(), own[w].end());
+	for (int i = 0; i < stable_keys; i++) all[stable_base + i] = 3LL * (stable_base + i);
+	compare(m, all, 0);
+	std::cout << "together size " << m.size() << std::endl;
+}
+
+int main() {
+	in_order(true);
+	in_order(false);
+	alone();
+	together();
+	std::cout << "errors " << errors.load() << std::endl;
+	return 0;
+}
@@ -0,0 +1,193 @@
+// map and multiset with weight_balance against std::map and std::multiset,
+// validate() runs after every change of the tree (SJTU_MAP_DEBUG).
+
+#define SJTU_MAP_DEBUG
+
+#include <iostream>
+#include <cmath>
+#include <map>
+#include <set>
+#include <vector>
+#include "map.hpp"
+#include "set.hpp"
+
+const int steps = 6000;
+const int key_range = 3000;
+
+unsigned long long seed = 4800;
+int rand() {
+	seed ^= seed << 13;
+	seed ^= seed >> 7;
+	seed ^= seed << 17;
+	return (int)(seed >> 33);
+}
+
+typedef sjtu::map<int, int, std::less<int>, sjtu::no_aggregate, sjtu::weight_balance> wmap;
+typedef sjtu::multiset<int, std::less<int>, sjtu::no_aggregate, sjtu::weight_balance> wmultiset;
+
+int errors = 0;
+
+void fail(const char* what, int step) {
+	if (++errors <= 10) std::cout << "mismatch " << what << " at step " << step << std::endl;
+}
+
+/**
+ * the same elements, a valid tree, and no higher than BB[alpha] allows:
+ *   a sibling weighs at most 3 times the other, so the heavier child of a
+ *   subtree of weight w weighs at most 3w/4 and the height is at most
+ *   log_{4/3} of the weight.
+ */
+void check(const wmap &m, const std::map<int, int> &r, int step) {
+	try {
+		m.validate();
+	}
+	catch (sjtu::runtime_error &) {
+		fail("validate", step);
+	}
+	if ((size_t)m.size() != r.size()) {
+		fail("size", step);
+		return;
+	}
+	wmap::const_iterator j = m.cbegin();
+	for (std::map<int, int>::const_iterator i = r.begin(); i != r.end(); ++i, ++j)
+		if (j->first != i->first || j->second != i->second) {
+			fail("element", step);
+			return;
+		}
+	if (m.stats().height > std::log((double)m.size() + 1) / std::log(4.0 / 3.0)) fail("height", step);
+}
+
+void random_ops() {
+	wmap m;
+	std::map<int, int> r;
+	for (int step = 0; step < steps; step++) {
+		int op = rand() % 12, k = rand() % key_range;
+		if (op < 4) {
+			m.insert(wmap::value_type(k, step));
+			r.insert(std::pair<const int, int>(k, step));
+		}
+		else if (op < 6) {
+			if ((size_t)m.erase(k) != r.erase(k)) fail("erase", step);
+		}
+		else if (op == 6) {
+			m.insert(m.lower_bound(k), wmap::value_type(k, step));
+			r.insert(std::pair<const int, int>(k, step));
+		}
+		else if (op == 7) {
+			int k2 = k + rand() % 200;
+			m.erase(m.lower_bound(k), m.lower_bound(k2));
+			r.erase(r.lower_bound(k), r.lower_bound(k2));
+		}
+		else if (op == 8) {
+			wmap o;
+			std::map<int, int> ro;
+			int n = rand() % ((rand() % 2) ? 5 : 2000);
+			for (int i = 0; i < n; i++) {
+				int x = rand() % (2 * key_range);
+				o.insert(wmap::value_type(x, -x));
+				ro.insert(std::pair<const int, int>(x, -x));
+			}
+			int w = rand() % 3;
+			if (w == 0) {
+				m.union_with(o);
+				r.insert(ro.begin(), ro.end());
+			}
+			else if (w == 1) {
+				m.intersect_with(o);
+				std::map<int, int> t;
+				for (std::map<int, int>::const_iterator i = r.begin(); i != r.end(); ++i)
+					if (ro.count(i->first)) t.insert(*i);
+				r = t;
+			}
+			else {
+				m.difference_with(o);
+				for (std::map<int, int>::const_iterator i = ro.begin(); i != ro.end(); ++i) r.erase(i->first);
+			}
+		}
+		else if (op == 9) {
+			wmap o;
+			m.split_at(k, o);
+			size_t above = 0;
+			for (std::map<int, int>::const_iterator i = r.lower_bound(k); i != r.end(); ++i) above++;
+			if ((size_t)o.size() != above) fail("split_at", step);
+			m.union_with(o);
+		}
+		else if (op == 10) {
+			std::vector<wmap::batch_op> v;
+			int n = rand() % 300;
+			for (int i = 0; i < n; i++) {
+				int x = rand() % key_range;
+				if (rand() % 3) {
+					v.push_back(wmap::batch_op(x, i));
+					r[x] = i;
+				}
+				else {
+					v.push_back(wmap::batch_op(x));
+					r.erase(x);
+				}
+			}
+			m.apply_batch(v.begin(), v.end());
+		}
+		else {
+			m[k] = step;
+			r[k] = step;
+		}
+		if (step % 100 == 0) check(m, r, step);
+	}
+	check(m, r, steps);
+	wmap c(m);
+	check(c, r, steps);
+	std::cout << "random " << m.size() << " height " << m.stats().height << std::endl;
+}
+
+/**
+ * growth at the ends, the worst case for a rebalancing scheme.
+ */
+void sequential() {
+	wmap m;
+	std::map<int, int> r;
+	for (int i = 0; i < 2 * key_range; i++) {
+		m.insert(m.end(), wmap::value_type(i, i));
+		r.insert(std::pair<const int, int>(i, i));
+	}
+	for (int i = -1; i > -key_range; i--) {
+		m.insert(m.cbegin() == m.cend() ? m.end() : m.begin(), wmap::value_type(i, i));
+		r.insert(std::pair<const int, int>(i, i));
+	}
+	check(m, r, 0);
+	for (int i = 0; i < 2 * key_range; i += 2) {
+		m.erase(i);
+		r.erase(i);
+	}
+	check(m, r, 1);
+	std::cout << "sequential " << m.size() << " height " << m.stats().height << std::endl;
+}
+
+void multi() {
+	wmultiset m;
+	std::multiset<int> r;
+	for (int step = 0; step < 4 * steps; step++) {
+		int x = rand() % 100;
+		if (rand() % 3) {
+			m.insert(x);
+			r.insert(x);
+		}
+		else if ((size_t)m.erase(x) != r.erase(x)) fail("multiset erase", step);
+	}
+	try {
+		m.validate();
+	}
+	catch (sjtu::runtime_error &) {
+		fail("multiset validate", 0);
+	}
+	if ((size_t)m.size() != r.size()) fail("multiset size", 0);
+	std::cout << "multiset " << m.size() << std::endl;
+}
+
+int main() {
+	random_ops();
+	sequential();
+	multi();
+	std::cout << "errors " << errors << std::endl;
+	return 0;
+}
@@ -0,0 +1,152 @@
+// compact_map against std::map: insert, operator[], at, erase by key and
+// by iterator, walks both ways, copies, clear and reserve.  validate()
+// rechecks the tree and the free list as it changes, and an iterator
+// taken early must still reach its element after the arena grew.
+
+#include <iostream>
+#include <map>
+#include "compact_map.hpp"
+
+const int steps = 30000;
+const int key_range = 3000;
+const int check_every = 1000;
+
+unsigned long long seed = 5600;
+int rand() {
+	seed ^= seed << 13;
+	seed ^= seed >> 7;
+	seed ^= seed << 17;
+	return (int)(seed >> 33);
+}
+
+typedef sjtu::compact_map<int, long long> cmap;
+typedef std::map<int, long long> reference;
+
+int errors = 0;
+
+void fail(const char* what, int step) {
+	if (++errors <= 10) std::cout << "mismatch " << what << " at step " << step << std::endl;
+}
+
+void check(const cmap &m, const reference &r, int step) {
+	try {
+		m.validate();
+	}
+	catch (sjtu::runtime_error &) {
+		fail("validate", step);
+		return;
+	}
+	if (m.size() != r.size()) {
+		fail("size", step);
+		return;
+	}
+	reference::const_iterator j = r.begin();
+	for (cmap::const_iterator it = m.cbegin(); it != m.cend(); ++it, ++j)
+		if (j == r.end() || it->first != j->first || it->second != j->second) {
+			fail("forward walk", step);
+			return;
+		}
+	if (r.empty()) return;
+	reference::const_reverse_iterator k = r.rbegin();
+	cmap::const_iterator it = m.cend();
+	do {
+		--it;
+		if (it->first != k->first) {
+			fail("backward walk", step);
+			return;
+		}
+		++k;
+	} while (k != r.rend());
+	try {
+		--it;
+		fail("-- before begin", step);
+	}
+	catch (sjtu::invalid_iterator &) {
+	}
+}
+
+int main() {
+	cmap m;
+	reference r;
+	m.insert(cmap::value_type(-1, -1));
+	r[-1] = -1;
+	cmap::iterator early = m.find(-1);
+	for (int step = 0; step < steps; step++) {
+		int op = rand() % 100, k = rand() % key_range;
+		if (op < 35) {
+			sjtu::pair<cmap::iterator, bool> p = m.insert(cmap::value_type(k, step));
+			bool fresh = r.find(k) == r.end();
+			if (p.second != fresh || p.first->first != k) fail("insert", step);
+			if (fresh) r[k] = step;
+		}
+		else if (op < 50) {
+			m[k] += step;
+			r[k] += step;
+		}
+		else if (op < 80) {
+			if (m.erase(k) != r.erase(k)) fail("erase", step);
+		}
+		else if (op < 88) {
+			cmap::iterator it = m.find(k);
+			if ((it == m.end()) != (r.find(k) == r.end())) fail("find", step);
+			else if (it != m.end()) {
+				// the neighbours of the erased element must stay where they are
+				cmap::iterator nx = it;
+				++nx;
+				int nk = (nx == m.end()) ? -2 : nx->first;
+				m.erase(it);
+				r.erase(k);
+				if (nk != -2 && (nx->first != nk || m.find(nk) != nx)) fail("iterator after erase", step);
+			}
+		}
+		else if (op < 95) {
+			try {
+				long long v = m.at(k);
+				if (r.find(k) == r.end() || r[k] != v) fail("at", step);
+			}
+			catch (sjtu::index_out_of_bound &) {
+				if (r.find(k) != r.end()) fail("at", step);
+			}
+			if (m.count(k) != r.count(k)) fail("count", step);
+		}
+		else if (op < 97) {
+			if (step % 32 == 0) {
+				cmap c(m);
+				check(c, r, step);
+				cmap d;
+				d[7] = 7;
+				d = c;
+				check(d, r, step);
+			}
+		}
+		else if (op < 98) {
+			m.reserve((size_t)(rand() % (2 * key_range)));
+		}
+		else if (rand() % 1000 == 0) {
+			m.clear();
+			r.clear();
+			m.insert(cmap::value_type(-1, -1));
+			r[-1] = -1;
+			early = m.find(-1);
+		}
+		if (early->first != -1 || early->second != -1) fail("early iterator", step);
+		if (step % check_every == 0) check(m, r, step);
+	}
+	check(m, r, steps);
+	const cmap &cm = m;
+	try {
+		cm[key_range];
+		fail("const operator[]", steps);
+	}
+	catch (sjtu::index_out_of_bound &) {
+	}
+	try {
+		m.erase(m.end());
+		fail("erase end()", steps);
+	}
+	catch (sjtu::invalid_iterator &) {
+	}
+	std::cout << "size " << m.size() << std::endl;
+	std::cout << "errors " << errors << std::endl;
+	return 0;
+}
@@ -0,0 +1,147 @@
+// unordered_map against sjtu::map: inserts, erases (each one a backward
+// shift), erases while iterating, rehash, reserve, copies and clear, with
+// a hash that puts four keys on every home so the clusters run long.
+// the key copy throws now and then: a throwing insert leaves the map as
+// it was and nothing leaks.
+
+#include <iostream>
+#include "map.hpp"
+#include "unordered_map.hpp"
+
+const int steps = 200000;
+const int key_range = 6000;
+const int check_every = 2000;
+
+unsigned long long seed = 5200;
+int rand() {
+	seed ^= seed << 13;
+	seed ^= seed >> 7;
+	seed ^= seed << 17;
+	return (int)(seed >> 33);
+}
+
+// key copies left before the next one throws, negative when disarmed
+int fuse = -1;
+long long live = 0;
+
+class key {
+public:
+	int v;
+	key(int v) :v(v) { live++; }
+	key(const key &other) :v(other.v) {
+		if (fuse >= 0 && fuse-- == 0) throw v;
+		live++;
+	}
+	~key() { live--; }
+	bool operator==(const key &rhs) const { return v == rhs.v; }
+};
+
+class clumpy {
+public:
+	size_t operator()(const key &k) const { return (size_t)(k.v / 4); }
+};
+
+typedef sjtu::unordered_map<key, int, clumpy> table;
+typedef sjtu::map<int, int> reference;
+
+int errors = 0;
+
+void fail(const char* what, int step) {
+	if (++errors <= 10) std::cout << "mismatch " << what << " at step " << step << std::endl;
+}
+
+void check(const table &t, const reference &r, int step) {
+	if (t.size() != r.size()) {
+		fail("size", step);
+		return;
+	}
+	size_t seen = 0;
+	for (table::const_iterator it = t.cbegin(); it != t.cend(); ++it, ++seen) {
+		reference::const_iterator j = r.find(it->first.v);
+		if (j == r.cend() || j->second != it->second) {
+			fail("element", step);
+			return;
+		}
+	}
+	if (seen != r.size()) fail("iteration", step);
+	for (reference::const_iterator j = r.cbegin(); j != r.cend(); ++j) {
+		table::const_iterator it = t.find(key(j->first));
+		if (it == t.cend() || it->second != j->second) {
+			fail("find", step);
+			return;
+		}
+	}
+}
+
+int main() {
+	table t;
+	reference r;
+	int caught = 0;
+	for (int step = 0; step < steps; step++) {
+		int op = rand() % 100, k = rand() % key_range;
+		if (op < 40) {
+			if (rand() % 8 == 0) fuse = rand() % 40;
+			try {
+				sjtu::pair<table::iterator, bool> p = t.insert(table::value_type(key(k), step));
+				fuse = -1;
+				if (p.second != (r.find(k) == r.end()) || p.first->first.v != k) fail("insert", step);
+				if (p.second) r[k] = step;
+			}
+			catch (int) {
+				fuse = -1;
+				caught++;
+			}
+		}
+		else if (op < 55) {
+			t[key(k)] = step;
+			r[k] = step;
+		}
+		else if (op < 90) {
+			if (t.erase(key(k)) != r.erase(k)) fail("erase", step);
+		}
+		else if (op < 93) {
+			table::iterator it = t.find(key(k));
+			if ((it == t.end()) != (r.find(k) == r.end())) fail("find", step);
+			else if (it != t.end()) {
+				t.erase(it);
+				r.erase(k);
+			}
+		}
+		else if (op < 94) {
+			// drop every key in a residue class while walking the table
+			int m = rand() % 5 + 2, c = rand() % m;
+			for (table::iterator it = t.begin(); it != t.end(); ) {
+				if (it->first.v % m == c) it = t.erase(it);
+				else ++it;
+			}
+			for (int i = c; i < key_range; i += m) r.erase(i);
+		}
+		else if (op < 96) {
+			t.rehash(rand() % 2 == 0 ? 0 : (size_t)(rand() % (4 * key_range)));
+		}
+		else if (op < 97) {
+			t.reserve((size_t)(rand() % (2 * key_range)));
+		}
+		else if (op < 99) {
+			table c(t);
+			check(c, r, step);
+			table d;
+			d[key(-1)] = 0;
+			d = c;
+			check(d, r, step);
+		}
+		else if (rand() % 20 == 0) {
+			t.clear();
+			r.clear();
+		}
+		if (step % check_every == 0) check(t, r, step);
+	}
+	check(t, r, steps);
+	long long held = (long long)t.size();
+	if (live != held) fail("leak", steps);
+	t.clear();
+	if (live != 0) fail("leak", steps);
+	std::cout << "caught " << caught << std::endl;
+	std::cout << "errors " << errors << std::endl;
+	return 0;
+}
@@ -0,0 +1,209 @@
+// lru_cache against a model kept in a std::list (recency, newest first)
+// and a std::map: random puts, gets, finds, contains, erases and capacity
+// changes must evict the same entries in the same order through the
+// callback (and never on erase or overwrite), with entry and byte weights.
+// then concurrent_lru_cache with a capacity below its shard count, which
+// must still keep what it is given, alone and from several threads.
+
+#include <iostream>
+#include <thread>
+#include <atomic>
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+#include "lru_cache.hpp"
+
+const int steps = 15000;
+const int key_range = 600;
+const int max_capacity = 400;
+const int threads = 4;
+const int thread_steps = 4000;
+
+unsigned long long seed = 1100;
+int rand() {
+	seed ^= seed << 13;
+	seed ^= seed >> 7;
+	seed ^= seed << 17;
+	return (int)(seed >> 33);
+}
+
+/**
+ * a value owning len bytes it does not hold, weighed by its own weight()
+ *   overload through byte_weight.
+ */
+class blob {
+public:
+	int id, len;
+	blob(int id = 0, int len = 0) :id(id), len(len) {}
+};
+
+size_t weight(const blob &b) {
+	return sizeof(blob) + (size_t)b.len;
+}
+
+std::atomic<int> errors(0);
+
+void fail(const char* what, int step) {
+	if (++errors <= 10) std::cout << "mismatch " << what << " at step " << step << std::endl;
+}
+
+class model {
+public:
+	std::list<int> order;
+	std::map<int, std::pair<blob, size_t> > m;
+	size_t cap, total;
+	std::vector<std::pair<int, int> > evicted;
+	model(size_t cap) :cap(cap), total(0) {}
+	void touch(int k) {
+		order.remove(k);
+		order.push_front(k);
+	}
+	void shrink() {
+		while (total > cap && !order.empty()) {
+			int k = order.back();
+			order.pop_back();
+			evicted.push_back(std::make_pair(k, m[k].first.id));
+			total -= m[k].second;
+			m.erase(k);
+		}
+	}
+	void put(int k, const blob &b, size_t w) {
+		if (m.count(k) != 0) total -= m[k].second;
+		m[k] = std::make_pair(b, w);
+		total += w;
+		touch(k);
+		shrink();
+	}
+	bool erase(int k) {
+		if (m.count(k) == 0) return false;
+		total -= m[k].second;
+		m.erase(k);
+		order.remove(k);
+		return true;
+	}
+};
+
+template<class Weigh>
+void differential(bool bytes, int &evictions) {
+	size_t cap = bytes ? (size_t)max_capacity * 40 : (size_t)max_capacity / 2;
+	sjtu::lru_cache<int, blob, std::less<int>, Weigh> c(cap);
+	model r(cap);
+	std::vector<std::pair<int, int> > seen;
+	c.on_evict([&seen](const int &k, blob &b) { seen.push_back(std::make_pair(k, b.id)); });
+	for (int step = 0; step < steps; step++) {
+		int op = rand() % 20;
+		int k = rand() % key_range;
+		if (op < 8) {
+			blob b(rand(), rand() % 100);
+			size_t w = bytes ? sizeof(int) + weight(b) : 1;
+			c.put(k, b);
+			r.put(k, b, w);
+		}
+		else if (op < 12) {
+			blob out;
+			bool hit = c.get(k, out);
+			if (hit != (r.m.count(k) != 0) || (hit && out.id != r.m[k].first.id)) fail("get", step);
+			if (hit) r.touch(k);
+		}
+		else if (op < 14) {
+			blob* p = c.find(k);
+			if ((p != NULL) != (r.m.count(k) != 0) || (p != NULL && p->id != r.m[k].first.id)) fail("find", step);
+			if (p != NULL) {
+				// written through the pointer
+				p->id = rand();
+				r.m[k].first.id = p->id;
+				r.touch(k);
+			}
+		}
+		else if (op < 16) {
+			if (c.contains(k) != (r.m.count(k) != 0)) fail("contains", step);
+		}
+		else if (op < 19) {
+			if (c.erase(k) != r.erase(k)) fail("erase", step);
+		}
+		else if (rand() % 50 == 0) {
+			size_t to = bytes ? (size_t)(rand() % (max_capacity * 60)) : (size_t)(rand() % max_capacity);
+			if (rand() % 40 == 0) to = 0;
+			c.set_capacity(to);
+			r.cap = to;
+			r.shrink();
+			if (c.capacity() != to) fail("capacity", step);
+		}
+		if (seen != r.evicted) {
+			fail("evictions", step);
+			seen = r.evicted;
+		}
+		if (c.size() != r.m.size() || c.weight() != r.total || c.weight() > c.capacity()) fail("size", step);
+		if (step % 1000 == 0) {
+			// the whole recency order, which for_each must not change
+			std::vector<int> keys;
+			c.for_each([&keys](const int &k, const blob &) { keys.push_back(k); });
+			if (keys != std::vector<int>(r.order.begin(), r.order.end())) fail("order", step);
+		}
+	}
+	evictions += (int)seen.size();
+	c.clear();
+	if (c.size() != 0 || c.weight() != 0) fail("clear", steps);
+}
+
+void strings() {
+	// std::string is weighed with its capacity, an overwrite reweighs
+	sjtu::lru_cache<int, std::string, std::less<int>, sjtu::byte_weight> c(1 << 20);
+	size_t want = 0;
+	for (int i = 0; i < 100; i++) c.put(i, std::string((size_t)(rand() % 200), 'x'));
+	c.put(7, std::string(1000, 'y'));
+	c.for_each([&want](const int &k, const std::string &v) { want += sizeof(k) + sizeof(v) + v.capacity(); });
+	if (c.weight() != want) fail("string weight", 0);
+	// shrinking to one long string evicts the others
+	c.set_capacity(sizeof(int) + sizeof(std::string) + 1000);
+	std::string out;
+	if (c.size() != 1 || !c.get(7, out) || out.size() != 1000) fail("string capacity", 0);
+}
+
+void sharded() {
+	// fewer units of capacity than shards: every key put is found right after
+	for (size_t cap = 0; cap <= 20; cap++) {
+		sjtu::concurrent_lru_cache<int, int> c(cap, 16);
+		if (c.shard_count() > (cap == 0 ? 1 : cap) || c.shard_count() == 0) fail("shard count", (int)cap);
+		for (int i = 0; i < 200; i++) {
+			int k = rand() % key_range, v = 0;
+			c.put(k, k * 3);
+			if (cap > 0 && (!c.get(k, v) || v != k * 3)) fail("sharded put", (int)cap);
+			if (c.size() > cap) fail("sharded size", (int)cap);
+		}
+	}
+	sjtu::concurrent_lru_cache<int, int> c(8, 16);
+	std::atomic<int> dropped(0);
+	c.on_evict([&dropped](const int &, int &) { dropped++; });
+	std::vector<std::thread> ts;
+	for (int t = 0; t < threads; t++)
+		ts.push_back(std::thread([&c, t]() {
+			unsigned long long x = 77 + (unsigned long long)t * 1000003;
+			for (int i = 0; i < thread_steps; i++) {
+				x ^= x << 13;
+				x ^= x >> 7;
+				x ^= x << 17;
+				int k = (int)(x % 64), v = 0;
+				if (i % 3 == 0) c.erase(k);
+				else if (c.get(k, v)) {
+					if (v != k * 5) fail("threaded get", i);
+				}
+				else c.put(k, k * 5);
+			}
+		}));
+	for (int t = 0; t < threads; t++) ts[t].join();
+	if (c.size() > 8 || c.weight() != c.size()) fail("threaded size", 0);
+	if (dropped.load() == 0) fail("threaded evictions", 0);
+}
+
+int main() {
+	int evictions = 0;
+	differential<sjtu::entry_weight>(false, evictions);
+	differential<sjtu::byte_weight>(true, evictions);
+	strings();
+	sharded();
+	std::cout << "evictions " << evictions << std::endl;
+	std::cout << "errors " << errors << std::endl;
+	return 0;
+}
@@ -0,0 +1,184 @@
+/**
+ * epoch based reclamation for the lock-free containers, see concurrent_skiplist_map
+ */
+#ifndef SJTU_EPOCH_HPP
+#define SJTU_EPOCH_HPP
+
+#include <cstddef>
+#include <atomic>
+
+namespace sjtu {
+
+/**
+ * memory unlinked from a lock-free structure may still be read by threads
+ *   that found it before the unlink, so it is retired instead of freed.
+ *
+ * every thread owns a record announcing the global epoch it saw when it
+ *   entered its current critical section (an epoch_guard).  the global
+ *   epoch moves from g to g + 1 only when every thread inside a critical
+ *   section has announced g, so once it reaches g + 2 nobody can still
+ *   hold a pointer found before a retire made at g, which is then freed.
+ * a retired object goes into the bag of the epoch current at the retire,
+ *   one bag per epoch modulo 3; the bags are emptied by their owner when
+ *   it enters a critical section or reuses the bag.
+ * the epoch is pushed on every advance_every retires, and by a thread
+ *   leaving its critical section every advance_every times while it has
+ *   something waiting, so a thread that retires rarely still gets its
+ *   memory back after a few operations.
+ * records are never freed while the program runs: a thread that exits
+ *   leaves its record (and its bags) to the next new thread.  all the
+ *   structures share one domain, so a retired object must not refer to
+ *   the container it came from.
+ */
+class epoch_domain {
+public:
+	class retired {
+	public:
+		void* p;
+		void (*del)(void*);
+	};
+	class bag {
+	public:
+		retired* v;
+		size_t n, c;
+		unsigned long long stamp;
+		bag() :v(NULL), n(0), c(0), stamp(0) {}
+		~bag() {
+			drain();
+			delete[] v;
+		}
+		void push(void* p, void (*del)(void*)) {
+			if (n == c) {
+				size_t nc = (c == 0) ? 64 : c * 2;
+				retired* nv = new retired[nc];
+				for (size_t i = 0; i < n; i++) nv[i] = v[i];
+				delete[] v;
+				v = nv;
+				c = nc;
+			}
+			v[n].p = p;
+			v[n].del = del;
+			n++;
+		}
+		void drain() {
+			for (size_t i = 0; i < n; i++) v[i].del(v[i].p);
+			n = 0;
+		}
+	};
+	class record {
+	public:
+		// (epoch << 1) | 1 inside a critical section, 0 outside
+		std::atomic<unsigned long long> local;
+		std::atomic<bool> used;
+		record* next;
+		int depth;
+		size_t retires, exits;
+		bag bags[3];
+		record() :local(0), used(true), next(NULL), depth(0), retires(0), exits(0) {}
+		bool waiting() const { return bags[0].n + bags[1].n + bags[2].n > 0; }
+	};
+	static epoch_domain & instance() {
+		static epoch_domain d;
+		return d;
+	}
+	/**
+	 * the record of the calling thread, taken on first use.
+	 */
+	static record* mine() {
+		class holder {
+		public:
+			record* r;
+			holder() :r(instance().acquire()) {}
+			~holder() { r->used.store(false, std::memory_order_release); }
+		};
+		static thread_local holder h;
+		return h.r;
+	}
+	void enter(record* r) {
+		if (r->depth++ > 0) return;
+		unsigned long long g = global.load(std::memory_order_seq_cst);
+		r->local.store((g << 1) | 1, std::memory_order_seq_cst);
+		for (int i = 0; i < 3; i++) {
+			if (r->bags[i].n > 0 && r->bags[i].stamp + 2 <= g) r->bags[i].drain();
+		}
+	}
+	void exit(record* r) {
+		if (--r->depth > 0) return;
+		r->local.store(0, std::memory_order_release);
+		if (r->waiting() && ++r->exits % advance_every == 0) advance(global.load(std::memory_order_seq_cst));
+	}
+	/**
+	 * free p with del(p) once no critical section can still see it, p must
+	 *   already be unreachable for threads that enter from now on.
+	 */
+	void retire(record* r, void* p, void (*del)(void*)) {
+		unsigned long long g = global.load(std::memory_order_seq_cst);
+		bag &b = r->bags[g % 3];
+		// the same slot three epochs ago at least, safe to free
+		if (b.stamp != g) {
+			b.drain();
+			b.stamp = g;
+		}
+		b.push(p, del);
+		if (++r->retires % advance_every == 0) advance(g);
+	}
+	epoch_domain(const epoch_domain &) = delete;
+	epoch_domain & operator=(const epoch_domain &) = delete;
+private:
+	static const size_t advance_every = 16;
+	std::atomic<unsigned long long> global;
+	std::atomic<record*> records;
+	epoch_domain() :global(0), records(NULL) {}
+	~epoch_domain() {
+		record* r = records.load(std::memory_order_acquire);
+		while (r != NULL) {
+			record* q = r->next;
+			delete r;
+			r = q;
+		}
+	}
+	record* acquire() {
+		for (record* r = records.load(std::memory_order_acquire); r != NULL; r = r->next) {
+			bool f = false;
+			if (!r->used.load(std::memory_order_relaxed) && r->used.compare_exchange_strong(f, true, std::memory_order_acquire)) return r;
+		}
+		record* r = new record;
+		record* h = records.load(std::memory_order_relaxed);
+		do {
+			r->next = h;
+		} while (!records.compare_exchange_weak(h, r, std::memory_order_release, std::memory_order_relaxed));
+		return r;
+	}
+	void advance(unsigned long long g) {
+		for (record* r = records.load(std::memory_order_acquire); r != NULL; r = r->next) {
+			unsigned long long v = r->local.load(std::memory_order_seq_cst);
+			if ((v & 1) && (v >> 1) != g) return;
+		}
+		global.compare_exchange_strong(g, g + 1, std::memory_order_seq_cst);
+	}
+};
+
+/**
+ * a critical section of the calling thread, they nest.  a guard must be
+ *   destroyed on the thread that made it.
+ */
+class epoch_guard {
+public:
+	epoch_guard() :r(epoch_domain::mine()) {
+		epoch_domain::instance().enter(r);
+	}
+	epoch_guard(const epoch_guard &) = delete;
+	epoch_guard & operator=(const epoch_guard &) = delete;
+	~epoch_guard() {
+		epoch_domain::instance().exit(r);
+	}
+	void retire(void* p, void (*del)(void*)) {
+		epoch_domain::instance().retire(r, p, del);
+	}
+private:
+	epoch_domain::record* r;
+};
+
+}
+
+#endif
@@ -0,0 +1,344 @@
+/**
+ * read-mostly associative containers stored in one contiguous array
+ */
+#ifndef SJTU_FLAT_MAP_HPP
+#define SJTU_FLAT_MAP_HPP
+
+// only for std::less<T>
+#include <functional>
+// only for std::stable_sort
+#include <algorithm>
+#include <cstddef>
+#include <new>
+#include "utility.hpp"
+#include "exceptions.hpp"
+
+namespace sjtu {
+
+/**
+ * a static search table in eytzinger (BFS) order: the children of slot k
+ *   are slots 2k and 2k + 1, slot 0 is unused.
+ * the search walks down without any branch on the comparison and
+ *   prefetches the slots four levels below (the last slot once that runs
+ *   past the end), so the descent is bounded by memory bandwidth instead
+ *   of latency.
+ * it is built once (see freeze, flat_map::freeze) and never modified.
+ */
+template<
+	class Key,
+	class T,
+	class Compare = std::less<Key>
+> class eytzinger_map {
+public:
+	typedef pair<const Key, T> value_type;
+	/**
+	 * build from n elements of an ascending sequence without duplicates.
+	 */
+	template<class ForwardIt>
+	eytzinger_map(ForwardIt first, size_t n) :data(NULL), n(n) {
+		data = static_cast<value_type*>(::operator new(sizeof(value_type) * (n + 1)));
+		fill(first, 1);
+	}
+	eytzinger_map(const eytzinger_map &other) :data(NULL), n(other.n) {
+		data = static_cast<value_type*>(::operator new(sizeof(value_type) * (n + 1)));
+		for (size_t k = 1; k <= n; k++) new (data + k) value_type(other.data[k]);
+	}
+	eytzinger_map & operator=(const eytzinger_map &other) {
+		if (this == &other) return *this;
+		destroy();
+		n = other.n;
+		data = static_cast<value_type*>(::operator new(sizeof(value_type) * (n + 1)));
+		for (size_t k = 1; k <= n; k++) new (data + k) value_type(other.data[k]);
+		return *this;
+	}
+	~eytzinger_map() {
+		destroy();
+	}
+	/**
+	 * the element with the smallest key not less than key, or NULL.
+	 */
+	const value_type* lower_bound(const Key &key) const {
+		size_t k = 1;
+		while (k <= n) {
+			SJTU_PREFETCH(data + (((k << 4) <= n) ? (k << 4) : n));
+			k = (k << 1) + (size_t)cmp(data[k].first, key);
+		}
+		// drop the trailing right turns and the last left turn: k becomes lower_bound
+		while (k & 1) k >>= 1;
+		k >>= 1;
+		return (k == 0) ? NULL : data + k;
+	}
+	/**
+	 * the element with key equivalent to key, or NULL.
+	 */
+	const value_type* find(const Key &key) const {
+		const value_type* p = lower_bound(key);
+		if (p == NULL || cmp(key, p->first)) return NULL;
+		return p;
+	}
+	const T & at(const Key &key) const {
+		const value_type* p = find(key);
+		if (p == NULL) throw index_out_of_bound("from eytzinger_map::at");
+		return p->second;
+	}
+	size_t count(const Key &key) const {
+		return (find(key) == NULL) ? 0 : 1;
+	}
+	bool empty() const { return n == 0; }
+	size_t size() const { return n; }
+private:
+	value_type* data;
+	size_t n;
+	Compare cmp;
+	template<class ForwardIt>
+	void fill(ForwardIt &it, size_t k) {
+		if (k > n) return;
+		fill(it, k << 1);
+		new (data + k) value_type(*it);
+		++it;
+		fill(it, (k << 1) + 1);
+	}
+	void destroy() {
+		if (data == NULL) return;
+		for (size_t k = 1; k <= n; k++) data[k].~value_type();
+		::operator delete(data);
+		data = NULL;
+	}
+};
+
+template<class Key, class T, class Compare, class Monoid, class Balance> class map;
+
+/**
+ * copy the elements of a map into a read-only eytzinger_map, whose lookups
+ *   are several times faster than walking the tree.
+ */
+template<class Key, class T, class Compare, class Monoid, class Balance>
+eytzinger_map<Key, T, Compare> freeze(const map<Key, T, Compare, Monoid, Balance> &m) {
+	return eytzinger_map<Key, T, Compare>(m.cbegin(), m.size());
+}
+
+/**
+ * a sorted array of pair<Key, T>, like boost::container::flat_map.
+ *
+ * lookups are a binary search over contiguous memory; a single insert or
+ *   erase shifts the tail, so fill it with the batched insert(first, last)
+ *   which sorts the batch and merges it in one pass.
+ * the keys must not be modified through an iterator.
+ * iterators are plain pointers and are invalidated by any modification.
+ */
+template<
+	class Key,
+	class T,
+	class Compare = std::less<Key>
+> class flat_map {
+public:
+	typedef pair<Key, T> value_type;
+	typedef value_type* iterator;
+	typedef const value_type* const_iterator;
+	flat_map() :a(NULL), n(0), c(0) {}
+	template<class InputIt>
+	flat_map(InputIt first, InputIt last) :a(NULL), n(0), c(0) {
+		insert(first, last);
+	}
+	flat_map(const flat_map &other) :a(NULL), n(0), c(0) {
+		reserve(other.n);
+		for (; n < other.n; n++) new (a + n) value_type(other.a[n]);
+	}
+	flat_map & operator=(const flat_map &other) {
+		if (this == &other) return *this;
+		clear();
+		reserve(other.n);
+		for (; n < other.n; n++) new (a + n) value_type(other.a[n]);
+		return *this;
+	}
+	~flat_map() {
+		clear();
+		::operator delete(a);
+	}
+	T & at(const Key &key) {
+		iterator p = find(key);
+		if (p == end()) throw index_out_of_bound("from flat_map::at");
+		return p->second;
+	}
+	const T & at(const Key &key) const {
+		const_iterator p = find(key);
+		if (p == cend()) throw index_out_of_bound("from flat_map::at");
+		return p->second;
+	}
+	T & operator[](const Key &key) {
+		return insert(value_type(key, T())).first->second;
+	}
+	const T & operator[](const Key &key) const {
+		return at(key);
+	}
+	iterator begin() { return a; }
+	const_iterator cbegin() const { return a; }
+	iterator end() { return a + n; }
+	const_iterator cend() const { return a + n; }
+	bool empty() const { return n == 0; }
+	size_t size() const { return n; }
+	void clear() {
+		for (size_t i = 0; i < n; i++) a[i].~value_type();
+		n = 0;
+	}
+	void reserve(size_t cnt) {
+		if (cnt > c) relocate(cnt);
+	}
+	/**
+	 * insert one element, shifting everything behind it.
+	 */
+	pair<iterator, bool> insert(const value_type &value) {
+		size_t p = bound(value.first);
+		if (p < n && !cmp(value.first, a[p].first)) return pair<iterator, bool>(a + p, false);
+		if (n == c) relocate(c < 8 ? 8 : c * 2);
+		for (size_t i = n; i > p; i--) {
+			new (a + i) value_type(std::move(a[i - 1]));
+			a[i - 1].~value_type();
+		}
+		new (a + p) value_type(value);
+		++n;
+		return pair<iterator, bool>(a + p, true);
+	}
+	/**
+	 * batched insert: sort the batch and merge it with the stored elements.
+	 * keys already present, and repeated keys in the batch after their first
+	 *   occurrence, are ignored like in insert(value).
+	 * the merged array is built aside and swapped in at the end, so an
+	 *   exception from a copy, a comparison or an allocation leaves the map
+	 *   as it was.  the stored elements are moved only if that cannot throw.
+	 */
+	template<class InputIt>
+	void insert(InputIt first, InputIt last) {
+		size_t m = 0, bc = 16, k = 0;
+		value_type* b = static_cast<value_type*>(::operator new(sizeof(value_type) * bc));
+		value_type** ord = NULL;
+		value_type* na = NULL;
+		try {
+			for (; first != last; ++first) {
+				if (m == bc) {
+					value_type* nb = moved(b, m, bc * 2);
+					release(b, m);
+					b = nb; bc *= 2;
+				}
+				new (b + m) value_type(*first);
+				++m;
+			}
+			ord = new value_type*[m];
+			for (size_t i = 0; i < m; i++) ord[i] = b + i;
+			std::stable_sort(ord, ord + m, [this](const value_type* x, const value_type* y) {
+				return cmp(x->first, y->first);
+			});
+			na = static_cast<value_type*>(::operator new(sizeof(value_type) * (n + m)));
+			size_t i = 0, j = 0;
+			while (i < n || j < m) {
+				if (j < m && k > 0 && !cmp(na[k - 1].first, ord[j]->first)) { ++j; continue; }
+				if (j == m || (i < n && !cmp(ord[j]->first, a[i].first))) {
+					new (na + k) value_type(std::move_if_noexcept(a[i]));
+					++i;
+				}
+				else {
+					new (na + k) value_type(std::move_if_noexcept(*ord[j]));
+					++j;
+				}
+				++k;
+			}
+		}
+		catch (...) {
+			release(na, k);
+			delete[] ord;
+			release(b, m);
+			throw;
+		}
+		release(b, m);
+		delete[] ord;
+		release(a, n);
+		a = na; c = n + m; n = k;
+	}
+	iterator erase(iterator pos) {
+		if (pos < a || pos >= a + n) throw invalid_iterator("from flat_map::erase");
+		size_t p = pos - a;
+		a[p].~value_type();
+		for (size_t i = p; i + 1 < n; i++) {
+			new (a + i) value_type(std::move(a[i + 1]));
+			a[i + 1].~value_type();
+		}
+		--n;
+		return a + p;
+	}
+	size_t erase(const Key &key) {
+		iterator p = find(key);
+		if (p == end()) return 0;
+		erase(p);
+		return 1;
+	}
+	size_t count(const Key &key) const {
+		return (find(key) == cend()) ? 0 : 1;
+	}
+	iterator find(const Key &key) {
+		size_t p = bound(key);
+		if (p == n || cmp(key, a[p].first)) return end();
+		return a + p;
+	}
+	const_iterator find(const Key &key) const {
+		size_t p = bound(key);
+		if (p == n || cmp(key, a[p].first)) return cend();
+		return a + p;
+	}
+	/**
+	 * the first element whose key is not less than key.
+	 */
+	iterator lower_bound(const Key &key) { return a + bound(key); }
+	const_iterator lower_bound(const Key &key) const { return a + bound(key); }
+	/**
+	 * copy into the eytzinger layout for the fastest read-only lookups.
+	 */
+	eytzinger_map<Key, T, Compare> freeze() const {
+		return eytzinger_map<Key, T, Compare>(cbegin(), n);
+	}
+private:
+	value_type* a;
+	size_t n, c;
+	Compare cmp;
+	size_t bound(const Key &key) const {
+		size_t lo = 0, len = n;
+		while (len > 0) {
+			size_t half = len >> 1;
+			if (cmp(a[lo + half].first, key)) lo += half + 1, len -= half + 1;
+			else len = half;
+		}
+		return lo;
+	}
+	/**
+	 * a new array of cap slots holding the cnt elements of p, which are
+	 *   moved if that cannot throw and copied otherwise.  p is left in place,
+	 *   if a copy throws the new array is freed again.
+	 */
+	static value_type* moved(value_type* p, size_t cnt, size_t cap) {
+		value_type* np = static_cast<value_type*>(::operator new(sizeof(value_type) * cap));
+		size_t i = 0;
+		try {
+			for (; i < cnt; i++) new (np + i) value_type(std::move_if_noexcept(p[i]));
+		}
+		catch (...) {
+			release(np, i);
+			throw;
+		}
+		return np;
+	}
+	/**
+	 * destroy the cnt elements of p and free it, p may be NULL.
+	 */
+	static void release(value_type* p, size_t cnt) {
+		for (size_t i = 0; i < cnt; i++) p[i].~value_type();
+		::operator delete(p);
+	}
+	void relocate(size_t cnt) {
+		value_type* na = moved(a, n, cnt);
+		release(a, n);
+		a = na; c = cnt;
+	}
+};
+
+}
+
+#endif
@@ -0,0 +1,135 @@
+/**
+ * implement an interval tree on top of sjtu::map
+ */
+#ifndef SJTU_INTERVAL_MAP_HPP
+#define SJTU_INTERVAL_MAP_HPP
+
+#include <cstddef>
+// only for std::numeric_limits<T>
+#include <limits>
+#include "utility.hpp"
+#include "exceptions.hpp"
+#include "map.hpp"
+
+namespace sjtu {
+
+/**
+ * a map from half open intervals [lo, hi) to V.
+ *
+ * the intervals are the keys of an sjtu::map ordered by (lo, hi), so the
+ *   AVL balancing, the nx/pr thread and the iterators are those of map.
+ *   every node also keeps the largest hi of its subtree through the
+ *   aggregate policy max_end, which map recomputes in every rotation.
+ * an overlap query for [lo, hi) reports, in key order,
+ *   - the intervals starting before lo that reach past it, found by a
+ *     descent that skips every subtree whose largest hi is <= lo, and
+ *   - the intervals starting in [lo, hi), a contiguous run of the thread
+ *     from lower_bound, O(log n + k).
+ *   the descent costs O(log n) per interval it reports at worst, and is
+ *   O(log n) when nothing starts before lo and reaches it.
+ * K needs operator< and std::numeric_limits<K>::lowest().
+ */
+template<class K, class V>
+class interval_map {
+public:
+	typedef pair<K, K> interval;
+	typedef pair<const interval, V> value_type;
+	class interval_less {
+	public:
+		bool operator()(const interval &a, const interval &b) const {
+			if (a.first < b.first) return true;
+			if (b.first < a.first) return false;
+			return a.second < b.second;
+		}
+	};
+	class max_end {
+	public:
+		typedef K result_type;
+		static K identity() { return std::numeric_limits<K>::lowest(); }
+		static K lift(const interval &i, const V &) { return i.second; }
+		static K combine(const K &a, const K &b) { return (a < b) ? b : a; }
+	};
+	typedef map<interval, V, interval_less, max_end> tree_type;
+	typedef typename tree_type::iterator iterator;
+	typedef typename tree_type::const_iterator const_iterator;
+	iterator begin() { return t.begin(); }
+	const_iterator cbegin() const { return t.cbegin(); }
+	iterator end() { return t.end(); }
+	const_iterator cend() const { return t.cend(); }
+	bool empty() const { return t.empty(); }
+	size_t size() const { return t.size(); }
+	void clear() { t.clear(); }
+	/**
+	 * insert [lo, hi) -> value, an empty interval (!(lo < hi)) throws runtime_error.
+	 * return the iterator to the element with this interval, and true if it was inserted.
+	 */
+	pair<iterator, bool> insert(const K &lo, const K &hi, const V &value) {
+		if (!(lo < hi)) throw runtime_error("from interval_map::insert empty interval");
+		return t.insert(value_type(interval(lo, hi), value));
+	}
+	void erase(iterator pos) {
+		t.erase(pos);
+	}
+	size_t erase(const K &lo, const K &hi) {
+		return t.erase(interval(lo, hi));
+	}
+	iterator find(const K &lo, const K &hi) {
+		return t.find(interval(lo, hi));
+	}
+	const_iterator find(const K &lo, const K &hi) const {
+		return t.find(interval(lo, hi));
+	}
+	/**
+	 * call f(const value_type &) in key order on every interval that
+	 *   overlaps [lo, hi), return how many there were.
+	 */
+	template<class F>
+	size_t overlapping(const K &lo, const K &hi, F f) const {
+		if (!(lo < hi)) return 0;
+		size_t k = 0;
+		const interval from(lo, std::numeric_limits<K>::lowest());
+		t.walk_pruned(from, [&lo](const K &end) { return lo < end; }, [&](const value_type &v) {
+			k++;
+			f(v);
+		});
+		for (const_iterator it = t.lower_bound(from); it != t.cend() && it->first.first < hi; ++it) {
+			k++;
+			f(*it);
+		}
+		return k;
+	}
+	/**
+	 * call f(const value_type &) in key order on every interval that
+	 *   contains x, return how many there were.
+	 */
+	template<class F>
+	size_t stabbing(const K &x, F f) const {
+		size_t k = 0;
+		const interval from(x, std::numeric_limits<K>::lowest());
+		t.walk_pruned(from, [&x](const K &end) { return x < end; }, [&](const value_type &v) {
+			k++;
+			f(v);
+		});
+		for (const_iterator it = t.lower_bound(from); it != t.cend() && !(x < it->first.first); ++it) {
+			k++;
+			f(*it);
+		}
+		return k;
+	}
+	/**
+	 * whether any interval overlaps [lo, hi), in O(log n).
+	 */
+	bool overlaps(const K &lo, const K &hi) const {
+		if (!(lo < hi)) return false;
+		const interval from(lo, std::numeric_limits<K>::lowest());
+		const_iterator it = t.lower_bound(from);
+		if (it != t.cend() && it->first.first < hi) return true;
+		return lo < t.aggregate(interval(std::numeric_limits<K>::lowest(), std::numeric_limits<K>::lowest()), from);
+	}
+private:
+	tree_type t;
+};
+
+}
+
+#endif
@@ -0,0 +1,305 @@
+/**
+ * implement a least recently used cache on top of sjtu::map
+ */
+#ifndef SJTU_LRU_CACHE_HPP
+#define SJTU_LRU_CACHE_HPP
+
+// only for std::less<T>, std::hash<T> and std::function<T>
+#include <functional>
+#include <cstddef>
+#include <mutex>
+#include <string>
+// only for std::is_trivially_copyable<T>
+#include <type_traits>
+#include "utility.hpp"
+#include "exceptions.hpp"
+#include "map.hpp"
+
+namespace sjtu {
+
+/**
+ * the bytes an object accounts for, as byte_weight sees them.
+ *   a trivially copyable type owns nothing outside itself and weighs its
+ *   sizeof; any other type needs an overload weight(const X &) next to it
+ *   (found by argument dependent lookup) that adds what it owns, or it
+ *   does not compile.  std::string is counted with its whole capacity.
+ */
+template<class X>
+size_t weight(const X &) {
+	static_assert(std::is_trivially_copyable<X>::value, "byte_weight needs weight(const X &) for a type that owns memory");
+	return sizeof(X);
+}
+
+template<class C, class Tr, class A>
+size_t weight(const std::basic_string<C, Tr, A> &s) {
+	return sizeof(s) + s.capacity() * sizeof(C);
+}
+
+/**
+ * weight policies for lru_cache, the capacity is a bound on the total.
+ *   entry_weight counts entries; byte_weight adds weight() of the key and
+ *   of the value.
+ */
+struct entry_weight {
+	template<class K, class V>
+	size_t operator()(const K &, const V &) const { return 1; }
+};
+
+struct byte_weight {
+	template<class K, class V>
+	size_t operator()(const K &k, const V &v) const { return weight(k) + weight(v); }
+};
+
+/**
+ * the entries are the elements of an sjtu::map, whose nodes never move,
+ *   and every entry carries the links of a second thread through them
+ *   ordered by recency, newest first, like nx/pr order them by key.
+ *   a hit relinks its entry at the front and an eviction unlinks the
+ *   back, both O(1) on top of the O(log n) lookup; an eviction then
+ *   erases its key from the map, O(log n).
+ * when an insert takes the total weight over the capacity, entries are
+ *   evicted from the back (the new one last) until it fits, each handed
+ *   to the eviction callback first.
+ * not thread safe, see concurrent_lru_cache.
+ */
+template<
+	class Key,
+	class V,
+	class Compare = std::less<Key>,
+	class Weigh = entry_weight
+> class lru_cache {
+public:
+	typedef std::function<void(const Key &, V &)> evict_callback;
+private:
+	class entry;
+	typedef pair<const Key, entry> item;
+	class entry {
+	public:
+		V value;
+		size_t w;
+		item *newer, *older;
+		explicit entry(const V &value) :value(value), w(0), newer(NULL), older(NULL) {}
+	};
+public:
+	explicit lru_cache(size_t capacity) :cap(capacity), total(0), front(NULL), back(NULL) {}
+	lru_cache(const lru_cache &) = delete;
+	lru_cache & operator=(const lru_cache &) = delete;
+	/**
+	 * called with every entry the cache pushes out (not with the ones
+	 *   erased or overwritten by the caller), before it is destroyed.
+	 */
+	void on_evict(const evict_callback &f) { cb = f; }
+	size_t size() const { return m.size(); }
+	bool empty() const { return m.empty(); }
+	size_t weight() const { return total; }
+	size_t capacity() const { return cap; }
+	/**
+	 * change the capacity, evicting what no longer fits.
+	 */
+	void set_capacity(size_t capacity) {
+		cap = capacity;
+		shrink();
+	}
+	/**
+	 * the value of key marked as just used, or NULL on a miss.
+	 *   the pointer is valid until the entry leaves the cache.
+	 */
+	V* find(const Key &key) {
+		typename map<Key, entry, Compare>::iterator it = m.find(key);
+		if (it == m.end()) return NULL;
+		touch(&*it);
+		return &it->second.value;
+	}
+	/**
+	 * copy the value of key into out and mark it as just used,
+	 *   return false on a miss.
+	 */
+	bool get(const Key &key, V &out) {
+		V* v = find(key);
+		if (v == NULL) return false;
+		out = *v;
+		return true;
+	}
+	/**
+	 * whether key is cached, without marking it as used.
+	 */
+	bool contains(const Key &key) const {
+		return m.count(key) != 0;
+	}
+	/**
+	 * insert or overwrite key, it becomes the most recently used entry.
+	 */
+	void put(const Key &key, const V &value) {
+		pair<typename map<Key, entry, Compare>::iterator, bool> r = m.try_emplace(key, value);
+		item* e = &*r.first;
+		if (r.second) {
+			link(e);
+		}
+		else {
+			total -= e->second.w;
+			e->second.value = value;
+			touch(e);
+		}
+		e->second.w = weigh(e->first, e->second.value);
+		total += e->second.w;
+		shrink();
+	}
+	/**
+	 * drop key without calling the eviction callback, return whether it was there.
+	 */
+	bool erase(const Key &key) {
+		typename map<Key, entry, Compare>::iterator it = m.find(key);
+		if (it == m.end()) return false;
+		unlink(&*it);
+		total -= it->second.w;
+		m.erase(it);
+		return true;
+	}
+	void clear() {
+		m.clear();
+		front = back = NULL;
+		total = 0;
+	}
+	/**
+	 * call f(const Key &, const V &) from the most to the least recently used.
+	 */
+	template<class F>
+	void for_each(F f) const {
+		for (const item* e = front; e != NULL; e = e->second.older) f(e->first, e->second.value);
+	}
+private:
+	map<Key, entry, Compare> m;
+	size_t cap, total;
+	item *front, *back;
+	Weigh weigh;
+	evict_callback cb;
+	void link(item* e) {
+		e->second.newer = NULL;
+		e->second.older = front;
+		if (front == NULL) back = e; else front->second.newer = e;
+		front = e;
+	}
+	void unlink(item* e) {
+		if (e->second.newer == NULL) front = e->second.older; else e->second.newer->second.older = e->second.older;
+		if (e->second.older == NULL) back = e->second.newer; else e->second.older->second.newer = e->second.newer;
+	}
+	void touch(item* e) {
+		if (e == front) return;
+		unlink(e);
+		link(e);
+	}
+	void shrink() {
+		while (total > cap && back != NULL) {
+			item* e = back;
+			unlink(e);
+			total -= e->second.w;
+			if (cb) cb(e->first, e->second.value);
+			m.erase(e->first);
+		}
+	}
+};
+
+/**
+ * an lru_cache cut into shards by the hash of the key, each behind its own
+ *   mutex, so threads touching different shards do not wait for each
+ *   other.  every shard gets an equal part of the capacity and evicts on
+ *   its own, the recency order is kept per shard only.
+ * a capacity below the number of shards asked for gets one shard per
+ *   unit of capacity instead, so that no shard has a capacity of 0 and
+ *   evicts everything put into it (see shard_count).
+ * a hit moves its entry, so even lookups lock their shard exclusively.
+ *   values are copied out, the eviction callback runs under the shard lock
+ *   and must not use the cache.
+ */
+template<
+	class Key,
+	class V,
+	class Compare = std::less<Key>,
+	class Weigh = entry_weight,
+	class Hash = std::hash<Key>
+> class concurrent_lru_cache {
+public:
+	typedef typename lru_cache<Key, V, Compare, Weigh>::evict_callback evict_callback;
+	explicit concurrent_lru_cache(size_t capacity, size_t shards = 16) :n(shards < capacity ? shards : capacity), sh(NULL) {
+		if (n == 0) n = 1;
+		sh = new shard*[n];
+		size_t i = 0;
+		try {
+			for (; i < n; i++) sh[i] = new shard(capacity / n + (i < capacity % n ? 1 : 0));
+		}
+		catch (...) {
+			while (i > 0) delete sh[--i];
+			delete[] sh;
+			throw;
+		}
+	}
+	concurrent_lru_cache(const concurrent_lru_cache &) = delete;
+	concurrent_lru_cache & operator=(const concurrent_lru_cache &) = delete;
+	~concurrent_lru_cache() {
+		for (size_t i = 0; i < n; i++) delete sh[i];
+		delete[] sh;
+	}
+	void on_evict(const evict_callback &f) {
+		for (size_t i = 0; i < n; i++) {
+			std::lock_guard<std::mutex> g(sh[i]->lock);
+			sh[i]->c.on_evict(f);
+		}
+	}
+	bool get(const Key &key, V &out) {
+		shard* s = pick(key);
+		std::lock_guard<std::mutex> g(s->lock);
+		return s->c.get(key, out);
+	}
+	bool contains(const Key &key) const {
+		shard* s = pick(key);
+		std::lock_guard<std::mutex> g(s->lock);
+		return s->c.contains(key);
+	}
+	void put(const Key &key, const V &value) {
+		shard* s = pick(key);
+		std::lock_guard<std::mutex> g(s->lock);
+		s->c.put(key, value);
+	}
+	bool erase(const Key &key) {
+		shard* s = pick(key);
+		std::lock_guard<std::mutex> g(s->lock);
+		return s->c.erase(key);
+	}
+	/**
+	 * the sums over the shards, exact only when nobody is writing.
+	 */
+	size_t size() const {
+		size_t k = 0;
+		for (size_t i = 0; i < n; i++) {
+			std::lock_guard<std::mutex> g(sh[i]->lock);
+			k += sh[i]->c.size();
+		}
+		return k;
+	}
+	size_t weight() const {
+		size_t k = 0;
+		for (size_t i = 0; i < n; i++) {
+			std::lock_guard<std::mutex> g(sh[i]->lock);
+			k += sh[i]->c.weight();
+		}
+		return k;
+	}
+	size_t shard_count() const { return n; }
+private:
+	class shard {
+	public:
+		mutable std::mutex lock;
+		lru_cache<Key, V, Compare, Weigh> c;
+		explicit shard(size_t capacity) :c(capacity) {}
+	};
+	size_t n;
+	shard** sh;
+	Hash hash;
+	shard* pick(const Key &key) const {
+		return sh[hash(key) % n];
+	}
+};
+
+}
+
+#endif
@@ -1,29 +1,320 @@
 /**
- * implement a container like std::map
+ * implement containers like std::map and std::multimap
  */
 #ifndef SJTU_MAP_HPP
 #define SJTU_MAP_HPP
 
 // only for std::less<T>
 #include <functional>
+// only for std::stable_sort
+#include <algorithm>
 #include <cstddef>
+// only for std::numeric_limits<T>
+#include <limits>
+// only for std::is_same<T, U> and std::conditional<B, T, F>
+#include <type_traits>
+#include <thread>
+#include <atomic>
+// only for std::exception_ptr
+#include <exception>
 #include "utility.hpp"
 #include "exceptions.hpp"
 
+/**
+ * when the bulk operations go parallel: a subtree pair is split over two
+ *   threads once it holds SJTU_MAP_FORK_GRAIN nodes (a batch once it has
+ *   SJTU_MAP_BATCH_GRAIN ops), at most SJTU_MAP_FORK_DEPTH levels deep.
+ *   the depth defaults to log2 of the hardware threads, so it is 0 on one
+ *   core; a test defines all three small to run the parallel paths anyway.
+ */
+#ifndef SJTU_MAP_FORK_GRAIN
+#define SJTU_MAP_FORK_GRAIN (1 << 15)
+#endif
+#ifndef SJTU_MAP_BATCH_GRAIN
+#define SJTU_MAP_BATCH_GRAIN (1 << 12)
+#endif
+
 namespace sjtu {
 
+/**
+ * subtree aggregate policies for map.
+ * a policy is a monoid over the elements:
+ *   typedef ... result_type;
+ *   static result_type identity();
+ *   static result_type lift(const Key &, const T &);
+ *   static result_type combine(const result_type &, const result_type &);
+ * combine must be associative, it is always called with the left operand
+ *   holding the smaller keys, so it need not be commutative.
+ * every node keeps the aggregate of its subtree, recomputed with h and s.
+ */
+struct no_aggregate {
+	struct result_type {};
+	static result_type identity() { return result_type(); }
+	template<class K, class V>
+	static result_type lift(const K &, const V &) { return result_type(); }
+	static result_type combine(const result_type &, const result_type &) { return result_type(); }
+};
+
+template<class T>
+struct aggregate_sum {
+	typedef T result_type;
+	static T identity() { return T(); }
+	template<class K>
+	static T lift(const K &, const T &v) { return v; }
+	static T combine(const T &a, const T &b) { return a + b; }
+};
+
+template<class T>
+struct aggregate_min {
+	typedef T result_type;
+	static T identity() { return std::numeric_limits<T>::max(); }
+	template<class K>
+	static T lift(const K &, const T &v) { return v; }
+	static T combine(const T &a, const T &b) { return (b < a) ? b : a; }
+};
+
+template<class T>
+struct aggregate_max {
+	typedef T result_type;
+	static T identity() { return std::numeric_limits<T>::lowest(); }
+	template<class K>
+	static T lift(const K &, const T &v) { return v; }
+	static T combine(const T &a, const T &b) { return (a < b) ? b : a; }
+};
+
+/**
+ * the per node storage of an aggregate, nothing at all for no_aggregate.
+ */
+template<class Monoid>
+class aggregate_slot {
+public:
+	typename Monoid::result_type agg;
+	aggregate_slot() :agg(Monoid::identity()) {}
+	const typename Monoid::result_type & get() const { return agg; }
+	void set(const typename Monoid::result_type &v) { agg = v; }
+};
+
+template<>
+class aggregate_slot<no_aggregate> {
+public:
+	no_aggregate::result_type get() const { return no_aggregate::result_type(); }
+	void set(const no_aggregate::result_type &) {}
+};
+
+/**
+ * what a map has been doing, see avl_tree::stats().
+ * the counters are compiled in only when SJTU_MAP_STATS is defined, else
+ *   they stay zero and cost nothing.  with SJTU_MAP_DEBUG every change of
+ *   the tree is followed by a full validate(), which is O(n).
+ *   searches     find, count, at, insert... and lower/upper_bound descents
+ *   compares     Compare calls made by those descents
+ *   depth[d]     descents that visited d nodes (the last slot takes the rest)
+ *   rotations    LL, RR, LR, RL
+ *   allocated    nodes made and freed by every map in the program,
+ *   freed          sentinels included
+ *   height       the tree height now, its peak after any change, and
+ *   peak_height    floor(log2(size)), the height of a perfect tree
+ *   ideal_height
+ */
+class map_stats {
+public:
+	static const int depth_slots = 64;
+	unsigned long long searches, compares;
+	unsigned long long depth[depth_slots];
+	unsigned long long rotations[4];
+	unsigned long long allocated, freed;
+	int height, peak_height, ideal_height;
+	size_t size;
+};
+
+template<bool On>
+class map_counters {
+public:
+	std::atomic<unsigned long long> searches, compares;
+	std::atomic<unsigned long long> depth[map_stats::depth_slots];
+	std::atomic<unsigned long long> rotations[4];
+	std::atomic<int> peak;
+	map_counters() { reset(); }
+	// a copy starts counting afresh
+	map_counters(const map_counters &) { reset(); }
+	map_counters & operator=(const map_counters &) { return *this; }
+	void reset() {
+		searches = 0;
+		compares = 0;
+		for (int i = 0; i < map_stats::depth_slots; i++) depth[i] = 0;
+		for (int i = 0; i < 4; i++) rotations[i] = 0;
+		peak = 0;
+	}
+	void searched(int c, int d) {
+		searches.fetch_add(1, std::memory_order_relaxed);
+		compares.fetch_add(c, std::memory_order_relaxed);
+		if (d >= map_stats::depth_slots) d = map_stats::depth_slots - 1;
+		depth[d].fetch_add(1, std::memory_order_relaxed);
+	}
+	void rotated(int k) { rotations[k].fetch_add(1, std::memory_order_relaxed); }
+	void grown(int h) {
+		int p = peak.load(std::memory_order_relaxed);
+		while (p < h && !peak.compare_exchange_weak(p, h, std::memory_order_relaxed));
+	}
+	static std::atomic<unsigned long long> & allocated() {
+		static std::atomic<unsigned long long> n(0);
+		return n;
+	}
+	static std::atomic<unsigned long long> & freed() {
+		static std::atomic<unsigned long long> n(0);
+		return n;
+	}
+	static void made() { allocated().fetch_add(1, std::memory_order_relaxed); }
+	static void gone() { freed().fetch_add(1, std::memory_order_relaxed); }
+	void get(map_stats &r) const {
+		r.searches = searches;
+		r.compares = compares;
+		for (int i = 0; i < map_stats::depth_slots; i++) r.depth[i] = depth[i];
+		for (int i = 0; i < 4; i++) r.rotations[i] = rotations[i];
+		r.allocated = allocated();
+		r.freed = freed();
+		r.peak_height = peak;
+	}
+};
+
+template<>
+class map_counters<false> {
+public:
+	void reset() {}
+	void searched(int, int) {}
+	void rotated(int) {}
+	void grown(int) {}
+	static void made() {}
+	static void gone() {}
+	void get(map_stats &r) const {
+		r.searches = r.compares = r.allocated = r.freed = 0;
+		for (int i = 0; i < map_stats::depth_slots; i++) r.depth[i] = 0;
+		for (int i = 0; i < 4; i++) r.rotations[i] = 0;
+		r.peak_height = 0;
+	}
+};
+
+#ifdef SJTU_MAP_STATS
+typedef map_counters<true> map_counters_type;
+#else
+typedef map_counters<false> map_counters_type;
+#endif
+
+/**
+ * what the tree stores, shared by map/multimap (map_traits) and
+ *   set/multiset (set_traits):
+ *   value_type, mapped_type
+ *   static key(value)          the key of an element
+ *   static mapped(value)       what a node handle hands out as mapped()
+ *   static lift<Monoid>(value) Monoid::lift on the element
+ */
+template<class Key, class T>
+struct map_traits {
+	typedef pair<const Key, T> value_type;
+	typedef T mapped_type;
+	static const Key & key(const value_type &v) { return v.first; }
+	static T & mapped(value_type &v) { return v.second; }
+	template<class Monoid>
+	static typename Monoid::result_type lift(const value_type &v) { return Monoid::lift(v.first, v.second); }
+};
+
+template<class Key>
+struct set_traits {
+	typedef const Key value_type;
+	typedef const Key mapped_type;
+	static const Key & key(const Key &v) { return v; }
+	static const Key & mapped(const Key &v) { return v; }
+	template<class Monoid>
+	static typename Monoid::result_type lift(const Key &v) { return Monoid::lift(v, v); }
+};
+
+/**
+ * the insertion stamp of a node in a tree with equal keys, equal keys are
+ *   ordered by it so they stay in insertion order and every node still has
+ *   a unique place to search for.  nothing at all when keys are unique.
+ */
+template<bool Multi>
+class order_slot {
+public:
+	unsigned long long seq;
+	order_slot() :seq(0) {}
+	unsigned long long stamp() const { return seq; }
+	void stamp(unsigned long long s) { seq = s; }
+};
+
+template<>
+class order_slot<false> {
+public:
+	unsigned long long stamp() const { return 0; }
+	void stamp(unsigned long long) {}
+};
+
+/**
+ * balancing policies for the tree behind map.  both keep h and s in every
+ *   node (h for stats() and validate(), s for rank and the set
+ *   operations) and differ only in when a subtree is out of balance:
+ *   static bool heavy(a, b)     a is too big to be the sibling of b
+ *   static bool outer(x, left)  x, the heavy left (right) child, is
+ *                               fixed by a single rotation
+ *   by_height                   heavy and outer read h alone, so a node
+ *                               whose height did not change cannot put
+ *                               its ancestors out of balance
+ * avl_balance: sibling heights differ by at most 1, the tree is at most
+ *   about 1.44 log2 n high.
+ * weight_balance: BB[alpha] on the weights s + 1 with the integer
+ *   parameters <3, 2> of Hirai and Yamamoto, a sibling weighs at most 3
+ *   times the other and a single rotation is used while the inner
+ *   grandchild weighs less than twice the outer one.  the tree may be
+ *   twice as high as a perfect one (log_{4/3} n), but a node that was
+ *   rotated needs a number of changes below it proportional to its size
+ *   before it rotates again.
+ */
+struct avl_balance {
+	static const bool by_height = true;
+	template<class N>
+	static int h(const N* t) { return (t == NULL) ? -1 : t->h; }
+	template<class N>
+	static bool heavy(const N* a, const N* b) { return h(a) > h(b) + 1; }
+	template<class N>
+	static bool outer(const N* x, bool left) {
+		return left ? !(h(x->l) < h(x->r)) : !(h(x->r) < h(x->l));
+	}
+};
+
+struct weight_balance {
+	static const bool by_height = false;
+	template<class N>
+	static size_t w(const N* t) { return (t == NULL) ? 1 : (size_t)t->s + 1; }
+	template<class N>
+	static bool heavy(const N* a, const N* b) { return w(a) > 3 * w(b); }
+	template<class N>
+	static bool outer(const N* x, bool left) {
+		return left ? w(x->r) < 2 * w(x->l) : w(x->l) < 2 * w(x->r);
+	}
+};
+
+/**
+ * the AVL tree behind map, multimap, set and multiset.
+ * Multi allows equal keys: they are kept in insertion order, find() and
+ *   lower_bound() give the first of them, and equal_range() is
+ *   O(log n + k).  the set operations need unique keys.
+ * Balance is avl_balance or weight_balance, the name stays for both.
+ */
 template<
 	class Key,
-	class T,
-	class Compare = std::less<Key>
-> class map {
+	class Traits,
+	class Compare,
+	class Monoid,
+	bool Multi,
+	class Balance
+> class avl_tree {
 public:
 	/**
 	 * the internal type of data.
 	 * it should have a default constructor, a copy constructor.
 	 * You can use sjtu::map as value_type by typedef.
 	 */
-	typedef pair<const Key, T> value_type;
+	typedef typename Traits::value_type value_type;
 	/**
 	 * see BidirectionalIterator at CppReference for help.
 	 *
@@ -31,24 +322,47 @@ public:
 	 *     like it = map.begin(); --it;
 	 *       or it = map.end(); ++end();
 	 */
-	class map_node {
+	typedef typename Monoid::result_type aggregate_type;
+	/**
+	 * what an iterator hands out: read only when the tree keeps an
+	 *   aggregate, so an element cannot change under the aggregates above
+	 *   it behind the tree's back; update() changes it and them together.
+	 */
+	typedef typename std::conditional<std::is_same<Monoid, no_aggregate>::value,
+		value_type, const value_type>::type exposed_type;
+	class map_node : public aggregate_slot<Monoid>, public order_slot<Multi> {
 	public:
 		value_type* data;
 		int h, s;
 		map_node *l, *r;
 		map_node *pr, *nx;
-		map_node() :l(NULL), r(NULL), nx(NULL), pr(NULL), h(-1), s(0), data(NULL) {}
-		map_node(const map_node& other) :l(NULL), r(NULL), nx(NULL), pr(NULL), h(other.h), s(other.s) {
+		map_node() :data(NULL), h(-1), s(0), l(NULL), r(NULL), pr(NULL), nx(NULL) {
+			map_counters_type::made();
+		}
+		map_node(const map_node& other) :order_slot<Multi>(other), data(NULL), h(other.h), s(other.s), l(NULL), r(NULL), pr(NULL), nx(NULL) {
 			data = new value_type(*other.data);
+			map_counters_type::made();
 		}
-		map_node(const value_type& e) :l(NULL), r(NULL), nx(NULL), pr(NULL), h(0), s(1) {
+		map_node(const value_type& e) :data(NULL), h(0), s(1), l(NULL), r(NULL), pr(NULL), nx(NULL) {
 			data = new value_type(e);
+			pull();
+			map_counters_type::made();
+		}
+		/**
+		 * take over an element built elsewhere.
+		 */
+		explicit map_node(value_type* d) :data(d), h(0), s(1), l(NULL), r(NULL), pr(NULL), nx(NULL) {
+			pull();
+			map_counters_type::made();
 		}
 		map_node operator =(const map_node& other) {
 			l = NULL; r = NULL; nx = NULL; pr = NULL; h = 0; s = 1;
 			data = new value_type(*other.data);
 		}
-		~map_node() { delete data; }
+		~map_node() {
+			delete data;
+			map_counters_type::gone();
+		}
 		int bd() {
 			int lh, rh;
 			if (l == NULL) lh = -1; else lh = l->h;
@@ -61,18 +375,25 @@ public:
 			if (r == NULL) rh = -1, rs = 0; else rh = r->h, rs = r->s;
 			if (lh > rh) h = lh + 1; else h = rh + 1;
 			s = ls + rs + 1;
+			pull();
+		}
+		void pull() {
+			aggregate_type a = Traits::template lift<Monoid>(*data);
+			if (l != NULL) a = Monoid::combine(l->get(), a);
+			if (r != NULL) a = Monoid::combine(a, r->get());
+			this->set(a);
 		}
 	};
 	class const_iterator;
 	class iterator {
-		friend class map;
+		friend class avl_tree;
 		friend class const_iterator;
 	private:
 		map_node* p;
-		const map* t;
+		const avl_tree* t;
 	public:
 		iterator():p(NULL),t(NULL) {}
-		iterator(map_node* p, const map* t) :p(p),t(t) {}
+		iterator(map_node* p, const avl_tree* t) :p(p),t(t) {}
 		iterator(const iterator &other) :p(other.p),t(other.t) {}
 		iterator(const const_iterator &other) :p(other.p),t(other.t) {}
 		/**
@@ -123,7 +444,7 @@ public:
 		/**
 		 * a operator to check whether two iterators are same (pointing to the same memory).
 		 */
-		value_type & operator*() const {
+		exposed_type & operator*() const {
 			return *(p->data);
 		}
 		bool operator==(const iterator &rhs) const {
@@ -145,21 +466,21 @@ public:
 		 * for the support of it->first.
 		 * See <http://kelvinh.github.io/blog/2013/11/20/overloading-of-member-access-operator-dash-greater-than-symbol-in-cpp/> for help.
 		 */
-		value_type* operator->() const noexcept {
+		exposed_type* operator->() const noexcept {
 			return p->data;
 		}
 	};
 	class const_iterator {
 		// it should has similar member method as iterator.
 		//  and it should be able to construct from an iterator.
-		friend class map;
+		friend class avl_tree;
 		friend class iterator;
 	private:
 		map_node* p;
-		const map* t;
+		const avl_tree* t;
 	public:
 		const_iterator() :p(NULL),t(NULL) {}
-		const_iterator(map_node* p,const map* t) :p(p),t(t) {}
+		const_iterator(map_node* p,const avl_tree* t) :p(p),t(t) {}
 		const_iterator(const const_iterator &other) :p(other.p),t(other.t) {}
 		const_iterator(const iterator &other) :p(other.p),t(other.t) {}
 		/**
@@ -232,79 +553,89 @@ public:
 		}
 	};
 	/**
-	 * TODO two constructors
+	 * owns an element taken out of a map by extract(), the node and the
+	 *   value are kept as they are so insert(node_type &&) needs neither an
+	 *   allocation nor a copy.  the element is destroyed with the handle.
 	 */
-	map() :head(NULL),bg(NULL),ed(NULL) {
-		bg = ed = new map_node;
-	}
-	map(const map &other):head(NULL),bg(NULL),ed(NULL) {
-		if (other.head == NULL) {
-			bg = ed = new map_node;
-			return;
+	class node_type {
+		friend class avl_tree;
+	private:
+		map_node* p;
+		explicit node_type(map_node* p) :p(p) {}
+	public:
+		node_type() :p(NULL) {}
+		node_type(node_type &&other) :p(other.p) { other.p = NULL; }
+		node_type & operator=(node_type &&other) {
+			if (this == &other) return *this;
+			delete p;
+			p = other.p;
+			other.p = NULL;
+			return *this;
 		}
-		head = new map_node(*other.head);
-		ed = new map_node;
-		copy(head, other.head);
-		map_node* his = NULL;
-		ldr(head, his);
-		his->nx = ed;
-		ed->pr = his;
-	}
+		node_type(const node_type &) = delete;
+		node_type & operator=(const node_type &) = delete;
+		~node_type() { delete p; }
+		bool empty() const { return p == NULL; }
+		explicit operator bool() const { return p != NULL; }
+		const Key & key() const { return key_of(p); }
+		typename Traits::mapped_type & mapped() const { return Traits::mapped(*p->data); }
+		value_type & value() const { return *p->data; }
+	};
 	/**
-	 * TODO assignment operator
+	 * TODO two constructors
 	 */
-	map & operator=(const map &other) {
-		if (this == &other) return *this;
-		clear();
-		if (other.head == NULL) {
-			return *this;
-		}
-		head = new map_node(*other.head);
-		copy(head, other.head);
-		map_node* his = NULL;
-		ldr(head, his);
-		his->nx = ed;
-		ed->pr = his;
-		return *this;
+	avl_tree() :head(NULL),bg(NULL),ed(NULL),ticket(0),fg(NULL) {
+		bg = ed = &tail;
+	}
+	avl_tree(const avl_tree &other):head(NULL),bg(NULL),ed(NULL),ticket(other.ticket),fg(NULL) {
+		bg = ed = &tail;
+		map_node *lo, *hi;
+		head = clone(other.head, lo, hi, fork_depth());
+		rethread(lo, hi);
 	}
 	/**
-	 * TODO Destructors
+	 * build from an ascending range in O(n), see assign_sorted.
 	 */
-	~map() {
-		clear();
-		delete ed;
+	template<class InputIt>
+	avl_tree(InputIt first, InputIt last) :head(NULL), bg(NULL), ed(NULL), ticket(0), fg(NULL) {
+		bg = ed = &tail;
+		assign_sorted(first, last);
 	}
 	/**
-	 * TODO
-	 * access specified element with bounds checking
-	 * Returns a reference to the mapped value of the element with key equivalent to key.
-	 * If no such element exists, an exception of type `index_out_of_bound'
+	 * take the elements of other in O(1), other is left empty.  the end
+	 *   sentinel lives in the map itself, so nothing is allocated for
+	 *   either side; iterators to the elements must be taken anew from
+	 *   the new owner.
 	 */
-	T & at(const Key &key) {
-		map_node* p = search(head, key);
-		if (p == NULL) throw index_out_of_bound("from map::at");
-		return (p->data->second);
-	}
-	const T & at(const Key &key) const {
-		map_node* p = search(head, key);
-		if (p == NULL) throw index_out_of_bound("from map::at");
-		return (p->data->second);
+	avl_tree(avl_tree &&other) noexcept :head(NULL), cmp(other.cmp), bg(NULL), ed(NULL), ticket(0), fg(NULL) {
+		bg = ed = &tail;
+		steal(other);
 	}
 	/**
-	 * TODO
-	 * access specified element
-	 * Returns a reference to the value that is mapped to a key equivalent to key,
-	 *   performing an insertion if such key does not already exist.
+	 * TODO assignment operator
 	 */
-	T & operator[](const Key &key) {
-		map_node* p = insert(pair<Key, T>(key, T())).first.p; //friendship required
-		return (p->data->second);
+	avl_tree & operator=(const avl_tree &other) {
+		if (this == &other) return *this;
+		clear();
+		ticket = other.ticket;
+		map_node *lo, *hi;
+		head = clone(other.head, lo, hi, fork_depth());
+		rethread(lo, hi);
+		return *this;
+	}
+	avl_tree & operator=(avl_tree &&other) noexcept {
+		if (this == &other) return *this;
+		clear();
+		steal(other);
+		return *this;
 	}
 	/**
-	 * behave like at() throw index_out_of_bound if such key does not exist.
+	 * TODO Destructors
 	 */
-	const T & operator[](const Key &key) const {
-		return at(key);
+	~avl_tree() {
+		settle();
+		clean(head);
+		delete fg;
 	}
 	/**
 	 * return a iterator to the beginning
@@ -325,15 +656,59 @@ public:
 	/**
 	 * returns the number of elements.
 	 */
-	size_t size() const { return (head == NULL) ? 0 : head->s; }
+	size_t size() const { return (head == NULL) ? 0 : head->s + pending(0); }
 	/**
 	 * clears the contents
 	 */
 	void clear() {
+		settle();
 		clean(head);
-		delete ed;
-		bg = ed = new map_node;
 		head = NULL;
+		rethread(NULL, NULL);
+	}
+	/**
+	 * replace the contents with an ascending range in O(n).
+	 * the nodes are threaded while reading, then a perfectly balanced tree
+	 *   is cut out of the thread without a single rotation.
+	 * repeated keys are collapsed to their first occurrence (kept in input
+	 *   order with Multi), a descending step throws runtime_error and
+	 *   leaves the map empty.
+	 */
+	template<class InputIt>
+	void assign_sorted(InputIt first, InputIt last) {
+		clear();
+		map_node *lo = NULL, *hi = NULL;
+		size_t n = 0;
+		try {
+			for (; first != last; ++first) {
+				map_node* p = new map_node(*first);
+				if (hi != NULL && !cmp(key_of(hi), key_of(p))) {
+					bool dup = !cmp(key_of(p), key_of(hi));
+					if (!dup || !Multi) {
+						delete p;
+						if (dup) continue;
+						throw runtime_error("from map::assign_sorted unsorted input");
+					}
+				}
+				p->stamp(ticket++);
+				p->pr = hi;
+				if (hi == NULL) lo = p; else hi->nx = p;
+				hi = p;
+				++n;
+			}
+		}
+		catch (...) {
+			while (lo != NULL) {
+				map_node* p = lo;
+				lo = lo->nx;
+				delete p;
+			}
+			throw;
+		}
+		map_node* cur = lo;
+		head = build(cur, n);
+		rethread(lo, hi);
+		changed();
 	}
 	/**
 	 * insert an element.
@@ -342,16 +717,82 @@ public:
 	 *   the second one is true if insert successfully, or false.
 	 */
 	pair<iterator, bool> insert(const value_type &value) {
-		map_node* p = search(head, value.first);
+		map_node* p = Multi ? NULL : search(head, Traits::key(value));
 		if (p != NULL) return pair<iterator, bool>(iterator(p, this), false);
-		p = insert(head, value);
-		if (head->s == 1) {
-			p->nx = ed;
-			ed->pr = p;
-			bg = p;
+		p = link(new map_node(value));
+		return pair<iterator, bool>(iterator(p, this), true);
+	}
+	/**
+	 * the same, the element is moved into the map.
+	 */
+	pair<iterator, bool> insert(value_type &&value) {
+		map_node* p = Multi ? NULL : search(head, Traits::key(value));
+		if (p != NULL) return pair<iterator, bool>(iterator(p, this), false);
+		p = link(make_node(std::move(value)));
+		return pair<iterator, bool>(iterator(p, this), true);
+	}
+	/**
+	 * build value_type(args...) in its node and insert it, the node is
+	 *   freed again if the key is present (the args are consumed anyway).
+	 */
+	template<class... Args>
+	pair<iterator, bool> emplace(Args&&... args) {
+		map_node* t = make_node(std::forward<Args>(args)...);
+		map_node* p;
+		try {
+			p = Multi ? NULL : search(head, key_of(t));
 		}
+		catch (...) {
+			delete t;
+			throw;
+		}
+		if (p != NULL) {
+			delete t;
+			return pair<iterator, bool>(iterator(p, this), false);
+		}
+		link(t);
+		return pair<iterator, bool>(iterator(t, this), true);
+	}
+	/**
+	 * relink the element owned by nh, no allocation and no copy.
+	 * if the key is already present nothing happens and nh keeps the element.
+	 * return the iterator to the element (or the one that prevented the insertion),
+	 *   and true if nh was consumed; an empty nh gives (end(), false).
+	 */
+	pair<iterator, bool> insert(node_type &&nh) {
+		if (nh.p == NULL) return pair<iterator, bool>(end(), false);
+		map_node* p = Multi ? NULL : search(head, key_of(nh.p));
+		if (p != NULL) return pair<iterator, bool>(iterator(p, this), false);
+		p = nh.p;
+		nh.p = NULL;
+		link(p);
 		return pair<iterator, bool>(iterator(p, this), true);
 	}
+	/**
+	 * insert an element, using hint (the element that should follow it) to
+	 *   skip the search.
+	 * the hint is checked against its neighbour on the thread; when it is
+	 *   right, value is not looked up a second time.  an append before end()
+	 *   goes to the bottom of the right spine, which the map keeps between
+	 *   appends (see spine), and climbs only while a subtree height
+	 *   changes: amortized O(1) with avl_balance and no aggregate.  with
+	 *   weight_balance or an aggregate, and for a prepend before begin(),
+	 *   it walks the whole spine without comparing any key, O(log n).
+	 * a wrong hint falls back to insert(value).  with Multi the element
+	 *   still goes after its equal keys, so only a hint just past them
+	 *   is right.
+	 * return the iterator to the new element or the one that prevented the insertion.
+	 */
+	iterator insert(iterator hint, const value_type &value) {
+		return insert_hint(hint, value);
+	}
+	iterator insert(iterator hint, value_type &&value) {
+		return insert_hint(hint, std::move(value));
+	}
+	template<class... Args>
+	iterator emplace_hint(iterator hint, Args&&... args) {
+		return insert_hint(hint, value_type(std::forward<Args>(args)...));
+	}
 	/**
 	 * erase the element at pos.
 	 *
@@ -361,8 +802,153 @@ public:
 		if (pos.t != this) throw invalid_iterator("from map::erase Not for this map");
 		if (pos.p == NULL) throw invalid_iterator("from map::erase NULL");
 		if (pos.p->data == NULL) throw invalid_iterator("from map::erase end()");
+		settle();
+		remove(head, pos.p);
+		delete pos.p;
+		changed();
+	}
+	/**
+	 * erase the elements in [first, last), return last.
+	 * the range is cut out with two splits and the rest joined back, the
+	 *   cut nodes are freed along the thread: O(log n + k) for k elements.
+	 */
+	iterator erase(iterator first, iterator last) {
+		if (first.t != this || last.t != this) throw invalid_iterator("from map::erase Not for this map");
+		if (first.p == NULL || last.p == NULL) throw invalid_iterator("from map::erase NULL");
+		if (first == last) return last;
+		if (first.p->data == NULL) throw invalid_iterator("from map::erase end()");
+		settle();
+		map_node* before = (first.p == bg) ? NULL : first.p->pr;
+		map_node *l, *mid, *r, *cut;
+		split(head, first.p, l, mid, r);
+		if (last.p != ed) {
+			split(r, last.p, cut, mid, r);
+			r = attach(NULL, mid, r);
+		}
+		else r = NULL;
+		for (map_node* p = first.p; p != last.p; ) {
+			map_node* q = p->nx;
+			delete p;
+			p = q;
+		}
+		if (l == NULL) head = r;
+		else {
+			if (r == NULL) head = l;
+			else {
+				map_node* k = pop_max(l);
+				head = attach(l, k, r);
+			}
+		}
+		last.p->pr = before;
+		if (before == NULL) bg = last.p; else before->nx = last.p;
+		changed();
+		return last;
+	}
+	/**
+	 * erase the elements with key, return the number erased (0 or 1
+	 *   unless Multi).
+	 */
+	size_t erase(const Key &key) {
+		if (Multi) {
+			iterator lo = lower_bound(key), hi = upper_bound(key);
+			size_t k = 0;
+			for (map_node* p = lo.p; p != hi.p; p = p->nx) k++;
+			erase(lo, hi);
+			return k;
+		}
+		map_node* p = search(head, key);
+		if (p == NULL) return 0;
+		settle();
+		remove(head, p);
+		delete p;
+		changed();
+		return 1;
+	}
+	/**
+	 * erase every element for which pred(const value_type &) is true,
+	 *   pred is called once per element in key order.
+	 * when the victims are so many that erasing them one by one
+	 *   (k log n) would cost more than a rebuild, the survivors are
+	 *   relinked along the thread and the tree is rebuilt in one O(n) pass.
+	 * return the number of elements erased.
+	 */
+	template<class Pred>
+	size_t erase_if(Pred pred) {
+		size_t n = size(), k = 0, c = 16;
+		map_node** v = new map_node*[c];
+		try {
+			for (map_node* p = bg; p != ed; p = p->nx) {
+				if (!pred(*p->data)) continue;
+				if (k == c) {
+					map_node** nv = new map_node*[c * 2];
+					for (size_t i = 0; i < k; i++) nv[i] = v[i];
+					delete[] v;
+					v = nv;
+					c *= 2;
+				}
+				v[k++] = p;
+			}
+		}
+		catch (...) {
+			delete[] v;
+			throw;
+		}
+		settle();
+		size_t lg = 1;
+		while (((size_t)1 << lg) < n) lg++;
+		if (k * lg <= n) {
+			for (size_t i = 0; i < k; i++) {
+				remove(head, v[i]);
+				delete v[i];
+			}
+		}
+		else {
+			map_node *lo = NULL, *hi = NULL;
+			size_t j = 0;
+			for (map_node* p = bg; p != ed; ) {
+				map_node* q = p->nx;
+				if (j < k && v[j] == p) {
+					delete p;
+					j++;
+				}
+				else {
+					p->pr = hi;
+					if (hi == NULL) lo = p; else hi->nx = p;
+					hi = p;
+				}
+				p = q;
+			}
+			map_node* cur = lo;
+			head = build(cur, n - k);
+			rethread(lo, hi);
+		}
+		delete[] v;
+		changed();
+		return k;
+	}
+	/**
+	 * unlink the element at pos and hand it over in a node handle,
+	 *   it can be put into another map by insert(node_type &&).
+	 */
+	node_type extract(iterator pos) {
+		if (pos.t != this) throw invalid_iterator("from map::extract Not for this map");
+		if (pos.p == NULL) throw invalid_iterator("from map::extract NULL");
+		if (pos.p->data == NULL) throw invalid_iterator("from map::extract end()");
+		settle();
 		remove(head, pos.p);
-		//checktree(head);
+		changed();
+		return node_type(pos.p);
+	}
+	/**
+	 * an empty handle if there is no such key, the first one with Multi.
+	 */
+	node_type extract(const Key &key) {
+		map_node* p = search(head, key);
+		if (p == NULL) return node_type();
+		settle();
+		remove(head, p);
+		changed();
+		return node_type(p);
 	}
 	/**
 	 * Returns the number of elements with key
@@ -372,6 +958,7 @@ public:
 	 * The default method of check the equivalence is !(a < b || b > a)
 	 */
 	size_t count(const Key &key) const {
+		if (Multi) return order(head, key, true) - order(head, key, false);
 		if (search(head, key) == NULL) return 0;
 		return 1;
 	}
@@ -380,6 +967,7 @@ public:
 	 * key value of the element to search for.
 	 * Iterator to an element with key equivalent to key.
 	 *   If no such element is found, past-the-end (see end()) iterator is returned.
+	 *   with Multi it is the first of the equal elements.
 	 */
 	iterator find(const Key &key) {
 		map_node* p = search(head, key);
@@ -393,6 +981,98 @@ public:
 		const_iterator it(p, this);
 		return it;
 	}
+	/**
+	 * out[i] = find(keys[i]) for i < n.
+	 * up to batch_width searches walk down the tree together, each taking
+	 *   one step per round: a step that reaches a node prefetches the
+	 *   element behind it, the next compares and prefetches the child, so
+	 *   the cache misses of the searches overlap instead of queueing one
+	 *   after another.  it pays off once the map is larger than the cache,
+	 *   on a small one it costs about as much as n calls to find().
+	 */
+	void find_batch(const Key* keys, size_t n, iterator* out) {
+		search_batch(keys, n, out);
+	}
+	void find_batch(const Key* keys, size_t n, const_iterator* out) const {
+		search_batch(keys, n, out);
+	}
+	/**
+	 * the first element whose key is not less than key (lower_bound),
+	 *   or greater than key (upper_bound), or end().
+	 */
+	iterator lower_bound(const Key &key) {
+		map_node* p = bound(head, key, false);
+		return iterator(p == NULL ? ed : p, this);
+	}
+	const_iterator lower_bound(const Key &key) const {
+		map_node* p = bound(head, key, false);
+		return const_iterator(p == NULL ? ed : p, this);
+	}
+	iterator upper_bound(const Key &key) {
+		map_node* p = bound(head, key, true);
+		return iterator(p == NULL ? ed : p, this);
+	}
+	const_iterator upper_bound(const Key &key) const {
+		map_node* p = bound(head, key, true);
+		return const_iterator(p == NULL ? ed : p, this);
+	}
+	/**
+	 * heterogeneous lookup: when Compare declares is_transparent (like
+	 *   std::less<>), a key of any type K that Compare can order against Key
+	 *   is used as it is, e.g. a const char* or a string view for a map of
+	 *   std::string, so no temporary Key is built per call.
+	 */
+	template<class K, class C = Compare, class = typename C::is_transparent>
+	size_t count(const K &key) const {
+		if (Multi) return order(head, key, true) - order(head, key, false);
+		return (search(head, key) == NULL) ? 0 : 1;
+	}
+	template<class K, class C = Compare, class = typename C::is_transparent>
+	iterator find(const K &key) {
+		map_node* p = search(head, key);
+		return iterator(p == NULL ? ed : p, this);
+	}
+	template<class K, class C = Compare, class = typename C::is_transparent>
+	const_iterator find(const K &key) const {
+		map_node* p = search(head, key);
+		return const_iterator(p == NULL ? ed : p, this);
+	}
+	template<class K, class C = Compare, class = typename C::is_transparent>
+	iterator lower_bound(const K &key) {
+		map_node* p = bound(head, key, false);
+		return iterator(p == NULL ? ed : p, this);
+	}
+	template<class K, class C = Compare, class = typename C::is_transparent>
+	const_iterator lower_bound(const K &key) const {
+		map_node* p = bound(head, key, false);
+		return const_iterator(p == NULL ? ed : p, this);
+	}
+	template<class K, class C = Compare, class = typename C::is_transparent>
+	iterator upper_bound(const K &key) {
+		map_node* p = bound(head, key, true);
+		return iterator(p == NULL ? ed : p, this);
+	}
+	template<class K, class C = Compare, class = typename C::is_transparent>
+	const_iterator upper_bound(const K &key) const {
+		map_node* p = bound(head, key, true);
+		return const_iterator(p == NULL ? ed : p, this);
+	}
+	/**
+	 * [lower_bound(key), upper_bound(key)), O(log n + k) to walk.
+	 */
+	pair<iterator, iterator> equal_range(const Key &key) {
+		return pair<iterator, iterator>(lower_bound(key), upper_bound(key));
+	}
+	pair<const_iterator, const_iterator> equal_range(const Key &key) const {
+		return pair<const_iterator, const_iterator>(lower_bound(key), upper_bound(key));
+	}
+	/**
+	 * the number of elements with key less than key, in O(log n) from the
+	 *   subtree sizes; rank(order_of_key(key) + 1) is lower_bound(key).
+	 */
+	size_t order_of_key(const Key &key) const {
+		return order(head, key, false);
+	}
 	iterator rank(int t) {
 		map_node* p = find_rank(head, t);
 		if (p == NULL) return end();
@@ -405,25 +1085,274 @@ public:
 		const_iterator it(p, this);
 		return it;
 	}
-private:
-	map_node* head;
-	Compare cmp;
-	map_node *bg, *ed;
-	void remove(map_node* &nw, map_node* t) {
-		if (nw == NULL) return;
-		if (cmp(t->data->first, nw->data->first)) {
-			remove(nw->l, t);
-			adjust(nw);
+	/**
+	 * bulk set operations built on join/split, they cost
+	 *   O(m log(n / m + 1)) comparisons for maps of size n and m instead of
+	 *   m insertions, and fix the nx/pr thread only at the seams.
+	 * independent subtrees are processed by separate threads once they are
+	 *   large enough, so Compare must be safe to call concurrently.
+	 *
+	 * union_with moves every element of other whose key is absent here into
+	 *   this map (no copy, no allocation), the rest is destroyed and other
+	 *   is left empty.  on equal keys the element of this map is kept.
+	 */
+	void union_with(avl_tree &other) {
+		static_assert(!Multi, "union_with needs unique keys");
+		if (this == &other) return;
+		settle();
+		other.settle();
+		map_node *lo, *hi;
+		head = unite(head, other.head, lo, hi, fork_depth());
+		other.head = NULL;
+		other.rethread(NULL, NULL);
+		rethread(lo, hi);
+		changed();
+	}
+	/**
+	 * keep only the elements whose key is also in other.
+	 */
+	void intersect_with(const avl_tree &other) {
+		static_assert(!Multi, "intersect_with needs unique keys");
+		if (this == &other) return;
+		settle();
+		map_node *lo, *hi;
+		head = intersect(head, other.head, lo, hi, fork_depth());
+		rethread(lo, hi);
+		changed();
+	}
+	/**
+	 * drop the elements whose key is in other.
+	 */
+	void difference_with(const avl_tree &other) {
+		static_assert(!Multi, "difference_with needs unique keys");
+		if (this == &other) {
+			clear();
+			return;
 		}
-		else {
-			if (cmp(nw->data->first, t->data->first)) {
-				remove(nw->r, t);
-				adjust(nw);
-			}
-			else {
-				if ((nw->l != NULL) && (nw->r != NULL)) {
-					map_node* p = nw->nx; //stable iterator!!!!!!
-					//value_type* temp = nw->data; nw->data = p->data; p->data = temp;
+		settle();
+		map_node *lo, *hi;
+		head = difference(head, other.head, lo, hi, fork_depth());
+		rethread(lo, hi);
+		changed();
+	}
+	/**
+	 * move the elements with key not less than key into other (whose old
+	 *   content is cleared), in O(log n).
+	 */
+	void split_at(const Key &key, avl_tree &other) {
+		if (this == &other) throw runtime_error("from map::split_at same map");
+		other.clear();
+		map_node* k = bound(head, key, false);
+		if (k == NULL) return;
+		settle();
+		map_node *l, *mid, *r;
+		split(head, k, l, mid, r);
+		if (mid != NULL) r = attach(NULL, mid, r);
+		head = l;
+		other.head = r;
+		rethread(head == NULL ? NULL : leftmost(head), head == NULL ? NULL : rightmost(head));
+		other.rethread(r == NULL ? NULL : leftmost(r), r == NULL ? NULL : rightmost(r));
+		changed();
+		other.changed();
+	}
+	/**
+	 * combine the elements with lo <= key < hi in key order, in O(log n).
+	 */
+	aggregate_type aggregate(const Key &lo, const Key &hi) const {
+		map_node* t = head;
+		while (t != NULL) {
+			if (cmp(key_of(t), lo)) t = t->r;
+			else {
+				if (!cmp(key_of(t), hi)) t = t->l;
+				else break;
+			}
+		}
+		if (t == NULL) return Monoid::identity();
+		aggregate_type a = Traits::template lift<Monoid>(*t->data);
+		a = Monoid::combine(suffix(t->l, lo), a);
+		return Monoid::combine(a, prefix(t->r, hi));
+	}
+	/**
+	 * combine all the elements.
+	 */
+	aggregate_type aggregate() const {
+		if (head == NULL) return Monoid::identity();
+		return head->get();
+	}
+	/**
+	 * call f(const value_type &) in key order on the elements with key < hi
+	 *   for which keep(Monoid::lift(element)) holds.  a subtree whose
+	 *   aggregate fails keep is skipped whole, so keep must only fail on an
+	 *   aggregate when it fails on every element below it (like "max > x"
+	 *   for aggregate_max); then every visited subtree holds a hit or lies
+	 *   on the path to hi.
+	 */
+	template<class Keep, class F>
+	void walk_pruned(const Key &hi, Keep keep, F f) const {
+		walk_pruned(head, hi, keep, f);
+	}
+	/**
+	 * run f(mapped value &) on the element at pos and recompute the
+	 *   aggregates above it, in O(log n) besides f.  with an aggregate this
+	 *   is the way to change an element in place, iterators, at() and
+	 *   operator[] only read.  the aggregates are recomputed even if f throws.
+	 */
+	template<class F>
+	void update(const_iterator pos, F f) {
+		if (pos.t != this) throw invalid_iterator("from map::update Not for this map");
+		if (pos.p == NULL || pos.p->data == NULL) throw invalid_iterator("from map::update end()");
+		try {
+			f(Traits::mapped(*pos.p->data));
+		}
+		catch (...) {
+			refresh(head, pos.p);
+			throw;
+		}
+		refresh(head, pos.p);
+	}
+	/**
+	 * recompute the aggregates above pos after its mapped value was changed
+	 *   in place some other way, in O(log n).
+	 */
+	void refresh(const_iterator pos) {
+		if (pos.t != this) throw invalid_iterator("from map::refresh Not for this map");
+		if (pos.p == NULL || pos.p->data == NULL) throw invalid_iterator("from map::refresh end()");
+		refresh(head, pos.p);
+	}
+	/**
+	 * the counters since construction (or copy) or the last reset_stats(),
+	 *   see map_stats.  the heights are filled in even without SJTU_MAP_STATS.
+	 */
+	map_stats stats() const {
+		map_stats r;
+		counters.get(r);
+		r.size = size();
+		r.height = height(head);
+		r.ideal_height = -1;
+		for (size_t n = r.size; n > 0; n >>= 1) r.ideal_height++;
+		if (r.peak_height < r.height) r.peak_height = r.height;
+		return r;
+	}
+	void reset_stats() {
+		counters.reset();
+	}
+	/**
+	 * walk the whole map and throw runtime_error at the first broken
+	 *   invariant: the key order, the balance, h and s of every node,
+	 *   the nx/pr thread with bg and ed, and the spine kept by appends.
+	 *   O(n).
+	 */
+	void validate() const {
+		if (ed == NULL || ed->data != NULL || ed->nx != NULL) throw runtime_error("from map::validate bad end");
+		if (fg != NULL && fg->d > 0) {
+			const map_node* p = head;
+			for (int i = 0; i < fg->d; i++, p = p->r) {
+				if (fg->node[i] != p) throw runtime_error("from map::validate broken spine");
+			}
+			if (p != NULL) throw runtime_error("from map::validate broken spine");
+		}
+		const map_node* last = NULL;
+		checktree(head, last, 0);
+		if (last == NULL ? (bg != ed) : (last->nx != ed)) throw runtime_error("from map::validate broken thread");
+		if (ed->pr != last) throw runtime_error("from map::validate broken thread");
+	}
+protected:
+	map_node* head;
+	Compare cmp;
+	map_node *bg, *ed;
+	// the next insertion stamp, see order_slot
+	unsigned long long ticket;
+	/**
+	 * the right spine of the tree while appends at end() go on (see
+	 *   insert_hint): node[0] is head, node[i + 1] is node[i]->r and
+	 *   node[d - 1] the last element.  an append climbs only while a height
+	 *   changes, so the s of node[i] misses the appends made since seen[i]:
+	 *   its size is s + appends - seen[i], every other node is exact.
+	 *   settle() writes the missing counts back before any other change of
+	 *   the tree, d is 0 when nothing is pending.  a const call only reads.
+	 * an int s keeps an avl tree below 46 levels, depth leaves room.
+	 */
+	class spine {
+	public:
+		static const int depth = 64;
+		map_node* node[depth];
+		size_t seen[depth];
+		int d;
+		size_t appends;
+		spine() :d(0), appends(0) {}
+	};
+	// made by the first append, only where spine_appends holds
+	spine* fg;
+	static const bool spine_appends = Balance::by_height && std::is_same<Monoid, no_aggregate>::value;
+	mutable map_counters_type counters;
+	// the end sentinel, ed points at it
+	map_node tail;
+	/**
+	 * recheck the subtree nw in order, last is the node visited before it;
+	 *   every node must follow last both in key order and on the thread.
+	 *   lvl is the spine level of nw, -1 off the right spine.
+	 */
+	void checktree(const map_node* nw, const map_node* &last, int lvl) const {
+		if (nw == NULL) return;
+		if (nw->data == NULL) throw runtime_error("from map::validate sentinel in the tree");
+		checktree(nw->l, last, -1);
+		if (last == NULL ? (bg != nw || nw->pr != NULL) : (last->nx != nw || nw->pr != last))
+			throw runtime_error("from map::validate broken thread");
+		if (last != NULL && !before(last, nw)) throw runtime_error("from map::validate out of order");
+		last = nw;
+		int rl = (lvl < 0) ? -1 : lvl + 1;
+		checktree(nw->r, last, rl);
+		int lh = height(nw->l), rh = height(nw->r);
+		if (Balance::heavy(nw->l, nw->r) || Balance::heavy(nw->r, nw->l)) throw runtime_error("from map::validate out of balance");
+		if (nw->h != ((lh > rh) ? lh : rh) + 1) throw runtime_error("from map::validate bad h");
+		if (nw->s + pending(lvl) != ((nw->l == NULL) ? 0 : nw->l->s) + ((nw->r == NULL) ? 0 : nw->r->s + pending(rl)) + 1)
+			throw runtime_error("from map::validate bad s");
+	}
+	/**
+	 * the appends that spine level i misses in s, 0 off the spine.
+	 */
+	size_t pending(int i) const {
+		return (fg == NULL || i < 0 || i >= fg->d) ? 0 : fg->appends - fg->seen[i];
+	}
+	void settle() noexcept {
+		if (fg == NULL) return;
+		for (int i = 0; i < fg->d; i++) fg->node[i]->s += (int)(fg->appends - fg->seen[i]);
+		fg->d = 0;
+	}
+	/**
+	 * called after every change of the tree: tracks the peak height, and
+	 *   revalidates everything under SJTU_MAP_DEBUG.
+	 */
+	void changed() {
+		counters.grown(height(head));
+#ifdef SJTU_MAP_DEBUG
+		validate();
+#endif
+	}
+	static const Key & key_of(const map_node* p) { return Traits::key(*p->data); }
+	/**
+	 * the tree order of two nodes: by key, then by stamp with Multi.
+	 */
+	bool before(const map_node* a, const map_node* b) const {
+		if (cmp(key_of(a), key_of(b))) return true;
+		if (!Multi || cmp(key_of(b), key_of(a))) return false;
+		return a->stamp() < b->stamp();
+	}
+	void remove(map_node* &nw, map_node* t) {
+		if (nw == NULL) return;
+		if (before(t, nw)) {
+			remove(nw->l, t);
+			adjust(nw);
+		}
+		else {
+			if (before(nw, t)) {
+				remove(nw->r, t);
+				adjust(nw);
+			}
+			else {
+				if ((nw->l != NULL) && (nw->r != NULL)) {
+					map_node* p = nw->nx; //stable iterator!!!!!!
+					//value_type* temp = nw->data; nw->data = p->data; p->data = temp;
 					int hh = nw->h; nw->h = p->h; p->h = hh;
 					hh = nw->s; nw->s = p->s; p->s = hh;
 					map_node* q;
@@ -456,23 +1385,24 @@ private:
 						nw->nx->pr = nw->pr;
 					}
 					if (nw->l == NULL) nw = nw->r; else nw = nw->l;
-				//	std::cout << "delete " << p->data->second << std::endl;
-					delete p;
+					// the caller owns p now
+					p->l = p->r = p->pr = p->nx = NULL;
+					p->h_update();
 				}
 			}
 		}
 	}
-	map_node* insert(map_node* &nw, const value_type& v) {
+	map_node* insert(map_node* &nw, map_node* t) {
 		map_node* x;
 		bool rm;
 		if (nw == NULL) {
-			nw = new map_node(v);
+			nw = t;
 			return nw;
 		}
 		else {
-			if (cmp(v.first, nw->data->first)) {
+			if (before(t, nw)) {
 				rm = (nw->l == NULL) ? 1 : 0;
-				x = insert(nw->l, v);
+				x = insert(nw->l, t);
 				if (rm) {
 					x->nx = nw;
 					x->pr = nw->pr;
@@ -484,37 +1414,337 @@ private:
 						bg = x;
 					}
 				}
-				maintain(nw, v);
+				adjust(nw);
 				return x;
 			}
 			else {
 				rm = (nw->r == NULL) ? 1 : 0;
-				x = insert(nw->r, v);
+				x = insert(nw->r, t);
 				if (rm) {
 					x->pr = nw;
 					x->nx = nw->nx;
 					nw->nx = x;
 					x->nx->pr = x;
 				}
-				maintain(nw, v);
+				adjust(nw);
 				return x;
 			}
 		}
 	}
-	map_node* search(map_node* nw, const Key &key) const {
-		if (nw == NULL) return NULL;
-		if (cmp(nw->data->first, key)) {
-			return search(nw->r, key);
+	/**
+	 * a detached node holding value_type(args...).
+	 */
+	template<class... Args>
+	static map_node* make_node(Args&&... args) {
+		value_type* v = new value_type(std::forward<Args>(args)...);
+		try {
+			return new map_node(v);
+		}
+		catch (...) {
+			delete v;
+			throw;
+		}
+	}
+	/**
+	 * insert(hint, value) for a const or a moved value.
+	 */
+	template<class V>
+	iterator insert_hint(iterator hint, V &&value) {
+		if (hint.t != this || hint.p == NULL) throw invalid_iterator("from map::insert hint");
+		map_node* nxt = hint.p;
+		map_node* prv = (nxt == bg) ? NULL : nxt->pr;
+		if (prv != NULL && !cmp(key_of(prv), Traits::key(value))) {
+			if (!Multi && !cmp(Traits::key(value), key_of(prv))) return iterator(prv, this);
+			if (!Multi || cmp(Traits::key(value), key_of(prv))) return insert(std::forward<V>(value)).first;
+		}
+		if (nxt != ed && !cmp(Traits::key(value), key_of(nxt))) {
+			if (!Multi && !cmp(key_of(nxt), Traits::key(value))) return iterator(nxt, this);
+			return insert(std::forward<V>(value)).first;
+		}
+		bool spine_append = spine_appends && nxt == ed;
+		if (spine_append && fg == NULL) fg = new spine;
+		if (!spine_append) settle();
+		map_node* p = make_node(std::forward<V>(value));
+		p->stamp(ticket++);
+		if (nxt == ed) {
+			if (spine_append) append(p); else push_back(head, p);
+			p->pr = prv;
+			p->nx = ed;
+			ed->pr = p;
+			if (prv == NULL) bg = p; else prv->nx = p;
 		}
 		else {
-			if (cmp(key, nw->data->first)) {
-				return search(nw->l, key);
+			if (prv == NULL) {
+				push_front(head, p);
+				p->nx = bg;
+				bg->pr = p;
+				bg = p;
+			}
+			else {
+				insert(head, p);
+			}
+		}
+		changed();
+		return iterator(p, this);
+	}
+	/**
+	 * take over the elements of other, this map must be empty.
+	 */
+	void steal(avl_tree &other) noexcept {
+		other.settle();
+		head = other.head;
+		ticket = other.ticket;
+		if (head != NULL) {
+			bg = other.bg;
+			ed->pr = other.ed->pr;
+			ed->pr->nx = ed;
+		}
+		other.head = NULL;
+		other.bg = other.ed;
+		other.ed->pr = NULL;
+	}
+	/**
+	 * put a node whose key is absent (or any node with Multi) into the tree
+	 *   and the thread, it goes after its equal keys.
+	 */
+	map_node* link(map_node* t) {
+		settle();
+		t->stamp(ticket++);
+		insert(head, t);
+		if (head->s == 1) {
+			t->nx = ed;
+			ed->pr = t;
+			bg = t;
+		}
+		changed();
+		return t;
+	}
+	/**
+	 * hang t below the last node through the spine, the levels above the
+	 *   first one whose height stays the same are left to settle().  the
+	 *   caller links the thread.
+	 * only a right child grows, so the rotations are RR and RL: RR lifts
+	 *   the next level and the spine gets one shorter, RL lifts the inner
+	 *   grandchild and keeps the length.  the node turned off the spine is
+	 *   recomputed from exact children.
+	 */
+	void append(map_node* t) {
+		spine &f = *fg;
+		if (f.d == 0) {
+			for (map_node* p = head; p != NULL; p = p->r) {
+				f.node[f.d] = p;
+				f.seen[f.d] = f.appends;
+				f.d++;
+			}
+		}
+		if (f.d == spine::depth) {
+			settle();
+			push_back(head, t);
+			return;
+		}
+		f.appends++;
+		f.node[f.d] = t;
+		f.seen[f.d] = f.appends;
+		if (f.d == 0) {
+			head = t;
+			f.d = 1;
+			return;
+		}
+		f.node[f.d - 1]->r = t;
+		f.d++;
+		for (int i = f.d - 2; i >= 0; i--) {
+			map_node* &x = (i == 0) ? head : f.node[i - 1]->r;
+			int h = x->h;
+			// the levels below are exact by now
+			x->h_update();
+			f.seen[i] = f.appends;
+			if (Balance::heavy(x->r, x->l)) {
+				if (Balance::outer(x->r, false)) {
+					RR(x);
+					for (int j = i + 1; j + 1 < f.d; j++) {
+						f.node[j] = f.node[j + 1];
+						f.seen[j] = f.seen[j + 1];
+					}
+					f.d--;
+				}
+				else {
+					RL(x);
+					f.node[i + 1] = x->r;
+					f.seen[i + 1] = f.appends;
+				}
+				f.node[i] = x;
+			}
+			if (x->h == h) return;
+		}
+	}
+	/**
+	 * hang t below the last (first) node, the path is the right (left)
+	 *   spine so no key is compared.  the caller links the thread.
+	 */
+	void push_back(map_node* &nw, map_node* t) {
+		if (nw == NULL) {
+			nw = t;
+			return;
+		}
+		push_back(nw->r, t);
+		adjust(nw);
+	}
+	void push_front(map_node* &nw, map_node* t) {
+		if (nw == NULL) {
+			nw = t;
+			return;
+		}
+		push_front(nw->l, t);
+		adjust(nw);
+	}
+	template<class K>
+	map_node* search(map_node* nw, const K &key) const {
+		map_node* p = NULL;
+		int c = 0, d = 0;
+		while (nw != NULL) {
+			d++;
+			c++;
+			if (cmp(key_of(nw), key)) {
+				nw = nw->r;
 			}
 			else {
-				return nw;
+				c++;
+				if (cmp(key, key_of(nw))) {
+					nw = nw->l;
+				}
+				else {
+					// with Multi go on for the first of the equal keys
+					p = nw;
+					if (!Multi) break;
+					nw = nw->l;
+				}
+			}
+		}
+		counters.searched(c, d);
+		return p;
+	}
+	static const size_t batch_width = 32;
+	/**
+	 * the interleaved searches of find_batch.  a slot holds one search:
+	 *   the key index (n when idle), the node it is at (NULL when done),
+	 *   whether the element of that node was prefetched already, and the
+	 *   last match.
+	 */
+	template<class It>
+	void search_batch(const Key* keys, size_t n, It* out) const {
+		size_t at[batch_width];
+		map_node *cur[batch_width], *got[batch_width];
+		bool ready[batch_width];
+		int c[batch_width], d[batch_width];
+		size_t next = 0, live = 0;
+		for (size_t j = 0; j < batch_width; j++) {
+			at[j] = n;
+			if (next == n) continue;
+			at[j] = next++;
+			cur[j] = head; got[j] = NULL; ready[j] = false; c[j] = d[j] = 0;
+			live++;
+		}
+		while (live > 0) {
+			for (size_t j = 0; j < batch_width; j++) {
+				if (at[j] == n) continue;
+				map_node* p = cur[j];
+				if (p != NULL) {
+					if (!ready[j]) {
+						SJTU_PREFETCH(p->data);
+						ready[j] = true;
+						continue;
+					}
+					ready[j] = false;
+					d[j]++;
+					c[j]++;
+					const Key &key = keys[at[j]];
+					if (cmp(key_of(p), key)) p = p->r;
+					else {
+						c[j]++;
+						if (cmp(key, key_of(p))) p = p->l;
+						else {
+							// with Multi go on for the first of the equal keys
+							got[j] = p;
+							p = Multi ? p->l : NULL;
+						}
+					}
+					cur[j] = p;
+					if (p != NULL) {
+						SJTU_PREFETCH(p);
+						continue;
+					}
+				}
+				counters.searched(c[j], d[j]);
+				out[at[j]] = It(got[j] == NULL ? ed : got[j], this);
+				if (next == n) {
+					at[j] = n;
+					live--;
+					continue;
+				}
+				at[j] = next++;
+				cur[j] = head; got[j] = NULL; ready[j] = false; c[j] = d[j] = 0;
 			}
 		}
 	}
+	/**
+	 * the number of elements with key < key (<= key when upper).
+	 */
+	template<class K>
+	size_t order(map_node* nw, const K &key, bool upper) const {
+		size_t k = 0;
+		while (nw != NULL) {
+			if (upper ? !cmp(key, key_of(nw)) : cmp(key_of(nw), key)) {
+				k += (nw->l == NULL) ? 1 : nw->l->s + 1;
+				nw = nw->r;
+			}
+			else nw = nw->l;
+		}
+		return k;
+	}
+	template<class K>
+	map_node* bound(map_node* nw, const K &key, bool upper) const {
+		map_node* p = NULL;
+		int d = 0;
+		while (nw != NULL) {
+			d++;
+			if (upper ? cmp(key, key_of(nw)) : !cmp(key_of(nw), key)) {
+				p = nw;
+				nw = nw->l;
+			}
+			else nw = nw->r;
+		}
+		counters.searched(d, d);
+		return p;
+	}
+	aggregate_type suffix(map_node* nw, const Key &lo) const {
+		if (nw == NULL) return Monoid::identity();
+		if (cmp(key_of(nw), lo)) return suffix(nw->r, lo);
+		aggregate_type a = Monoid::combine(suffix(nw->l, lo), Traits::template lift<Monoid>(*nw->data));
+		if (nw->r != NULL) a = Monoid::combine(a, nw->r->get());
+		return a;
+	}
+	aggregate_type prefix(map_node* nw, const Key &hi) const {
+		if (nw == NULL) return Monoid::identity();
+		if (!cmp(key_of(nw), hi)) return prefix(nw->l, hi);
+		aggregate_type a = Traits::template lift<Monoid>(*nw->data);
+		if (nw->l != NULL) a = Monoid::combine(nw->l->get(), a);
+		return Monoid::combine(a, prefix(nw->r, hi));
+	}
+	template<class Keep, class F>
+	void walk_pruned(map_node* nw, const Key &hi, Keep &keep, F &f) const {
+		if (nw == NULL || !keep(nw->get())) return;
+		walk_pruned(nw->l, hi, keep, f);
+		if (!cmp(key_of(nw), hi)) return;
+		if (keep(Traits::template lift<Monoid>(*nw->data))) f(*nw->data);
+		walk_pruned(nw->r, hi, keep, f);
+	}
+	void refresh(map_node* nw, const map_node* t) {
+		if (before(t, nw)) refresh(nw->l, t);
+		else {
+			if (before(nw, t)) refresh(nw->r, t);
+		}
+		nw->pull();
+	}
 	map_node* find_rank(map_node* nw, int s) const {
 		if (nw == NULL) return NULL;
 		if (nw->l == NULL) {
@@ -525,37 +1755,286 @@ private:
 		if (s == nw->l->s + 1) return nw;
 		return find_rank(nw->r, s - 1 - nw->l->s);
 	}
-	void copy(map_node* nw, map_node* ori) {
-		if (ori->l != NULL) {
-			nw->l = new map_node(*(ori->l));
-			copy(nw->l, ori->l);
+	/**
+	 * a copy of the subtree ori with the same shape, threaded inside; its
+	 *   lowest and highest node are returned in lo/hi.  the two sides are
+	 *   copied by separate threads once they are large enough (see
+	 *   union_with), and joined to the copy of ori in O(1).
+	 * if copying an element throws, everything copied so far is freed.
+	 */
+	map_node* clone(const map_node* ori, map_node* &lo, map_node* &hi, int depth) {
+		if (ori == NULL) {
+			lo = hi = NULL;
+			return NULL;
 		}
-		if (ori->r != NULL) {
-			nw->r = new map_node(*(ori->r));
-			copy(nw->r, ori->r);
+		map_node* nw = new map_node(*ori);
+		map_node *llo, *lhi, *rlo, *rhi;
+		try {
+			fork(forkable(depth, NULL, ori),
+				[&]() { nw->l = clone(ori->l, llo, lhi, depth - 1); },
+				[&]() { nw->r = clone(ori->r, rlo, rhi, depth - 1); });
+		}
+		catch (...) {
+			// a side that returned is a whole threaded copy, one that threw freed its own
+			clean(nw->l);
+			clean(nw->r);
+			delete nw;
+			throw;
 		}
 		nw->h_update();
+		nw->pr = lhi;
+		if (lhi != NULL) lhi->nx = nw;
+		nw->nx = rlo;
+		if (rlo != NULL) rlo->pr = nw;
+		lo = (llo == NULL) ? nw : llo;
+		hi = (rhi == NULL) ? nw : rhi;
+		return nw;
 	}
-	void ldr(map_node* nw, map_node* &his) {
-		if (nw->l != NULL) {
-			ldr(nw->l, his);
+	/**
+	 * free the subtree x by walking its thread, a subtree is a contiguous
+	 *   run of it (also for the pieces of a split), so no stack is needed.
+	 */
+	void clean(map_node* x) {
+		if (x == NULL) return;
+		map_node* p = leftmost(x);
+		for (int n = x->s; n > 0; n--) {
+			map_node* q = p->nx;
+			delete p;
+			p = q;
 		}
-		if (his == NULL) bg = nw;
-		nw->pr = his;
-		if (his != NULL) his->nx = nw;
-		his = nw;
-		if (nw->r != NULL) {
-			ldr(nw->r, his);
+	}
+	/**
+	 * join/split primitives.
+	 * attach(l, k, r) needs every key of l < k < every key of r and builds
+	 *   a balanced tree in O(|h(l) - h(r)| + 1), leaving the thread alone.
+	 * split cuts t into the nodes before k, the node equal to k (or NULL)
+	 *   and the nodes after k (see before(), k need not be in t); the pieces are contiguous runs of the old order, so
+	 *   their inner threads stay valid and only their ends dangle.
+	 * the set operations return the lowest and highest node of the result
+	 *   in lo/hi, which lets join relink the thread in O(1).
+	 */
+	static int height(map_node* t) { return (t == NULL) ? -1 : t->h; }
+	static map_node* leftmost(map_node* t) {
+		while (t->l != NULL) t = t->l;
+		return t;
+	}
+	static map_node* rightmost(map_node* t) {
+		while (t->r != NULL) t = t->r;
+		return t;
+	}
+	map_node* attach(map_node* l, map_node* k, map_node* r) {
+		if (Balance::heavy(l, r)) {
+			l->r = attach(l->r, k, r);
+			adjust(l);
+			return l;
 		}
+		if (Balance::heavy(r, l)) {
+			r->l = attach(l, k, r->l);
+			adjust(r);
+			return r;
+		}
+		k->l = l;
+		k->r = r;
+		k->h_update();
+		return k;
 	}
-	void clean(map_node* x) {
-		if (x == NULL) return;
-		clean(x->l);
-		clean(x->r);
-		delete x;
+	void split(map_node* t, const map_node* k, map_node* &l, map_node* &mid, map_node* &r) {
+		if (t == NULL) {
+			l = mid = r = NULL;
+			return;
+		}
+		map_node *tl = t->l, *tr = t->r;
+		if (before(k, t)) {
+			split(tl, k, l, mid, r);
+			r = attach(r, t, tr);
+		}
+		else {
+			if (before(t, k)) {
+				split(tr, k, l, mid, r);
+				l = attach(tl, t, l);
+			}
+			else {
+				l = tl; mid = t; r = tr;
+				t->l = t->r = NULL;
+				t->h_update();
+			}
+		}
+	}
+	map_node* pop_max(map_node* &t) {
+		map_node* k;
+		if (t->r == NULL) {
+			k = t;
+			t = t->l;
+			k->l = NULL;
+			return k;
+		}
+		k = pop_max(t->r);
+		adjust(t);
+		return k;
+	}
+	map_node* join(map_node* l, map_node* llo, map_node* lhi, map_node* k,
+		map_node* r, map_node* rlo, map_node* rhi, map_node* &lo, map_node* &hi) {
+		k->pr = lhi;
+		if (lhi != NULL) lhi->nx = k;
+		k->nx = rlo;
+		if (rlo != NULL) rlo->pr = k;
+		lo = (l == NULL) ? k : llo;
+		hi = (r == NULL) ? k : rhi;
+		return attach(l, k, r);
+	}
+	map_node* join2(map_node* l, map_node* llo, map_node* lhi,
+		map_node* r, map_node* rlo, map_node* rhi, map_node* &lo, map_node* &hi) {
+		if (l == NULL) {
+			lo = rlo; hi = rhi;
+			return r;
+		}
+		if (r == NULL) {
+			lo = llo; hi = lhi;
+			return l;
+		}
+		lhi->nx = rlo;
+		rlo->pr = lhi;
+		lo = llo; hi = rhi;
+		map_node* k = pop_max(l);
+		return attach(l, k, r);
+	}
+	/**
+	 * turn the next n nodes of the thread starting at cur into a perfectly
+	 *   balanced tree, cur ends up after them.
+	 */
+	map_node* build(map_node* &cur, size_t n) {
+		if (n == 0) return NULL;
+		map_node* l = build(cur, n / 2);
+		map_node* t = cur;
+		cur = cur->nx;
+		t->l = l;
+		t->r = build(cur, n - n / 2 - 1);
+		t->h_update();
+		return t;
+	}
+	static void ends(map_node* t, map_node* &lo, map_node* &hi) {
+		if (t == NULL) lo = hi = NULL;
+		else lo = leftmost(t), hi = rightmost(t);
+	}
+	/**
+	 * set bg/ed after a bulk operation, lo/hi are the ends of head.
+	 */
+	void rethread(map_node* lo, map_node* hi) {
+		if (head == NULL) {
+			bg = ed;
+			ed->pr = NULL;
+			return;
+		}
+		bg = lo;
+		lo->pr = NULL;
+		hi->nx = ed;
+		ed->pr = hi;
+	}
+	/**
+	 * run f and g, on two threads when allowed.  an exception from either
+	 *   is rethrown here once both are done (g's if both throw); when no
+	 *   thread can be started the two simply run one after the other.
+	 */
+	template<class F, class G>
+	static void fork(bool par, F f, G g) {
+		if (!par) {
+			f();
+			g();
+			return;
+		}
+		std::exception_ptr e;
+		std::thread th;
+		try {
+			th = std::thread([&]() {
+				try {
+					f();
+				}
+				catch (...) {
+					e = std::current_exception();
+				}
+			});
+		}
+		catch (...) {
+			f();
+			g();
+			return;
+		}
+		try {
+			g();
+		}
+		catch (...) {
+			th.join();
+			throw;
+		}
+		th.join();
+		if (e) std::rethrow_exception(e);
+	}
+	static const int fork_grain = SJTU_MAP_FORK_GRAIN;
+	// a batch is forked by op count, each op costs about one descent
+	static const size_t batch_grain = SJTU_MAP_BATCH_GRAIN;
+	static int fork_depth() {
+#ifdef SJTU_MAP_FORK_DEPTH
+		return SJTU_MAP_FORK_DEPTH;
+#else
+		int d = 0;
+		for (unsigned int c = std::thread::hardware_concurrency(); c > 1; c >>= 1) d++;
+		return d;
+#endif
+	}
+	static bool forkable(int depth, map_node* a, const map_node* b) {
+		return depth > 0 && ((a == NULL ? 0 : a->s) + (b == NULL ? 0 : b->s)) >= fork_grain;
+	}
+	map_node* unite(map_node* a, map_node* b, map_node* &lo, map_node* &hi, int depth) {
+		if (a == NULL || b == NULL) {
+			map_node* t = (a == NULL) ? b : a;
+			ends(t, lo, hi);
+			return t;
+		}
+		bool par = forkable(depth, a, b);
+		map_node *bl, *mid, *br;
+		split(b, a, bl, mid, br);
+		delete mid;
+		map_node *al = a->l, *ar = a->r;
+		map_node *l, *llo, *lhi, *r, *rlo, *rhi;
+		fork(par,
+			[&]() { l = unite(al, bl, llo, lhi, depth - 1); },
+			[&]() { r = unite(ar, br, rlo, rhi, depth - 1); });
+		return join(l, llo, lhi, a, r, rlo, rhi, lo, hi);
+	}
+	map_node* intersect(map_node* a, const map_node* b, map_node* &lo, map_node* &hi, int depth) {
+		if (a == NULL || b == NULL) {
+			clean(a);
+			lo = hi = NULL;
+			return NULL;
+		}
+		bool par = forkable(depth, a, b);
+		map_node *al, *mid, *ar;
+		split(a, b, al, mid, ar);
+		map_node *l, *llo, *lhi, *r, *rlo, *rhi;
+		fork(par,
+			[&]() { l = intersect(al, b->l, llo, lhi, depth - 1); },
+			[&]() { r = intersect(ar, b->r, rlo, rhi, depth - 1); });
+		if (mid != NULL) return join(l, llo, lhi, mid, r, rlo, rhi, lo, hi);
+		return join2(l, llo, lhi, r, rlo, rhi, lo, hi);
+	}
+	map_node* difference(map_node* a, const map_node* b, map_node* &lo, map_node* &hi, int depth) {
+		if (a == NULL || b == NULL) {
+			ends(a, lo, hi);
+			return a;
+		}
+		bool par = forkable(depth, a, b);
+		map_node *al, *mid, *ar;
+		split(a, b, al, mid, ar);
+		delete mid;
+		map_node *l, *llo, *lhi, *r, *rlo, *rhi;
+		fork(par,
+			[&]() { l = difference(al, b->l, llo, lhi, depth - 1); },
+			[&]() { r = difference(ar, b->r, rlo, rhi, depth - 1); });
+		return join2(l, llo, lhi, r, rlo, rhi, lo, hi);
 	}
 	inline void LL(map_node* &x) {
 //		std::cout << "LL" << std::endl;
+		counters.rotated(0);
 		map_node* p = x->l;
 		x->l = p->r;
 		p->r = x;
@@ -565,6 +2044,7 @@ private:
 	}
 	inline void RR(map_node* &x) {
 //		std::cout << "RR" << std::endl;
+		counters.rotated(1);
 		map_node* p = x->r;
 		x->r = p->l;
 		p->l = x;
@@ -574,6 +2054,7 @@ private:
 	}
 	inline void LR(map_node* &x) {
 //		std::cout << "LR" << std::endl;
+		counters.rotated(2);
 		map_node* p = x->l;
 		map_node* q = p->r;
 		p->r = q->l;
@@ -587,6 +2068,7 @@ private:
 	}
 	inline void RL(map_node* &x) {
 //		std::cout << "RL" << std::endl;
+		counters.rotated(3);
 		map_node* p = x->r;
 		map_node* q = p->l;
 		x->r = q->l;
@@ -598,27 +2080,355 @@ private:
 		x->r->h_update();
 		x->h_update();
 	}
-	inline void maintain(map_node* &x, const value_type& v) {
+	inline void adjust(map_node*& x) {
 		x->h_update();
-		if (x->bd() == 2) {
-			if (cmp(v.first, x->l->data->first)) LL(x); else LR(x);
+		if (Balance::heavy(x->l, x->r)) {
+			if (Balance::outer(x->l, true)) LL(x); else LR(x);
 		}
-		if (x->bd() == -2) {
-			if (cmp(x->r->data->first, v.first)) RR(x); else RL(x);
+		else {
+			if (Balance::heavy(x->r, x->l)) {
+				if (Balance::outer(x->r, false)) RR(x); else RL(x);
+			}
 		}
 	}
-	inline void adjust(map_node*& x) {
-		//delete l
-		x->h_update();
-		if (x->bd() == -2) {
-			int bfr = x->r->bd();
-			if (bfr == 0 || bfr == -1) RR(x); else RL(x);
+};
+
+/**
+ * a map from unique keys to T, see avl_tree for the common part.
+ */
+template<
+	class Key,
+	class T,
+	class Compare = std::less<Key>,
+	class Monoid = no_aggregate,
+	class Balance = avl_balance
+> class map : public avl_tree<Key, map_traits<Key, T>, Compare, Monoid, false, Balance> {
+	typedef avl_tree<Key, map_traits<Key, T>, Compare, Monoid, false, Balance> base;
+public:
+	typedef typename base::value_type value_type;
+	typedef typename base::iterator iterator;
+	typedef typename base::const_iterator const_iterator;
+	typedef typename base::map_node map_node;
+	/**
+	 * T, or const T when the map keeps an aggregate (see update()).
+	 */
+	typedef typename std::conditional<std::is_same<Monoid, no_aggregate>::value, T, const T>::type exposed_mapped;
+	/**
+	 * one entry of a batch for apply_batch: set key to value (insert or
+	 *   overwrite), or erase key.
+	 */
+	class batch_op {
+	public:
+		Key key;
+		T value;
+		bool erase;
+		batch_op(const Key &key, const T &value) :key(key), value(value), erase(false) {}
+		explicit batch_op(const Key &key) :key(key), value(), erase(true) {}
+	};
+	map() {}
+	/**
+	 * build from an ascending range in O(n), see assign_sorted.
+	 */
+	template<class InputIt>
+	map(InputIt first, InputIt last) :base(first, last) {}
+	/**
+	 * TODO
+	 * access specified element with bounds checking
+	 * Returns a reference to the mapped value of the element with key equivalent to key.
+	 * If no such element exists, an exception of type `index_out_of_bound'
+	 */
+	exposed_mapped & at(const Key &key) {
+		map_node* p = search(head, key);
+		if (p == NULL) throw index_out_of_bound("from map::at");
+		return (p->data->second);
+	}
+	const T & at(const Key &key) const {
+		map_node* p = search(head, key);
+		if (p == NULL) throw index_out_of_bound("from map::at");
+		return (p->data->second);
+	}
+	/**
+	 * TODO
+	 * access specified element
+	 * Returns a reference to the value that is mapped to a key equivalent to key,
+	 *   performing an insertion if such key does not already exist.
+	 */
+	exposed_mapped & operator[](const Key &key) {
+		return try_emplace(key).first->second;
+	}
+	/**
+	 * the same, a new element takes its key from key by moving.
+	 */
+	exposed_mapped & operator[](Key &&key) {
+		return try_emplace(std::move(key)).first->second;
+	}
+	/**
+	 * behave like at() throw index_out_of_bound if such key does not exist.
+	 */
+	const T & operator[](const Key &key) const {
+		return at(key);
+	}
+	template<class K, class C = Compare, class = typename C::is_transparent>
+	exposed_mapped & at(const K &key) {
+		map_node* p = search(head, key);
+		if (p == NULL) throw index_out_of_bound("from map::at");
+		return (p->data->second);
+	}
+	template<class K, class C = Compare, class = typename C::is_transparent>
+	const T & at(const K &key) const {
+		map_node* p = search(head, key);
+		if (p == NULL) throw index_out_of_bound("from map::at");
+		return (p->data->second);
+	}
+	/**
+	 * if key is absent, insert (key, T(args...)) built in place, T need not
+	 *   be movable; if it is present nothing is built at all, args are left
+	 *   untouched.
+	 * return the iterator to the element with key, and true if it was inserted.
+	 */
+	template<class... Args>
+	pair<iterator, bool> try_emplace(const Key &key, Args&&... args) {
+		map_node* p = search(head, key);
+		if (p != NULL) return pair<iterator, bool>(iterator(p, this), false);
+		p = link(make_node(std::piecewise_construct, std::forward_as_tuple(key),
+			std::forward_as_tuple(std::forward<Args>(args)...)));
+		return pair<iterator, bool>(iterator(p, this), true);
+	}
+	template<class... Args>
+	pair<iterator, bool> try_emplace(Key &&key, Args&&... args) {
+		map_node* p = search(head, key);
+		if (p != NULL) return pair<iterator, bool>(iterator(p, this), false);
+		p = link(make_node(std::piecewise_construct, std::forward_as_tuple(std::move(key)),
+			std::forward_as_tuple(std::forward<Args>(args)...)));
+		return pair<iterator, bool>(iterator(p, this), true);
+	}
+	/**
+	 * assign obj to the element with key, or insert (key, obj) if there is none.
+	 *   the aggregates above an assigned element are recomputed.
+	 * return the iterator to the element, and true if it was inserted.
+	 */
+	template<class M>
+	pair<iterator, bool> insert_or_assign(const Key &key, M &&obj) {
+		map_node* p = search(head, key);
+		if (p != NULL) {
+			p->data->second = std::forward<M>(obj);
+			if (!std::is_same<Monoid, no_aggregate>::value) this->refresh(head, p);
+			return pair<iterator, bool>(iterator(p, this), false);
 		}
-		//delete r
-		if (x->bd() == 2) {
-			int bfr = x->l->bd();
-			if (bfr == 0 || bfr == 1) LL(x); else LR(x);
+		p = link(make_node(key, std::forward<M>(obj)));
+		return pair<iterator, bool>(iterator(p, this), true);
+	}
+	template<class M>
+	pair<iterator, bool> insert_or_assign(Key &&key, M &&obj) {
+		map_node* p = search(head, key);
+		if (p != NULL) {
+			p->data->second = std::forward<M>(obj);
+			if (!std::is_same<Monoid, no_aggregate>::value) this->refresh(head, p);
+			return pair<iterator, bool>(iterator(p, this), false);
+		}
+		p = link(make_node(std::move(key), std::forward<M>(obj)));
+		return pair<iterator, bool>(iterator(p, this), true);
+	}
+	/**
+	 * apply a batch of batch_op in one pass, as if they were applied one by
+	 *   one in the given order (so for a repeated key the last op wins).
+	 * the batch is sorted by key and walked down the tree together: at
+	 *   every node the ops are cut at its key, a subtree that no op reaches
+	 *   is never visited and the paths shared by neighbouring keys are
+	 *   walked once, O(m log(n / m + 1)) nodes for m distinct keys instead
+	 *   of m log n.  ops that land in an empty subtree are built into a
+	 *   balanced tree directly, and each node is rebalanced once on the
+	 *   way back up.
+	 * existing elements are overwritten in place, iterators to them stay valid.
+	 * if copying or assigning a value throws, the map is left valid but
+	 *   holding only part of the batch: every op was either applied or not.
+	 *   Compare must not throw.
+	 * with parallel set, halves that are large enough go to separate
+	 *   threads (see union_with), Compare and T's copy must then be safe
+	 *   to call concurrently.
+	 * the ops are read through pointers, the range must outlive the call.
+	 */
+	template<class ForwardIt>
+	void apply_batch(ForwardIt first, ForwardIt last, bool parallel = false) {
+		size_t m = 0;
+		for (ForwardIt it = first; it != last; ++it) m++;
+		if (m == 0) return;
+		const batch_op** op = new const batch_op*[m];
+		try {
+			size_t i = 0;
+			for (; first != last; ++first) op[i++] = &*first;
+			std::stable_sort(op, op + m, [this](const batch_op* x, const batch_op* y) {
+				return cmp(x->key, y->key);
+			});
+			size_t k = 0;
+			for (i = 0; i < m; i++) {
+				if (i + 1 < m && !cmp(op[i]->key, op[i + 1]->key)) continue;
+				op[k++] = op[i];
+			}
+			this->settle();
+			apply(head, op, k, NULL, NULL, parallel ? fork_depth() : 0);
 		}
+		catch (...) {
+			delete[] op;
+			this->changed();
+			throw;
+		}
+		delete[] op;
+		this->changed();
+	}
+private:
+	using base::head;
+	using base::cmp;
+	using base::bg;
+	using base::ed;
+	using base::search;
+	using base::link;
+	using base::make_node;
+	using base::attach;
+	using base::pop_max;
+	using base::build;
+	using base::fork;
+	using base::fork_depth;
+	using base::batch_grain;
+	/**
+	 * apply m sorted ops with distinct keys to subtree t, which is replaced
+	 *   by the result; pred/succ are the nearest ancestors left and right of
+	 *   t (NULL at the ends), between which new nodes are threaded.  the ops
+	 *   are cut at t's key and each part goes down its own side, so only the
+	 *   union of their paths is visited, then t is put back with attach,
+	 *   which also rebalances a side that grew or shrank by more than one
+	 *   level.
+	 * when a copy throws below, each level on the way out still puts its
+	 *   node back between whatever its two sides hold by then, so t is a
+	 *   valid tree when the exception leaves.
+	 */
+	void apply(map_node* &t, const batch_op** op, size_t m, map_node* pred, map_node* succ, int depth) {
+		if (m == 0) return;
+		if (t == NULL) {
+			t = grow(op, m, pred, succ);
+			return;
+		}
+		size_t lo = 0, len = m;
+		while (len > 0) {
+			size_t half = len >> 1;
+			if (cmp(op[lo + half]->key, t->data->first)) lo += half + 1, len -= half + 1;
+			else len = half;
+		}
+		size_t k = lo;
+		bool hit = k < m && !cmp(t->data->first, op[k]->key);
+		map_node *l = t->l, *r = t->r;
+		try {
+			fork(depth > 0 && m >= batch_grain,
+				[&]() { apply(l, op, k, pred, t, depth - 1); },
+				[&]() { apply(r, op + k + hit, m - k - hit, t, succ, depth - 1); });
+			if (hit && !op[k]->erase) t->data->second = op[k]->value;
+		}
+		catch (...) {
+			t = attach(l, t, r);
+			throw;
+		}
+		if (hit && op[k]->erase) {
+			// bg is only written by the leftmost path, other threads must not read it
+			if (t->pr == NULL) bg = t->nx; else t->pr->nx = t->nx;
+			t->nx->pr = t->pr;
+			delete t;
+			if (l == NULL) t = r;
+			else {
+				if (r == NULL) t = l;
+				else {
+					map_node* x = pop_max(l);
+					t = attach(l, x, r);
+				}
+			}
+			return;
+		}
+		t = attach(l, t, r);
+	}
+	/**
+	 * a balanced tree of the upserts among m sorted ops, threaded between pred and succ.
+	 * if building an element throws, the nodes made here are freed and
+	 *   nothing is linked.
+	 */
+	map_node* grow(const batch_op** op, size_t m, map_node* pred, map_node* succ) {
+		map_node *lo = NULL, *hi = NULL;
+		size_t n = 0;
+		for (size_t i = 0; i < m; i++) {
+			if (op[i]->erase) continue;
+			map_node* p;
+			try {
+				p = make_node(op[i]->key, op[i]->value);
+			}
+			catch (...) {
+				while (lo != NULL) {
+					map_node* q = lo->nx;
+					delete lo;
+					lo = q;
+				}
+				throw;
+			}
+			p->pr = hi;
+			if (hi == NULL) lo = p; else hi->nx = p;
+			hi = p;
+			n++;
+		}
+		if (n == 0) return NULL;
+		if (succ == NULL) succ = ed;
+		lo->pr = pred;
+		if (pred == NULL) bg = lo; else pred->nx = lo;
+		hi->nx = succ;
+		succ->pr = hi;
+		map_node* cur = lo;
+		return build(cur, n);
+	}
+};
+
+/**
+ * a map whose equal keys are kept in insertion order, insert always
+ *   succeeds and returns only the iterator.
+ */
+template<
+	class Key,
+	class T,
+	class Compare = std::less<Key>,
+	class Monoid = no_aggregate,
+	class Balance = avl_balance
+> class multimap : public avl_tree<Key, map_traits<Key, T>, Compare, Monoid, true, Balance> {
+	typedef avl_tree<Key, map_traits<Key, T>, Compare, Monoid, true, Balance> base;
+public:
+	typedef typename base::value_type value_type;
+	typedef typename base::iterator iterator;
+	typedef typename base::const_iterator const_iterator;
+	typedef typename base::node_type node_type;
+	multimap() {}
+	/**
+	 * build from an ascending range in O(n), see assign_sorted.
+	 */
+	template<class InputIt>
+	multimap(InputIt first, InputIt last) :base(first, last) {}
+	/**
+	 * insert an element after the elements with an equal key.
+	 */
+	iterator insert(const value_type &value) {
+		return base::insert(value).first;
+	}
+	iterator insert(value_type &&value) {
+		return base::insert(std::move(value)).first;
+	}
+	iterator insert(iterator hint, const value_type &value) {
+		return base::insert(hint, value);
+	}
+	iterator insert(iterator hint, value_type &&value) {
+		return base::insert(hint, std::move(value));
+	}
+	/**
+	 * relink the element owned by nh, an empty nh gives end().
+	 */
+	iterator insert(node_type &&nh) {
+		return base::insert(std::move(nh)).first;
+	}
+	template<class... Args>
+	iterator emplace(Args&&... args) {
+		return base::emplace(std::forward<Args>(args)...).first;
 	}
 };
 
@@ -0,0 +1,266 @@
+/**
+ * implement a price-time priority limit order book on sjtu::map
+ */
+#ifndef SJTU_ORDER_BOOK_HPP
+#define SJTU_ORDER_BOOK_HPP
+
+// only for std::less<T> and std::greater<T>
+#include <functional>
+#include <cstddef>
+#include "utility.hpp"
+#include "exceptions.hpp"
+#include "map.hpp"
+#include "unordered_map.hpp"
+
+namespace sjtu {
+
+/**
+ * every side is an sjtu::map from price to level, the bids in descending
+ *   and the asks in ascending order so the best price is begin() on both.
+ *   a level queues its orders in an sjtu::map keyed by an arrival stamp
+ *   that only grows, so a new order is a hinted insert at the end and the
+ *   oldest is begin(); the level keeps their total quantity as it changes.
+ *
+ * a map never moves an element, so the id index (an sjtu::unordered_map)
+ *   points straight at the resting order and its level: modify is O(1)
+ *   past the index lookup, cancel is O(log k) for k orders at the price
+ *   plus, when the level empties, the O(log n) erase of the level.
+ * a match walks the opposite side from its best level and fills the
+ *   orders at the front where they are, reporting every fill as
+ *   f(maker id, taker id, price, quantity).  nothing is copied but the
+ *   new order that rests.
+ */
+template<
+	class Price = long long,
+	class Qty = long long,
+	class Id = unsigned long long
+> class order_book {
+public:
+	enum side { buy, sell };
+	class order {
+	public:
+		Id id;
+		Qty qty;
+		order(const Id &id, const Qty &qty) :id(id), qty(qty) {}
+	};
+	class level {
+	public:
+		map<unsigned long long, order> q;
+		Qty total;
+		level() :total(0) {}
+	};
+private:
+	class ref {
+	public:
+		order* o;
+		level* l;
+		side s;
+		Price price;
+		unsigned long long stamp;
+		ref() :o(NULL), l(NULL), s(buy), price(), stamp(0) {}
+		ref(order* o, level* l, side s, const Price &price, unsigned long long stamp) :o(o), l(l), s(s), price(price), stamp(stamp) {}
+	};
+	typedef map<Price, level, std::greater<Price> > bid_book;
+	typedef map<Price, level, std::less<Price> > ask_book;
+	class no_fill {
+	public:
+		void operator()(const Id &, const Id &, const Price &, const Qty &) const {}
+	};
+public:
+	order_book() :bid_live(false), ask_live(false), stamp(0) {}
+	/**
+	 * match a new order against the other side and rest what is left.
+	 * return the quantity that rests.  an id that is live already or a
+	 *   quantity that is not positive throws runtime_error.
+	 */
+	template<class F>
+	Qty add(const Id &id, side s, const Price &price, Qty qty, F f) {
+		if (!(Qty() < qty)) throw runtime_error("from order_book::add bad quantity");
+		if (idx.count(id) != 0) throw runtime_error("from order_book::add duplicate id");
+		if (s == buy) {
+			while (Qty() < qty && ask_live && !(price < best_ask)) {
+				sweep(asks, id, qty, f);
+				ask_live = !asks.empty();
+				if (ask_live) best_ask = asks.cbegin()->first;
+			}
+			if (Qty() < qty) rest(bids, id, s, price, qty);
+		}
+		else {
+			while (Qty() < qty && bid_live && !(best_bid < price)) {
+				sweep(bids, id, qty, f);
+				bid_live = !bids.empty();
+				if (bid_live) best_bid = bids.cbegin()->first;
+			}
+			if (Qty() < qty) rest(asks, id, s, price, qty);
+		}
+		return qty;
+	}
+	Qty add(const Id &id, side s, const Price &price, const Qty &qty) {
+		return add(id, s, price, qty, no_fill());
+	}
+	/**
+	 * take a resting order out, return false if the id is not resting.
+	 */
+	bool cancel(const Id &id) {
+		typename unordered_map<Id, ref>::iterator it = idx.find(id);
+		if (it == idx.end()) return false;
+		ref r = it->second;
+		idx.erase(it);
+		if (r.s == buy) drop(bids, r);
+		else drop(asks, r);
+		return true;
+	}
+	/**
+	 * change the quantity of a resting order, return false if the id is
+	 *   not resting.  a smaller quantity keeps the place in the queue, a
+	 *   larger one goes to the back like a new order; 0 cancels.
+	 */
+	bool modify(const Id &id, const Qty &qty) {
+		typename unordered_map<Id, ref>::iterator it = idx.find(id);
+		if (it == idx.end()) return false;
+		if (!(Qty() < qty)) return cancel(id);
+		ref r = it->second;
+		if (!(r.o->qty < qty)) {
+			r.l->total -= r.o->qty - qty;
+			r.o->qty = qty;
+			return true;
+		}
+		cancel(id);
+		add(id, r.s, r.price, qty);
+		return true;
+	}
+	/**
+	 * cancel and add again at another price, matching if it now crosses.
+	 * return false if the id is not resting, otherwise put the quantity
+	 *   that rests in rested.  a quantity that is not positive throws
+	 *   runtime_error and leaves the order where it was.
+	 */
+	template<class F>
+	bool replace(const Id &id, const Price &price, const Qty &qty, F f, Qty &rested) {
+		if (!(Qty() < qty)) throw runtime_error("from order_book::replace bad quantity");
+		typename unordered_map<Id, ref>::iterator it = idx.find(id);
+		if (it == idx.end()) return false;
+		side s = it->second.s;
+		cancel(id);
+		rested = add(id, s, price, qty, f);
+		return true;
+	}
+	bool replace(const Id &id, const Price &price, const Qty &qty, Qty &rested) {
+		return replace(id, price, qty, no_fill(), rested);
+	}
+	/**
+	 * the best price of a side, false if the side is empty.  O(1), the
+	 *   best prices are kept up to date by every change.
+	 */
+	bool best(side s, Price &out) const {
+		if (s == buy) {
+			if (bid_live) out = best_bid;
+			return bid_live;
+		}
+		if (ask_live) out = best_ask;
+		return ask_live;
+	}
+	/**
+	 * the resting quantity and number of orders at a price, 0 if none.
+	 */
+	Qty volume_at(side s, const Price &price) const {
+		const level* l = find_level(s, price);
+		return (l == NULL) ? Qty() : l->total;
+	}
+	size_t orders_at(side s, const Price &price) const {
+		const level* l = find_level(s, price);
+		return (l == NULL) ? 0 : l->q.size();
+	}
+	/**
+	 * call f(price, total quantity, order count) on at most n levels of a
+	 *   side from the best one.
+	 */
+	template<class F>
+	void depth(side s, size_t n, F f) const {
+		if (s == buy) walk(bids, n, f);
+		else walk(asks, n, f);
+	}
+	/**
+	 * the number of resting orders.
+	 */
+	size_t size() const { return idx.size(); }
+	bool empty() const { return idx.empty(); }
+	size_t levels(side s) const { return (s == buy) ? bids.size() : asks.size(); }
+private:
+	bid_book bids;
+	ask_book asks;
+	unordered_map<Id, ref> idx;
+	bool bid_live, ask_live;
+	Price best_bid, best_ask;
+	unsigned long long stamp;
+	/**
+	 * fill the taker against the best level of book until either is used
+	 *   up, erase the level if it emptied.
+	 */
+	template<class Book, class F>
+	void sweep(Book &book, const Id &taker, Qty &qty, F &f) {
+		typename Book::iterator lv = book.begin();
+		level &l = lv->second;
+		while (Qty() < qty && !l.q.empty()) {
+			typename map<unsigned long long, order>::iterator it = l.q.begin();
+			order &o = it->second;
+			Qty x = (o.qty < qty) ? o.qty : qty;
+			o.qty -= x;
+			qty -= x;
+			l.total -= x;
+			f(o.id, taker, lv->first, x);
+			if (Qty() < o.qty) break;
+			idx.erase(o.id);
+			l.q.erase(it);
+		}
+		if (l.q.empty()) book.erase(lv);
+	}
+	template<class Book>
+	void rest(Book &book, const Id &id, side s, const Price &price, const Qty &qty) {
+		level &l = book.try_emplace(price).first->second;
+		typename map<unsigned long long, order>::iterator it =
+			l.q.emplace_hint(l.q.end(), ++stamp, order(id, qty));
+		l.total += qty;
+		idx.insert(typename unordered_map<Id, ref>::value_type(id, ref(&it->second, &l, s, price, stamp)));
+		if (s == buy) {
+			if (!bid_live || best_bid < price) best_bid = price;
+			bid_live = true;
+		}
+		else {
+			if (!ask_live || price < best_ask) best_ask = price;
+			ask_live = true;
+		}
+	}
+	template<class Book>
+	void drop(Book &book, const ref &r) {
+		r.l->total -= r.o->qty;
+		r.l->q.erase(r.stamp);
+		if (!r.l->q.empty()) return;
+		book.erase(r.price);
+		if (r.s == buy) {
+			bid_live = !bids.empty();
+			if (bid_live) best_bid = bids.cbegin()->first;
+		}
+		else {
+			ask_live = !asks.empty();
+			if (ask_live) best_ask = asks.cbegin()->first;
+		}
+	}
+	const level* find_level(side s, const Price &price) const {
+		if (s == buy) {
+			typename bid_book::const_iterator it = bids.find(price);
+			return (it == bids.cend()) ? NULL : &it->second;
+		}
+		typename ask_book::const_iterator it = asks.find(price);
+		return (it == asks.cend()) ? NULL : &it->second;
+	}
+	template<class Book, class F>
+	static void walk(const Book &book, size_t n, F &f) {
+		for (typename Book::const_iterator it = book.cbegin(); n > 0 && it != book.cend(); ++it, --n)
+			f(it->first, it->second.total, it->second.q.size());
+	}
+};
+
+}
+
+#endif
@@ -0,0 +1,366 @@
+/**
+ * implement a copy-on-write ordered map with O(1) snapshots
+ */
+#ifndef SJTU_PERSISTENT_MAP_HPP
+#define SJTU_PERSISTENT_MAP_HPP
+
+// only for std::less<T>
+#include <functional>
+#include <cstddef>
+#include <atomic>
+#include "utility.hpp"
+#include "exceptions.hpp"
+
+namespace sjtu {
+
+/**
+ * an AVL tree whose nodes are shared between versions by reference count.
+ *
+ * copying the map (or calling snapshot()) only bumps the count of the root.
+ *   a writer copies the nodes on the root-to-leaf path that are still
+ *   shared (path copying) and changes its own copies in place, so every
+ *   snapshot keeps seeing the elements it was taken with.
+ * a node that is shared cannot carry the nx/pr thread of sjtu::map (its
+ *   neighbours differ between versions), so an iterator keeps the path
+ *   from the root instead and all iterators are const.
+ * a snapshot may be read and destroyed on another thread while the map it
+ *   came from keeps being written; one object must not be written while
+ *   it is read.  iterators stay valid as long as the object they came from
+ *   is neither modified nor destroyed.
+ */
+template<
+	class Key,
+	class T,
+	class Compare = std::less<Key>
+> class persistent_map {
+public:
+	typedef pair<const Key, T> value_type;
+private:
+	class node {
+	public:
+		value_type data;
+		node *l, *r;
+		int h, s;
+		std::atomic<long> rc;
+		node(const value_type &v) :data(v), l(NULL), r(NULL), h(0), s(1), rc(1) {}
+		node(const node &other) :data(other.data), l(other.l), r(other.r), h(other.h), s(other.s), rc(1) {
+			if (l != NULL) l->rc.fetch_add(1, std::memory_order_relaxed);
+			if (r != NULL) r->rc.fetch_add(1, std::memory_order_relaxed);
+		}
+	};
+	// an AVL tree of 2^63 nodes is less than 92 levels high
+	static const int max_depth = 96;
+public:
+	class const_iterator {
+		friend class persistent_map;
+	private:
+		node* stk[max_depth];
+		int d;
+		const persistent_map* t;
+		node* top() const { return (d == 0) ? NULL : stk[d - 1]; }
+		void leftmost(node* x) {
+			for (; x != NULL; x = x->l) stk[d++] = x;
+		}
+		void rightmost(node* x) {
+			for (; x != NULL; x = x->r) stk[d++] = x;
+		}
+	public:
+		const_iterator() :d(0), t(NULL) {}
+		const_iterator(const const_iterator &other) :d(other.d), t(other.t) {
+			for (int i = 0; i < d; i++) stk[i] = other.stk[i];
+		}
+		const_iterator& operator =(const const_iterator &other) {
+			if (this == &other) return *this;
+			d = other.d;
+			t = other.t;
+			for (int i = 0; i < d; i++) stk[i] = other.stk[i];
+			return *this;
+		}
+		const_iterator & operator++() {
+			if (d == 0) throw invalid_iterator("from persistent_map::const_iterator::operator++");
+			node* x = stk[d - 1];
+			if (x->r != NULL) leftmost(x->r);
+			else {
+				node* c;
+				do {
+					c = stk[--d];
+				} while (d > 0 && stk[d - 1]->r == c);
+			}
+			return *this;
+		}
+		const_iterator operator++(int) {
+			const_iterator nw(*this);
+			++(*this);
+			return nw;
+		}
+		const_iterator & operator--() {
+			if (t == NULL) throw invalid_iterator("from persistent_map::const_iterator::operator--");
+			if (d == 0) {
+				if (t->root == NULL) throw invalid_iterator("from persistent_map::const_iterator::operator--");
+				rightmost(t->root);
+				return *this;
+			}
+			node* x = stk[d - 1];
+			if (x->l != NULL) rightmost(x->l);
+			else {
+				int k = d;
+				node* c;
+				do {
+					c = stk[--k];
+				} while (k > 0 && stk[k - 1]->l == c);
+				if (k == 0) throw invalid_iterator("from persistent_map::const_iterator::operator--");
+				d = k;
+			}
+			return *this;
+		}
+		const_iterator operator--(int) {
+			const_iterator nw(*this);
+			--(*this);
+			return nw;
+		}
+		const value_type & operator*() const {
+			return top()->data;
+		}
+		const value_type* operator->() const noexcept {
+			return &(top()->data);
+		}
+		bool operator==(const const_iterator &rhs) const {
+			return (top() == rhs.top());
+		}
+		bool operator!=(const const_iterator &rhs) const {
+			return (top() != rhs.top());
+		}
+	};
+	typedef const_iterator iterator;
+	persistent_map() :root(NULL) {}
+	/**
+	 * O(1), the two maps share every node until one of them is written.
+	 */
+	persistent_map(const persistent_map &other) :root(other.root) {
+		if (root != NULL) root->rc.fetch_add(1, std::memory_order_relaxed);
+	}
+	persistent_map & operator=(const persistent_map &other) {
+		if (this == &other) return *this;
+		node* x = other.root;
+		if (x != NULL) x->rc.fetch_add(1, std::memory_order_relaxed);
+		release(root);
+		root = x;
+		return *this;
+	}
+	~persistent_map() {
+		release(root);
+	}
+	/**
+	 * a read-only view of the current contents, in O(1).
+	 */
+	persistent_map snapshot() const {
+		return persistent_map(*this);
+	}
+	const T & at(const Key &key) const {
+		node* p = search(key);
+		if (p == NULL) throw index_out_of_bound("from persistent_map::at");
+		return p->data.second;
+	}
+	/**
+	 * performing an insertion if such key does not already exist.
+	 * the path to the element is unshared first, so the reference may be written.
+	 */
+	T & operator[](const Key &key) {
+		if (search(key) == NULL) return insert(root, value_type(key, T()))->data.second;
+		return touch(root, key)->data.second;
+	}
+	const T & operator[](const Key &key) const {
+		return at(key);
+	}
+	const_iterator begin() const { return cbegin(); }
+	const_iterator cbegin() const {
+		const_iterator it;
+		it.t = this;
+		it.leftmost(root);
+		return it;
+	}
+	const_iterator end() const { return cend(); }
+	const_iterator cend() const {
+		const_iterator it;
+		it.t = this;
+		return it;
+	}
+	bool empty() const { return root == NULL; }
+	size_t size() const { return (root == NULL) ? 0 : root->s; }
+	void clear() {
+		release(root);
+		root = NULL;
+	}
+	/**
+	 * return a pair, the first of the pair is
+	 *   the iterator to the new element (or the element that prevented the insertion),
+	 *   the second one is true if insert successfully, or false.
+	 */
+	pair<const_iterator, bool> insert(const value_type &value) {
+		if (search(value.first) != NULL) return pair<const_iterator, bool>(find(value.first), false);
+		insert(root, value);
+		return pair<const_iterator, bool>(find(value.first), true);
+	}
+	void erase(const_iterator pos) {
+		if (pos.t != this) throw invalid_iterator("from persistent_map::erase Not for this map");
+		if (pos.d == 0) throw invalid_iterator("from persistent_map::erase end()");
+		remove(root, pos.top()->data.first);
+	}
+	size_t erase(const Key &key) {
+		if (search(key) == NULL) return 0;
+		remove(root, key);
+		return 1;
+	}
+	size_t count(const Key &key) const {
+		return (search(key) == NULL) ? 0 : 1;
+	}
+	const_iterator find(const Key &key) const {
+		const_iterator it;
+		it.t = this;
+		for (node* x = root; x != NULL; ) {
+			it.stk[it.d++] = x;
+			if (cmp(key, x->data.first)) x = x->l;
+			else {
+				if (cmp(x->data.first, key)) x = x->r;
+				else return it;
+			}
+		}
+		return cend();
+	}
+private:
+	node* root;
+	Compare cmp;
+	static void release(node* x) {
+		if (x != NULL && x->rc.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+			release(x->l);
+			release(x->r);
+			delete x;
+		}
+	}
+	/**
+	 * make the node in slot x private to this version before writing it.
+	 */
+	static void own(node* &x) {
+		if (x->rc.load(std::memory_order_acquire) == 1) return;
+		node* c = new node(*x);
+		release(x);
+		x = c;
+	}
+	node* search(const Key &key) const {
+		node* x = root;
+		while (x != NULL) {
+			if (cmp(key, x->data.first)) x = x->l;
+			else {
+				if (cmp(x->data.first, key)) x = x->r;
+				else return x;
+			}
+		}
+		return NULL;
+	}
+	static int height(node* x) { return (x == NULL) ? -1 : x->h; }
+	static int bd(node* x) { return height(x->l) - height(x->r); }
+	static void update(node* x) {
+		int lh = height(x->l), rh = height(x->r);
+		x->h = ((lh > rh) ? lh : rh) + 1;
+		x->s = ((x->l == NULL) ? 0 : x->l->s) + ((x->r == NULL) ? 0 : x->r->s) + 1;
+	}
+	/**
+	 * x is owned; the child that moves up is made private before it is written.
+	 */
+	static void rotate_right(node* &x) {
+		own(x->l);
+		node* p = x->l;
+		x->l = p->r;
+		p->r = x;
+		update(x);
+		update(p);
+		x = p;
+	}
+	static void rotate_left(node* &x) {
+		own(x->r);
+		node* p = x->r;
+		x->r = p->l;
+		p->l = x;
+		update(x);
+		update(p);
+		x = p;
+	}
+	static void fix(node* &x) {
+		update(x);
+		if (bd(x) == 2) {
+			if (bd(x->l) < 0) {
+				own(x->l);
+				rotate_left(x->l);
+			}
+			rotate_right(x);
+		}
+		else {
+			if (bd(x) == -2) {
+				if (bd(x->r) > 0) {
+					own(x->r);
+					rotate_right(x->r);
+				}
+				rotate_left(x);
+			}
+		}
+	}
+	node* insert(node* &x, const value_type &v) {
+		if (x == NULL) {
+			x = new node(v);
+			return x;
+		}
+		own(x);
+		node* p;
+		if (cmp(v.first, x->data.first)) p = insert(x->l, v);
+		else p = insert(x->r, v);
+		fix(x);
+		return p;
+	}
+	/**
+	 * unshare the path to an existing key, return its node.
+	 */
+	node* touch(node* &x, const Key &key) {
+		own(x);
+		if (cmp(key, x->data.first)) return touch(x->l, key);
+		if (cmp(x->data.first, key)) return touch(x->r, key);
+		return x;
+	}
+	node* pop_min(node* &x) {
+		own(x);
+		if (x->l == NULL) {
+			node* m = x;
+			x = x->r;
+			m->r = NULL;
+			return m;
+		}
+		node* m = pop_min(x->l);
+		fix(x);
+		return m;
+	}
+	void remove(node* &x, const Key &key) {
+		own(x);
+		if (cmp(key, x->data.first)) remove(x->l, key);
+		else {
+			if (cmp(x->data.first, key)) remove(x->r, key);
+			else {
+				node* old = x;
+				if (x->l == NULL || x->r == NULL) x = (x->l == NULL) ? x->r : x->l;
+				else {
+					node* m = pop_min(x->r);
+					m->l = x->l;
+					m->r = x->r;
+					x = m;
+				}
+				// the children now belong to the replacement
+				old->l = old->r = NULL;
+				release(old);
+				if (x == NULL) return;
+			}
+		}
+		fix(x);
+	}
+};
+
+}
+
+#endif
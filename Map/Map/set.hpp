@@ -0,0 +1,91 @@
+/**
+ * implement containers like std::set and std::multiset on the tree of sjtu::map
+ */
+#ifndef SJTU_SET_HPP
+#define SJTU_SET_HPP
+
+// only for std::less<T>
+#include <functional>
+#include <cstddef>
+#include "utility.hpp"
+#include "exceptions.hpp"
+#include "map.hpp"
+
+namespace sjtu {
+
+/**
+ * a set of unique keys, see avl_tree for the operations.
+ * the elements are const, an aggregate policy sees every key as both
+ *   its key and its value: Monoid::lift(key, key).
+ */
+template<
+	class Key,
+	class Compare = std::less<Key>,
+	class Monoid = no_aggregate,
+	class Balance = avl_balance
+> class set : public avl_tree<Key, set_traits<Key>, Compare, Monoid, false, Balance> {
+	typedef avl_tree<Key, set_traits<Key>, Compare, Monoid, false, Balance> base;
+public:
+	typedef typename base::value_type value_type;
+	typedef typename base::iterator iterator;
+	typedef typename base::const_iterator const_iterator;
+	set() {}
+	/**
+	 * build from an ascending range in O(n), see assign_sorted.
+	 */
+	template<class InputIt>
+	set(InputIt first, InputIt last) :base(first, last) {}
+};
+
+/**
+ * a set whose equal keys are kept in insertion order, insert always
+ *   succeeds and returns only the iterator.
+ */
+template<
+	class Key,
+	class Compare = std::less<Key>,
+	class Monoid = no_aggregate,
+	class Balance = avl_balance
+> class multiset : public avl_tree<Key, set_traits<Key>, Compare, Monoid, true, Balance> {
+	typedef avl_tree<Key, set_traits<Key>, Compare, Monoid, true, Balance> base;
+public:
+	typedef typename base::value_type value_type;
+	typedef typename base::iterator iterator;
+	typedef typename base::const_iterator const_iterator;
+	typedef typename base::node_type node_type;
+	multiset() {}
+	/**
+	 * build from an ascending range in O(n), see assign_sorted.
+	 */
+	template<class InputIt>
+	multiset(InputIt first, InputIt last) :base(first, last) {}
+	/**
+	 * insert a key after the equal ones.
+	 */
+	iterator insert(const value_type &value) {
+		return base::insert(value).first;
+	}
+	iterator insert(value_type &&value) {
+		return base::insert(std::move(value)).first;
+	}
+	iterator insert(iterator hint, const value_type &value) {
+		return base::insert(hint, value);
+	}
+	iterator insert(iterator hint, value_type &&value) {
+		return base::insert(hint, std::move(value));
+	}
+	/**
+	 * relink the element owned by nh, an empty nh gives end().
+	 */
+	iterator insert(node_type &&nh) {
+		return base::insert(std::move(nh)).first;
+	}
+	template<class... Args>
+	iterator emplace(Args&&... args) {
+		return base::emplace(std::forward<Args>(args)...).first;
+	}
+};
+
+}
+
+#endif
@@ -0,0 +1,355 @@
+/**
+ * binary snapshot files of sjtu::map, see save and load
+ */
+#ifndef SJTU_SNAPSHOT_HPP
+#define SJTU_SNAPSHOT_HPP
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <string>
+// only for std::is_trivially_copyable<T> and std::aligned_storage<T>
+#include <type_traits>
+#include "utility.hpp"
+#include "exceptions.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define SJTU_SNAPSHOT_MMAP
+#endif
+
+namespace sjtu {
+
+/**
+ * a snapshot file is a fixed header followed by the payload:
+ *   char magic[8]            "SJTUSNAP"
+ *   unsigned int version     snapshot_version
+ *   unsigned int reserved    0
+ *   unsigned long long layout chosen by the serializer from the key and
+ *                              value types, a load with another layout is
+ *                              refused
+ *   unsigned long long count number of elements
+ *   unsigned long long bytes payload size
+ *   unsigned long long sum   64-bit FNV-1a of the payload
+ * integers are stored in the byte order of the host that wrote the file.
+ */
+static const unsigned int snapshot_version = 2;
+
+class snapshot_header {
+public:
+	char magic[8];
+	unsigned int version;
+	unsigned int reserved;
+	unsigned long long layout;
+	unsigned long long count;
+	unsigned long long bytes;
+	unsigned long long sum;
+};
+
+inline unsigned long long snapshot_hash(unsigned long long h, const void* p, size_t len) {
+	const unsigned char* c = static_cast<const unsigned char*>(p);
+	for (size_t i = 0; i < len; i++) h = (h ^ c[i]) * 1099511628211ull;
+	return h;
+}
+static const unsigned long long snapshot_seed = 14695981039346656037ull;
+
+/**
+ * streams the payload to path + ".tmp" and, in finish(), fills the
+ *   header, flushes the file to disk and renames it over path.  until
+ *   then the old file at path is untouched, so a crash or a full disk
+ *   during a save never costs the last good snapshot.  a writer that is
+ *   not finished removes its temporary file.
+ */
+class snapshot_writer {
+public:
+	snapshot_writer(const std::string &path, unsigned long long layout) :f(NULL), path(path), tmp(path + ".tmp"), layout(layout), bytes(0), sum(snapshot_seed) {
+		f = std::fopen(tmp.c_str(), "wb");
+		if (f == NULL) throw runtime_error("from snapshot_writer cannot open " + tmp);
+		snapshot_header h;
+		memset(&h, 0, sizeof(h));
+		if (std::fwrite(&h, sizeof(h), 1, f) != 1) fail();
+	}
+	snapshot_writer(const snapshot_writer &) = delete;
+	snapshot_writer & operator=(const snapshot_writer &) = delete;
+	~snapshot_writer() {
+		if (f == NULL) return;
+		std::fclose(f);
+		std::remove(tmp.c_str());
+	}
+	void write(const void* p, size_t len) {
+		if (len == 0) return;
+		if (std::fwrite(p, 1, len, f) != len) fail();
+		sum = snapshot_hash(sum, p, len);
+		bytes += len;
+	}
+	void finish(unsigned long long count) {
+		snapshot_header h;
+		memcpy(h.magic, "SJTUSNAP", 8);
+		h.version = snapshot_version;
+		h.reserved = 0;
+		h.layout = layout;
+		h.count = count;
+		h.bytes = bytes;
+		h.sum = sum;
+		if (std::fseek(f, 0, SEEK_SET) != 0 || std::fwrite(&h, sizeof(h), 1, f) != 1 || std::fflush(f) != 0) fail();
+#ifdef SJTU_SNAPSHOT_MMAP
+		if (fsync(fileno(f)) != 0) fail();
+#endif
+		FILE* g = f;
+		f = NULL;
+		if (std::fclose(g) != 0) {
+			std::remove(tmp.c_str());
+			throw runtime_error("from snapshot_writer write failed");
+		}
+#if defined(_WIN32)
+		// rename does not replace an existing file there
+		std::remove(path.c_str());
+#endif
+		if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+			std::remove(tmp.c_str());
+			throw runtime_error("from snapshot_writer cannot replace " + path);
+		}
+	}
+private:
+	FILE* f;
+	std::string path, tmp;
+	unsigned long long layout;
+	unsigned long long bytes, sum;
+	void fail() {
+		std::fclose(f);
+		f = NULL;
+		std::remove(tmp.c_str());
+		throw runtime_error("from snapshot_writer write failed");
+	}
+};
+
+/**
+ * reads the payload sequentially, never past its end.
+ */
+class snapshot_reader {
+public:
+	snapshot_reader(const unsigned char* p, const unsigned char* end) :p(p), end(end) {}
+	void read(void* out, size_t len) {
+		if ((size_t)(end - p) < len) throw runtime_error("from snapshot_reader truncated payload");
+		memcpy(out, p, len);
+		p += len;
+	}
+	bool done() const { return p == end; }
+private:
+	const unsigned char* p;
+	const unsigned char* end;
+};
+
+/**
+ * the whole file in memory: mapped read-only where mmap exists, else
+ *   (or when mapping fails) read into a buffer.
+ * the header, layout, size and checksum are verified before anything is
+ *   handed out, so a damaged file is refused before the map is touched.
+ */
+class snapshot_file {
+public:
+	snapshot_file(const std::string &path, unsigned long long layout) :data(NULL), len(0), mapped(false) {
+		open(path);
+		snapshot_header h;
+		if (len < sizeof(h)) {
+			close();
+			throw runtime_error("from snapshot_file not a snapshot " + path);
+		}
+		memcpy(&h, data, sizeof(h));
+		const char* err = NULL;
+		if (memcmp(h.magic, "SJTUSNAP", 8) != 0) err = "not a snapshot ";
+		else if (h.version != snapshot_version) err = "unsupported version ";
+		else if (h.layout != layout) err = "layout mismatch ";
+		else if (h.bytes != len - sizeof(h)) err = "size mismatch ";
+		else if (snapshot_hash(snapshot_seed, data + sizeof(h), (size_t)h.bytes) != h.sum) err = "checksum mismatch ";
+		if (err != NULL) {
+			close();
+			throw runtime_error(std::string("from snapshot_file ") + err + path);
+		}
+		n = h.count;
+	}
+	snapshot_file(const snapshot_file &) = delete;
+	snapshot_file & operator=(const snapshot_file &) = delete;
+	~snapshot_file() {
+		close();
+	}
+	unsigned long long count() const { return n; }
+	snapshot_reader reader() const {
+		return snapshot_reader(data + sizeof(snapshot_header), data + len);
+	}
+private:
+	unsigned char* data;
+	size_t len;
+	bool mapped;
+	unsigned long long n;
+	void open(const std::string &path) {
+#ifdef SJTU_SNAPSHOT_MMAP
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0) throw runtime_error("from snapshot_file cannot open " + path);
+		struct stat st;
+		if (fstat(fd, &st) == 0 && st.st_size > 0) {
+			void* m = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (m != MAP_FAILED) {
+				data = static_cast<unsigned char*>(m);
+				len = (size_t)st.st_size;
+				mapped = true;
+				madvise(m, len, MADV_SEQUENTIAL);
+			}
+		}
+		::close(fd);
+		if (mapped) return;
+#endif
+		FILE* f = std::fopen(path.c_str(), "rb");
+		if (f == NULL) throw runtime_error("from snapshot_file cannot open " + path);
+		size_t cap = 1 << 16;
+		data = new unsigned char[cap];
+		for (;;) {
+			len += std::fread(data + len, 1, cap - len, f);
+			if (len < cap) break;
+			unsigned char* nd = new unsigned char[cap * 2];
+			memcpy(nd, data, len);
+			delete[] data;
+			data = nd;
+			cap *= 2;
+		}
+		bool bad = std::ferror(f) != 0;
+		std::fclose(f);
+		if (bad) {
+			close();
+			throw runtime_error("from snapshot_file read failed " + path);
+		}
+	}
+	void close() {
+		if (data == NULL) return;
+#ifdef SJTU_SNAPSHOT_MMAP
+		if (mapped) munmap(data, len);
+		else delete[] data;
+#else
+		delete[] data;
+#endif
+		data = NULL;
+	}
+};
+
+/**
+ * the type tag raw_serializer stores for X: its kind in the top byte
+ *   (signed or unsigned integer, floating point, bool, character, enum,
+ *   anything else) and its size below, so a map<int, float> snapshot is
+ *   refused by a map<float, int> or a map<unsigned, float>.
+ * two structs of the same size share a tag; specialize snapshot_tag for
+ *   a struct to tell it apart, e.g. with a value of kind 8 and up.
+ */
+template<class X, class = void>
+struct snapshot_tag {
+	static const unsigned int kind =
+		std::is_same<X, bool>::value ? 4 :
+		(std::is_same<X, char>::value || std::is_same<X, wchar_t>::value ||
+			std::is_same<X, char16_t>::value || std::is_same<X, char32_t>::value) ? 5 :
+		std::is_enum<X>::value ? 6 :
+		std::is_floating_point<X>::value ? 3 :
+		std::is_integral<X>::value ? (std::is_signed<X>::value ? 1 : 2) : 7;
+	static const unsigned int value = (kind << 24) | (unsigned int)(sizeof(X) & 0xffffff);
+};
+
+/**
+ * the default serializer: the bytes of the object as they are, for
+ *   trivially copyable types only.
+ * a serializer for other types provides the same members:
+ *   static tag<X>()          an id of the type X as it is written
+ *   static layout<Key, T>()  the tags of Key and T, stored in the header
+ *                              and checked by load
+ *   write(w, x)              append x through snapshot_writer::write
+ *   read<X>(r)               return the next X through snapshot_reader::read
+ */
+class raw_serializer {
+public:
+	template<class X>
+	static unsigned int tag() {
+		return snapshot_tag<typename std::remove_cv<X>::type>::value;
+	}
+	template<class K, class V>
+	static unsigned long long layout() {
+		return ((unsigned long long)tag<K>() << 32) | tag<V>();
+	}
+	template<class X>
+	void write(snapshot_writer &w, const X &x) const {
+		static_assert(std::is_trivially_copyable<X>::value, "raw_serializer needs trivially copyable types, pass a serializer");
+		w.write(&x, sizeof(X));
+	}
+	template<class X>
+	X read(snapshot_reader &r) const {
+		static_assert(std::is_trivially_copyable<X>::value, "raw_serializer needs trivially copyable types, pass a serializer");
+		typename std::aligned_storage<sizeof(X), alignof(X)>::type buf;
+		r.read(&buf, sizeof(X));
+		return *reinterpret_cast<X*>(&buf);
+	}
+};
+
+template<class Key, class T, class Compare, class Monoid, class Balance> class map;
+
+/**
+ * the elements of a snapshot payload as an input range for
+ *   map::assign_sorted, each position is read when it is dereferenced, once.
+ */
+template<class Key, class T, class S>
+class snapshot_input {
+public:
+	snapshot_reader* r;
+	const S* s;
+	unsigned long long left;
+	snapshot_input() :r(NULL), s(NULL), left(0) {}
+	snapshot_input(snapshot_reader* r, const S* s, unsigned long long left) :r(r), s(s), left(left) {}
+	pair<const Key, T> operator*() const {
+		Key k = s->template read<Key>(*r);
+		return pair<const Key, T>(k, s->template read<T>(*r));
+	}
+	snapshot_input & operator++() {
+		--left;
+		return *this;
+	}
+	bool operator!=(const snapshot_input &rhs) const {
+		return left != rhs.left;
+	}
+};
+
+/**
+ * write the elements of m in key order to a snapshot file.
+ * the default raw_serializer stores Key and T byte for byte and only
+ *   accepts trivially copyable types, pass a serializer for the others.
+ * the file is replaced only once the new one is complete and on disk.
+ * throw runtime_error if the file cannot be written.
+ */
+template<class Key, class T, class Compare, class Monoid, class Balance, class S = raw_serializer>
+void save(const map<Key, T, Compare, Monoid, Balance> &m, const std::string &path, const S &s = S()) {
+	snapshot_writer w(path, S::template layout<Key, T>());
+	for (typename map<Key, T, Compare, Monoid, Balance>::const_iterator it = m.cbegin(); it != m.cend(); ++it) {
+		s.write(w, it->first);
+		s.write(w, it->second);
+	}
+	w.finish(m.size());
+}
+
+/**
+ * replace the contents of m with a snapshot written by save with the same
+ *   serializer.  the file is mapped (or read) whole and verified first,
+ *   a damaged file throws runtime_error with m untouched; the sorted
+ *   stream is then built into a balanced tree in O(n) by assign_sorted,
+ *   without a single rotation.
+ */
+template<class Key, class T, class Compare, class Monoid, class Balance, class S = raw_serializer>
+void load(map<Key, T, Compare, Monoid, Balance> &m, const std::string &path, const S &s = S()) {
+	snapshot_file f(path, S::template layout<Key, T>());
+	snapshot_reader r = f.reader();
+	m.assign_sorted(snapshot_input<Key, T, S>(&r, &s, f.count()), snapshot_input<Key, T, S>());
+	if (!r.done()) {
+		m.clear();
+		throw runtime_error("from load trailing bytes in " + path);
+	}
+}
+
+}
+
+#endif
@@ -0,0 +1,414 @@
+/**
+ * implement a container like std::unordered_map
+ */
+#ifndef SJTU_UNORDERED_MAP_HPP
+#define SJTU_UNORDERED_MAP_HPP
+
+// only for std::hash<T> and std::equal_to<T>
+#include <functional>
+#include <cstddef>
+#include <new>
+#include "utility.hpp"
+#include "exceptions.hpp"
+
+namespace sjtu {
+
+/**
+ * open addressing hash table with robin hood probing.
+ *
+ * every slot remembers its probe distance (0 means empty, d + 1 means the
+ *   element sits d slots after its home).  elements of one cluster are kept
+ *   sorted by home, so an insertion shifts the tail of the cluster right by
+ *   one and an erasure shifts it back left (backward shift), no tombstone
+ *   is ever left behind.
+ * the table does not wrap around: there are a few overflow slots after the
+ *   `cap' home slots, and running off the end triggers a grow.  thanks to
+ *   that, erasing during a forward iteration never moves an element that
+ *   has already been visited.
+ *
+ * iterators are invalidated by insert (elements may shift or rehash).
+ */
+template<
+	class Key,
+	class T,
+	class Hash = std::hash<Key>,
+	class Eq = std::equal_to<Key>
+> class unordered_map {
+public:
+	typedef pair<const Key, T> value_type;
+	class const_iterator;
+	class iterator {
+		friend class unordered_map;
+		friend class const_iterator;
+	private:
+		size_t p;
+		const unordered_map* t;
+	public:
+		iterator() :p(0), t(NULL) {}
+		iterator(size_t p, const unordered_map* t) :p(p), t(t) {}
+		iterator(const iterator &other) :p(other.p), t(other.t) {}
+		iterator& operator =(const iterator &other) {
+			if (this == &other) return *this;
+			p = other.p;
+			t = other.t;
+			return *this;
+		}
+		iterator & operator++() {
+			if (t == NULL || p >= t->tot) throw invalid_iterator("from unordered_map::iterator::operator++");
+			p = t->next_used(p + 1);
+			return *this;
+		}
+		iterator operator++(int) {
+			iterator nw(*this);
+			++(*this);
+			return nw;
+		}
+		value_type & operator*() const {
+			return t->slot[p];
+		}
+		value_type* operator->() const noexcept {
+			return t->slot + p;
+		}
+		bool operator==(const iterator &rhs) const {
+			return (p == rhs.p && t == rhs.t);
+		}
+		bool operator==(const const_iterator &rhs) const {
+			return (p == rhs.p && t == rhs.t);
+		}
+		bool operator!=(const iterator &rhs) const {
+			return !(*this == rhs);
+		}
+		bool operator!=(const const_iterator &rhs) const {
+			return !(*this == rhs);
+		}
+	};
+	class const_iterator {
+		friend class unordered_map;
+		friend class iterator;
+	private:
+		size_t p;
+		const unordered_map* t;
+	public:
+		const_iterator() :p(0), t(NULL) {}
+		const_iterator(size_t p, const unordered_map* t) :p(p), t(t) {}
+		const_iterator(const const_iterator &other) :p(other.p), t(other.t) {}
+		const_iterator(const iterator &other) :p(other.p), t(other.t) {}
+		const_iterator& operator =(const const_iterator &other) {
+			if (this == &other) return *this;
+			p = other.p;
+			t = other.t;
+			return *this;
+		}
+		const_iterator & operator++() {
+			if (t == NULL || p >= t->tot) throw invalid_iterator("from unordered_map::const_iterator::operator++");
+			p = t->next_used(p + 1);
+			return *this;
+		}
+		const_iterator operator++(int) {
+			const_iterator nw(*this);
+			++(*this);
+			return nw;
+		}
+		const value_type & operator*() const {
+			return t->slot[p];
+		}
+		const value_type* operator->() const noexcept {
+			return t->slot + p;
+		}
+		bool operator==(const iterator &rhs) const {
+			return (p == rhs.p && t == rhs.t);
+		}
+		bool operator==(const const_iterator &rhs) const {
+			return (p == rhs.p && t == rhs.t);
+		}
+		bool operator!=(const iterator &rhs) const {
+			return !(*this == rhs);
+		}
+		bool operator!=(const const_iterator &rhs) const {
+			return !(*this == rhs);
+		}
+	};
+	unordered_map() :slot(NULL), dist(NULL), bits(0), cap(0), tot(0), n(0) {}
+	/**
+	 * use the given hash and key equality, they are copied along with the map.
+	 */
+	explicit unordered_map(const Hash &hash, const Eq &eq = Eq()) :slot(NULL), dist(NULL), bits(0), cap(0), tot(0), n(0), hash(hash), eq(eq) {}
+	unordered_map(const unordered_map &other) :slot(NULL), dist(NULL), bits(0), cap(0), tot(0), n(0), hash(other.hash), eq(other.eq) {
+		reserve(other.n);
+		for (size_t i = 0; i < other.tot; i++)
+			if (other.dist[i] != 0) place(other.slot[i]);
+	}
+	unordered_map & operator=(const unordered_map &other) {
+		if (this == &other) return *this;
+		clear();
+		hash = other.hash;
+		eq = other.eq;
+		reserve(other.n);
+		for (size_t i = 0; i < other.tot; i++)
+			if (other.dist[i] != 0) place(other.slot[i]);
+		return *this;
+	}
+	~unordered_map() {
+		destroy();
+	}
+	/**
+	 * access specified element with bounds checking
+	 * If no such element exists, an exception of type `index_out_of_bound'
+	 */
+	T & at(const Key &key) {
+		size_t p = search(key);
+		if (p == tot) throw index_out_of_bound("from unordered_map::at");
+		return slot[p].second;
+	}
+	const T & at(const Key &key) const {
+		size_t p = search(key);
+		if (p == tot) throw index_out_of_bound("from unordered_map::at");
+		return slot[p].second;
+	}
+	/**
+	 * access specified element, performing an insertion if such key does not already exist.
+	 */
+	T & operator[](const Key &key) {
+		size_t p = search(key);
+		if (p == tot) p = place(value_type(key, T()));
+		return slot[p].second;
+	}
+	/**
+	 * behave like at() throw index_out_of_bound if such key does not exist.
+	 */
+	const T & operator[](const Key &key) const {
+		return at(key);
+	}
+	iterator begin() { return iterator(next_used(0), this); }
+	const_iterator cbegin() const { return const_iterator(next_used(0), this); }
+	iterator end() { return iterator(tot, this); }
+	const_iterator cend() const { return const_iterator(tot, this); }
+	bool empty() const { return n == 0; }
+	size_t size() const { return n; }
+	/**
+	 * number of home slots, and the ratio of elements to them.
+	 */
+	size_t bucket_count() const { return cap; }
+	double load_factor() const { return (cap == 0) ? 0.0 : (double)n / cap; }
+	/**
+	 * clears the contents, keeping the allocated table.
+	 */
+	void clear() {
+		for (size_t i = 0; i < tot; i++)
+			if (dist[i] != 0) {
+				slot[i].~value_type();
+				dist[i] = 0;
+			}
+		n = 0;
+	}
+	/**
+	 * make room for at least cnt elements without further rehashing.
+	 */
+	void reserve(size_t cnt) {
+		size_t c = 8;
+		while (c * max_load_num < cnt * max_load_den) c <<= 1;
+		if (c > cap) rehash(c);
+	}
+	/**
+	 * rebuild the table with at least cnt home slots (rounded up to a power of two,
+	 *   and never below what the current size needs).
+	 */
+	void rehash(size_t cnt) {
+		size_t c = 8;
+		int b = 3;
+		while (c < cnt || c * max_load_num < n * max_load_den) c <<= 1, b++;
+		relocate(c, b);
+	}
+	pair<iterator, bool> insert(const value_type &value) {
+		size_t p = search(value.first);
+		if (p != tot) return pair<iterator, bool>(iterator(p, this), false);
+		p = place(value);
+		return pair<iterator, bool>(iterator(p, this), true);
+	}
+	/**
+	 * erase the element at pos, return the iterator following it.
+	 *
+	 * throw if pos pointed to a bad element (pos == this->end() || pos points an element out of this)
+	 */
+	iterator erase(iterator pos) {
+		if (pos.t != this) throw invalid_iterator("from unordered_map::erase Not for this map");
+		if (pos.p >= tot || dist[pos.p] == 0) throw invalid_iterator("from unordered_map::erase end()");
+		remove(pos.p);
+		return iterator(next_used(pos.p), this);
+	}
+	size_t erase(const Key &key) {
+		size_t p = search(key);
+		if (p == tot) return 0;
+		remove(p);
+		return 1;
+	}
+	size_t count(const Key &key) const {
+		return (search(key) == tot) ? 0 : 1;
+	}
+	iterator find(const Key &key) {
+		return iterator(search(key), this);
+	}
+	const_iterator find(const Key &key) const {
+		return const_iterator(search(key), this);
+	}
+private:
+	static const size_t max_load_num = 7, max_load_den = 8;
+	value_type* slot;
+	unsigned int* dist;
+	int bits;
+	size_t cap, tot, n;
+	Hash hash;
+	Eq eq;
+	size_t home(const Key &key) const {
+		return home(key, bits);
+	}
+	size_t home(const Key &key, int b) const {
+		size_t h = hash(key) * (size_t)11400714819323198485ull;
+		return h >> (sizeof(size_t) * 8 - b);
+	}
+	size_t next_used(size_t p) const {
+		while (p < tot && dist[p] == 0) ++p;
+		return p;
+	}
+	size_t search(const Key &key) const {
+		if (n == 0) return tot;
+		size_t p = home(key);
+		for (unsigned int d = 1; p < tot && dist[p] >= d; ++p, ++d)
+			if (dist[p] == d && eq(slot[p].first, key)) return p;
+		return tot;
+	}
+	/**
+	 * put a value known to be absent, return the slot it ends in.
+	 * the value is copied before anything moves, and if moving it or the
+	 *   cluster in throws, the cluster is shifted back over the gap: the
+	 *   map is left as it was (see close for a move that throws again).
+	 */
+	size_t place(const value_type &value) {
+		if (cap == 0 || (n + 1) * max_load_den > cap * max_load_num) rehash(cap * 2);
+		for (;;) {
+			size_t p = home(value.first);
+			unsigned int d = 1;
+			while (p < tot && dist[p] >= d) ++p, ++d;
+			size_t q = p;
+			while (q < tot && dist[q] != 0) ++q;
+			if (q == tot) {
+				if (n * 8 < cap) throw runtime_error("from unordered_map probe sequence too long, bad hash");
+				rehash(cap * 2);
+				continue;
+			}
+			value_type v(value);
+			try {
+				for (; q > p; --q) {
+					new (slot + q) value_type(std::move(slot[q - 1]));
+					dist[q] = dist[q - 1] + 1;
+					slot[q - 1].~value_type();
+					dist[q - 1] = 0;
+				}
+				new (slot + p) value_type(std::move(v));
+			}
+			catch (...) {
+				close(q);
+				throw;
+			}
+			dist[p] = d;
+			++n;
+			return p;
+		}
+	}
+	void remove(size_t p) {
+		slot[p].~value_type();
+		dist[p] = 0;
+		--n;
+		close(p);
+	}
+	/**
+	 * fill the empty slot p by shifting the rest of its cluster back left
+	 *   (backward shift), nothing past p is reachable until then.
+	 * a move copies the const key, so it can throw with a key like
+	 *   std::string; the elements not shifted yet would stay hidden behind
+	 *   the gap, they are destroyed instead and the table stays valid.
+	 */
+	void close(size_t p) noexcept {
+		try {
+			for (; p + 1 < tot && dist[p + 1] > 1; ++p) {
+				new (slot + p) value_type(std::move(slot[p + 1]));
+				dist[p] = dist[p + 1] - 1;
+				slot[p + 1].~value_type();
+				dist[p + 1] = 0;
+			}
+		}
+		catch (...) {
+			for (++p; p < tot && dist[p] > 1; ++p) {
+				slot[p].~value_type();
+				dist[p] = 0;
+				--n;
+			}
+		}
+	}
+	/**
+	 * move every element into a new table of c home slots.
+	 *
+	 * in a table that does not wrap, the homes alone fix the layout: taken in
+	 *   order of home, an element sits at its home or right after the one
+	 *   before it.  so all homes are hashed first, the slot of every element is
+	 *   counted out from them (the overflow area is widened if the count runs
+	 *   past it) and each element is built once where it belongs, never shifted.
+	 * elements are moved when that cannot throw and copied otherwise, so a
+	 *   throw from the hash or a copy leaves the old table as it was.
+	 */
+	void relocate(size_t c, int b) {
+		size_t e = (b < 4) ? 4 : b, nt = 0;
+		size_t *hm = NULL, *st = NULL;
+		value_type* ns = NULL;
+		unsigned int* nd = NULL;
+		try {
+			hm = new size_t[tot == 0 ? 1 : tot];
+			st = new size_t[c];
+			for (size_t h = 0; h < c; h++) st[h] = 0;
+			for (size_t i = 0; i < tot; i++)
+				if (dist[i] != 0) st[hm[i] = home(slot[i].first, b)]++;
+			size_t p = 0;
+			for (size_t h = 0; h < c; h++) {
+				size_t k = st[h];
+				st[h] = (p < h) ? h : p;
+				p = st[h] + k;
+			}
+			nt = (p > c + e) ? p : c + e;
+			ns = static_cast<value_type*>(::operator new(sizeof(value_type) * nt));
+			nd = new unsigned int[nt];
+			for (size_t i = 0; i < nt; i++) nd[i] = 0;
+			for (size_t i = 0; i < tot; i++)
+				if (dist[i] != 0) {
+					size_t q = st[hm[i]]++;
+					new (ns + q) value_type(std::move_if_noexcept(slot[i]));
+					nd[q] = (unsigned int)(q - hm[i] + 1);
+				}
+		}
+		catch (...) {
+			if (nd != NULL)
+				for (size_t i = 0; i < nt; i++)
+					if (nd[i] != 0) ns[i].~value_type();
+			::operator delete(ns);
+			delete[] nd;
+			delete[] st;
+			delete[] hm;
+			throw;
+		}
+		delete[] st;
+		delete[] hm;
+		size_t m = n;
+		destroy();
+		slot = ns; dist = nd;
+		bits = b; cap = c; tot = nt; n = m;
+	}
+	void destroy() {
+		clear();
+		::operator delete(slot);
+		delete[] dist;
+		slot = NULL; dist = NULL;
+	}
+};
+
+}
+
+#endif
@@ -2,6 +2,20 @@
 #define SJTU_UTILITY_HPP
 
 #include <utility>
+#include <tuple>
+#include <cstddef>
+
+/**
+ * hint the cpu to pull the cache line holding p, it never faults.
+ */
+#if defined(__GNUC__)
+#define SJTU_PREFETCH(p) __builtin_prefetch(p)
+#elif defined(_MSC_VER)
+#include <xmmintrin.h>
+#define SJTU_PREFETCH(p) _mm_prefetch((const char*)(p), _MM_HINT_T0)
+#else
+#define SJTU_PREFETCH(p) ((void)0)
+#endif
 
 namespace sjtu {
 
@@ -15,11 +29,23 @@ public:
 	pair(pair &&other) = default;
 	pair(const T1 &x, const T2 &y) : first(x), second(y) {}
 	template<class U1, class U2>
-	pair(U1 &&x, U2 &&y) : first(x), second(y) {}
+	pair(U1 &&x, U2 &&y) : first(std::forward<U1>(x)), second(std::forward<U2>(y)) {}
 	template<class U1, class U2>
 	pair(const pair<U1, U2> &other) : first(other.first), second(other.second) {}
 	template<class U1, class U2>
-	pair(pair<U1, U2> &&other) : first(other.first), second(other.second) {}
+	pair(pair<U1, U2> &&other) : first(std::forward<U1>(other.first)), second(std::forward<U2>(other.second)) {}
+	/**
+	 * build first from the elements of x and second from those of y in
+	 *   place, for types that cannot be copied or moved.
+	 */
+	template<class... A1, class... A2>
+	pair(std::piecewise_construct_t, std::tuple<A1...> x, std::tuple<A2...> y)
+		: pair(x, y, std::index_sequence_for<A1...>(), std::index_sequence_for<A2...>()) {}
+private:
+	template<class X, class Y, std::size_t... I1, std::size_t... I2>
+	pair(X &x, Y &y, std::index_sequence<I1...>, std::index_sequence<I2...>)
+		: first(std::forward<typename std::tuple_element<I1, X>::type>(std::get<I1>(x))...),
+		second(std::forward<typename std::tuple_element<I2, Y>::type>(std::get<I2>(y))...) {}
 };
 
 }